@@ -0,0 +1,64 @@
+#pragma once
+
+#include <ros/ros.h>
+#include <boost/function.hpp>
+
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+#include "argus_utils/synchronization/WorkerPool.h"
+
+#include <map>
+
+namespace argus
+{
+
+/*! \brief Renders and publishes debug outputs on a low-priority background
+ * thread, so that the thread producing them only pays for copying a snapshot
+ * of what to draw. Outputs are identified by key, such as a camera name, and
+ * each is rendered only while subscribed and at up to a max rate. Only the
+ * newest job of each key is kept, so a slow renderer drops outputs rather than
+ * falling behind. Thread-safe.
+ */
+class BackgroundRenderer
+{
+public:
+
+	typedef boost::function<void()> Job;
+
+	/*! \brief Creates a renderer limiting each output to rate Hz. A rate of 0
+	 * does not limit the rate. */
+	BackgroundRenderer( double rate = 0 );
+	~BackgroundRenderer();
+
+	void SetMaxRate( double rate );
+	double GetMaxRate() const;
+
+	/*! \brief Returns whether the output is subscribed and due to be rendered.
+	 * If so, it is marked as rendered, and the caller should snapshot what to
+	 * draw and submit a job. */
+	bool ShouldRender( const std::string& key, unsigned int numSubscribers );
+
+	/*! \brief Queues a job to render from a snapshot it owns, replacing any
+	 * job of the same key that has not started. */
+	void Submit( const std::string& key, const Job& job );
+
+	unsigned int NumRendered() const;
+	unsigned int NumDropped() const;
+
+private:
+
+	mutable Mutex _mutex;
+	ConditionVariable _hasJobCond;
+	ros::WallDuration _minInterval;
+	std::map<std::string, ros::WallTime> _lastRenderTimes;
+	std::map<std::string, Job> _pending;
+	bool _closed;
+
+	unsigned int _numRendered;
+	unsigned int _numDropped;
+
+	WorkerPool _worker; // Declared after the state it uses
+
+	void RenderSpin();
+};
+
+}
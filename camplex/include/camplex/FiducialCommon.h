@@ -94,17 +94,25 @@ bool CheckDetectionROI( const FiducialDetection& det,
  * if a fiducial detection will be valid. */
 double FindMinDistance( const std::vector <argus_msgs::Point2D>& points );
 
-PoseSE3 EstimateArrayPose( const FiducialDetection& detection,
-                           const Fiducial& fiducial,
-                           const PoseSE3& guess = PoseSE3() );
-
 /*! \brief Estimates the array pose using OpenCV's solvePnP. Requires normalized and
  * undistorted detections. Assumes standard camera convention (z-forward) for 
- * imagePoints and object convention (x-forward) for input and returned poses. */
-// NOTE Currently the guess functionality is broken?
+ * imagePoints and object convention (x-forward) for returned poses. Planar
+ * arrays are initialized from a homography decomposition before LM refinement. */
+PoseSE3 EstimateArrayPose( const FiducialDetection& detection,
+                           const Fiducial& fiducial );
+PoseSE3 EstimateArrayPose( const std::vector<FiducialDetection>& detections,
+                           const std::vector<Fiducial>& fiducials );
+
+/*! \brief Estimates the array pose as above, warm-starting LM refinement from
+ * a guess in the same convention as the returned pose, such as the previous
+ * estimate for the same stream. Falls back to a cold solve if the refined pose
+ * has a large reprojection error. */
+PoseSE3 EstimateArrayPose( const FiducialDetection& detection,
+                           const Fiducial& fiducial,
+                           const PoseSE3& guess );
 PoseSE3 EstimateArrayPose( const std::vector<FiducialDetection>& detections,
-                           const std::vector<Fiducial>& camplex,
-                           const PoseSE3& guess = PoseSE3() );
+                           const std::vector<Fiducial>& fiducials,
+                           const PoseSE3& guess );
 
 template<typename Scalar, typename Derived>
 void
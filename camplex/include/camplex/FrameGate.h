@@ -0,0 +1,81 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+#include <iostream>
+#include <map>
+
+namespace argus
+{
+
+/*! \brief Parameters for gating frames before fiducial detection. */
+struct FrameGateParams
+{
+	/*! \brief Width of the thumbnail the metrics are computed on (pix). */
+	unsigned int thumbnailWidth;
+	/*! \brief Min variance of the thumbnail Laplacian. 0 disables the check. */
+	double minSharpness;
+	/*! \brief Min mean absolute thumbnail difference from the last accepted
+	 * frame of the same source (intensity). 0 disables the check. */
+	double minNovelty;
+
+	FrameGateParams();
+};
+std::ostream& operator<<( std::ostream& os, const FrameGateParams& params );
+
+/*! \brief Rejects frames that are too blurry, or too similar to the last
+ * accepted frame of their source, to be worth running a detector on.
+ * Sources are tracked independently by name. Thread-safe.
+ */
+class FrameGate
+{
+public:
+
+	enum Result
+	{
+		FRAME_ACCEPTED = 0,
+		FRAME_BLURRY,
+		FRAME_REDUNDANT
+	};
+
+	FrameGate( const FrameGateParams& params = FrameGateParams() );
+
+	void SetParams( const FrameGateParams& params );
+	FrameGateParams GetParams() const;
+
+	/*! \brief Evaluates a grayscale or BGR image from the named source. Accepted
+	 * frames become the novelty reference for that source. */
+	Result Evaluate( const std::string& source, const cv::Mat& image );
+
+	/*! \brief Forgets all novelty references. Does not reset the counters. */
+	void Reset();
+
+	unsigned int NumAccepted() const;
+	unsigned int NumBlurry() const;
+	unsigned int NumRedundant() const;
+	unsigned int NumSkipped() const;
+
+	/*! \brief Returns the sharpness metric of an image. */
+	static double ComputeSharpness( const cv::Mat& thumbnail );
+	/*! \brief Returns the novelty metric between two same-size thumbnails. */
+	static double ComputeNovelty( const cv::Mat& thumbnail, const cv::Mat& reference );
+
+private:
+
+	mutable Mutex _mutex;
+	FrameGateParams _params;
+
+	std::map<std::string, cv::Mat> _references;
+
+	unsigned int _numAccepted;
+	unsigned int _numBlurry;
+	unsigned int _numRedundant;
+
+	cv::Mat MakeThumbnail( const cv::Mat& image, unsigned int width ) const;
+};
+
+std::ostream& operator<<( std::ostream& os, const FrameGate& gate );
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+namespace argus
+{
+
+/*! \brief A single-slot mailbox that hands a consumer the newest posted item.
+ * Posting over an item that has not been taken replaces it and counts it as
+ * skipped, so a slow consumer always works on the freshest data instead of
+ * falling behind a queue. Thread-safe.
+ */
+template <typename T>
+class LatestFrameMailbox
+{
+public:
+
+	LatestFrameMailbox()
+	: _hasItem( false ), _closed( false ), _numSkipped( 0 ) {}
+
+	/*! \brief Posts an item, replacing any untaken item. Returns whether an
+	 * item was replaced. */
+	bool Post( const T& item )
+	{
+		bool replaced;
+		{
+			WriteLock lock( _mutex );
+			replaced = _hasItem;
+			if( replaced ) { ++_numSkipped; }
+			_item = item;
+			_hasItem = true;
+		}
+		_hasItemCond.notify_one();
+		return replaced;
+	}
+
+	/*! \brief Takes the item if there is one. Returns success. Also returns
+	 * the number of items replaced since the last take. */
+	bool TryTake( T& item, unsigned int& skipped )
+	{
+		WriteLock lock( _mutex );
+		return TakeLocked( item, skipped );
+	}
+
+	/*! \brief Blocks until an item is posted or the mailbox is closed. Returns
+	 * false if closed. */
+	bool WaitTake( T& item, unsigned int& skipped )
+	{
+		WriteLock lock( _mutex );
+		while( !_hasItem && !_closed )
+		{
+			_hasItemCond.wait( lock );
+		}
+		return TakeLocked( item, skipped );
+	}
+
+	/*! \brief Returns whether an item is waiting to be taken. */
+	bool HasItem() const
+	{
+		ReadLock lock( _mutex );
+		return _hasItem;
+	}
+
+	/*! \brief Wakes all waiting consumers and makes further waits return
+	 * immediately. */
+	void Close()
+	{
+		{
+			WriteLock lock( _mutex );
+			_closed = true;
+		}
+		_hasItemCond.notify_all();
+	}
+
+private:
+
+	mutable Mutex _mutex;
+	ConditionVariable _hasItemCond;
+	T _item;
+	bool _hasItem;
+	bool _closed;
+	unsigned int _numSkipped;
+
+	bool TakeLocked( T& item, unsigned int& skipped )
+	{
+		if( !_hasItem ) { return false; }
+		item = _item;
+		_item = T();
+		_hasItem = false;
+		skipped = _numSkipped;
+		_numSkipped = 0;
+		return true;
+	}
+};
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+#include <atomic>
+#include <map>
+#include <vector>
+
+namespace argus
+{
+/*! \brief Collects per-stage timings and event counters of a processing
+ * pipeline. Each stage keeps its most recent timings in a rolling window
+ * for percentile reports, while counters accumulate until the next report.
+ * Names are taken as C strings, and the enabled flag is checked before any
+ * locking, so a disabled profiler costs only a branch per call. Thread-safe.
+ */
+class PipelineProfiler
+{
+public:
+
+	/*! \brief Times the enclosing scope as one sample of a stage. The stage
+	 * name must outlive the timer. */
+	class ScopedTimer
+	{
+	public:
+
+		ScopedTimer( PipelineProfiler& profiler, const char* stage );
+		~ScopedTimer();
+
+		/*! \brief Records the sample now instead of on destruction. */
+		void Stop();
+
+	private:
+
+		PipelineProfiler& _profiler;
+		const char* _stage;
+		bool _running;
+		ros::WallTime _start;
+	};
+
+	PipelineProfiler( bool enabled = true, unsigned int windowSize = 500 );
+
+	void SetEnabled( bool enabled );
+	bool IsEnabled() const;
+
+	/*! \brief Records a timing sample in seconds. */
+	void AddTiming( const char* stage, double seconds );
+
+	/*! \brief Adds to a counter. */
+	void Increment( const char* counter, double amount = 1.0 );
+
+	/*! \brief Reports the p50, p95, p99 and max of each stage window in ms,
+	 * the number of samples since the last report, and the counters. Resets
+	 * the counters and sample counts, but keeps the windows. */
+	diagnostic_msgs::DiagnosticStatus Report( const std::string& name,
+	                                          const std::string& hardwareId = "" );
+
+	/*! \brief Clears all stages and counters. */
+	void Reset();
+
+private:
+
+	struct StageWindow
+	{
+		std::vector<double> samples;
+		size_t next; // Ring index of the next sample
+		unsigned int numNew; // Samples since the last report
+
+		StageWindow() : next( 0 ), numNew( 0 ) {}
+	};
+
+	mutable Mutex _mutex;
+	std::atomic<bool> _enabled;
+	unsigned int _windowSize;
+	std::map<std::string, StageWindow> _stages;
+	std::map<std::string, double> _counters;
+};
+}
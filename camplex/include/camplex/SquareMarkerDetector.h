@@ -0,0 +1,87 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+#include "camplex/FiducialCommon.h"
+
+namespace argus
+{
+
+/*! \brief Parameters for the square binary marker detector. */
+struct SquareMarkerParams
+{
+	/*! \brief Integer downsampling factor used for quad detection. */
+	unsigned int decimation;
+	/*! \brief Adaptive threshold window dimension at decimated resolution (pix). */
+	unsigned int thresholdBlockDim;
+	/*! \brief Adaptive threshold offset from local mean (intensity). */
+	double thresholdOffset;
+	/*! \brief Min/max quad perimeter as ratio of max image dimension. */
+	double minPerimeterRatio;
+	double maxPerimeterRatio;
+	/*! \brief Min quad side length at full resolution (pix). */
+	double minSideLength;
+	/*! \brief Polygon approximation tolerance as ratio of contour perimeter. */
+	double polygonTolerance;
+	/*! \brief Whether to refine quad edges at full resolution. */
+	bool enableEdgeRefinement;
+	/*! \brief Edge search half-width along the side normal (full res pix). */
+	double edgeSearchRadius;
+	/*! \brief Side length of each marker cell in the rectified marker image (pix). */
+	unsigned int cellPixels;
+	/*! \brief Max number of white cells tolerated in the black marker border. */
+	unsigned int maxBorderErrors;
+	/*! \brief Prefix prepended to the marker ID to form the fiducial name. */
+	std::string namePrefix;
+
+	SquareMarkerParams();
+};
+std::ostream& operator<<( std::ostream& os, const SquareMarkerParams& params );
+
+/*! \brief Detects square binary markers of the original ArUco 5x5 dictionary
+ * (1024 IDs). Quads are found on a decimated image, their edges are refined
+ * at full resolution, and the payload is then decoded. Candidates of a single
+ * image are refined and decoded in parallel.
+ *
+ * Detections have points ordered top-left, top-right, bottom-right, bottom-left
+ * in the marker frame, and are named namePrefix + ID. See GenerateMarkerName
+ * and GenerateMarkerFiducial for the corresponding fiducial intrinsics.
+ */
+class SquareMarkerDetector
+{
+public:
+
+	SquareMarkerDetector( const SquareMarkerParams& params = SquareMarkerParams() );
+
+	void SetParams( const SquareMarkerParams& params );
+	const SquareMarkerParams& GetParams() const;
+
+	/*! \brief Finds all markers in a grayscale image. Detections are not
+	 * undistorted or normalized. */
+	std::vector<FiducialDetection> Detect( const cv::Mat& image ) const;
+
+	/*! \brief Returns the rectified binary payload for a marker ID, with bit
+	 * (i,j) set where the cell is white. Throws if the ID is not in [0,1023]. */
+	static std::vector<std::vector<bool> > GenerateMarkerBits( unsigned int id );
+
+	/*! \brief Returns the fiducial name corresponding to a marker ID. */
+	static std::string GenerateMarkerName( const std::string& prefix, unsigned int id );
+
+	/*! \brief Returns the fiducial intrinsics for a marker of the specified outer
+	 * black border side length, centered on the marker. */
+	static Fiducial GenerateMarkerFiducial( double dim );
+
+private:
+
+	SquareMarkerParams _params;
+
+	typedef std::vector<cv::Point2f> Quad;
+
+	void FindQuads( const cv::Mat& image, std::vector<Quad>& quads ) const;
+	bool RefineEdges( const cv::Mat& image, Quad& quad ) const;
+	bool DecodeQuad( const cv::Mat& image, Quad& quad, unsigned int& id ) const;
+
+	friend class SquareMarkerDecodeBody;
+};
+
+}
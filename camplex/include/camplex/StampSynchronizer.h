@@ -0,0 +1,104 @@
+#pragma once
+
+#include <ros/ros.h>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+#include <iostream>
+#include <vector>
+
+namespace argus
+{
+
+/*! \brief Groups messages from several inputs into sets with matching stamps.
+ * Each input buffers up to a fixed number of messages in preallocated slots, so
+ * matching never allocates. A set is emitted as soon as its last message
+ * arrives, when every other input has a message within the match window of its
+ * stamp. A window of 0 requires exact stamps. Emitting a set evicts it and all
+ * older buffered messages, which can no longer complete a set, and messages
+ * older than the last emitted set of their input are rejected as late.
+ * Thread-safe.
+ */
+class StampSynchronizer
+{
+public:
+
+	typedef boost::shared_ptr<const void> Message;
+	/*! \brief A matched message for each input, in input order. */
+	typedef std::vector<Message> MessageSet;
+	typedef boost::function<void( const MessageSet& )> Callback;
+
+	/*! \brief Creates a synchronizer buffering queueSize messages per input
+	 * and matching stamps within window seconds. */
+	StampSynchronizer( unsigned int numInputs, unsigned int queueSize,
+	                   double window = 0 );
+
+	/*! \brief Sets the set callback. It is called with the synchronizer locked,
+	 * so it should be short and must not call back into the synchronizer. */
+	void RegisterCallback( const Callback& callback );
+
+	void SetWindow( double window );
+	double GetWindow() const;
+
+	/*! \brief Adds a message to an input. Returns whether it completed a set. */
+	bool Add( unsigned int input, const ros::Time& stamp, const Message& msg );
+
+	/*! \brief Adds a message with a header to an input. */
+	template <typename M>
+	bool Add( unsigned int input, const boost::shared_ptr<const M>& msg )
+	{
+		return Add( input, msg->header.stamp, msg );
+	}
+
+	/*! \brief Retrieves the typed message of an input from a set. */
+	template <typename M>
+	static boost::shared_ptr<const M> Get( const MessageSet& set, unsigned int input )
+	{
+		return boost::static_pointer_cast<const M>( set.at( input ) );
+	}
+
+	/*! \brief Clears all buffered messages. Does not reset the counters. */
+	void Reset();
+
+	unsigned int NumInputs() const;
+	unsigned int NumMatched() const;
+	unsigned int NumDropped() const;
+	unsigned int NumLate() const;
+
+private:
+
+	struct Slot
+	{
+		ros::Time stamp;
+		Message msg;
+	};
+
+	struct InputBuffer
+	{
+		std::vector<Slot> slots; // Empty slots have null messages
+		ros::Time lastMatched;
+	};
+
+	mutable Mutex _mutex;
+	Callback _callback;
+	ros::Duration _window;
+	std::vector<InputBuffer> _inputs;
+
+	// Reused to match and emit sets
+	std::vector<int> _matchedSlots;
+	MessageSet _matchedSet;
+
+	unsigned int _numMatched;
+	unsigned int _numDropped;
+	unsigned int _numLate;
+
+	// Returns the slot closest to stamp within the window, or -1 if none
+	int FindMatch( const InputBuffer& buffer, const ros::Time& stamp ) const;
+	void EvictThrough( InputBuffer& buffer, const ros::Time& stamp );
+};
+
+std::ostream& operator<<( std::ostream& os, const StampSynchronizer& sync );
+
+}
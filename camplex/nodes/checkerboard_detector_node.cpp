@@ -5,6 +5,7 @@
 #include <opencv2/calib3d/calib3d.hpp>
 
 #include "camplex/FiducialCommon.h"
+#include "camplex/FrameGate.h"
 
 #include "argus_utils/utils/ParamUtils.h"
 #include "argus_utils/synchronization/ThreadsafeQueue.hpp"
@@ -41,6 +42,17 @@ public:
 			                                    epsilon );
 		}
 
+		FrameGateParams gateParams;
+		GetParam( ph, "gate_thumbnail_width", gateParams.thumbnailWidth, gateParams.thumbnailWidth );
+		GetParam( ph, "gate_min_sharpness", gateParams.minSharpness, gateParams.minSharpness );
+		GetParam( ph, "gate_min_novelty", gateParams.minNovelty, gateParams.minNovelty );
+		_gate.SetParams( gateParams );
+		_enableGating = gateParams.minSharpness > 0 || gateParams.minNovelty > 0;
+		if( _enableGating )
+		{
+			ROS_INFO_STREAM( "Gating frames with parameters: " << std::endl << gateParams );
+		}
+
 		_detPub = ph.advertise<argus_msgs::ImageFiducialDetections>( "detections", 20 );
 
 		unsigned int buffLen;
@@ -84,6 +96,13 @@ public:
 				frame = msgFrame;
 			}
 
+			if( _enableGating )
+			{
+				FrameGate::Result result = _gate.Evaluate( msg->header.frame_id, frame );
+				ROS_INFO_STREAM_THROTTLE( 10.0, "Frame gate: " << _gate );
+				if( result != FrameGate::FRAME_ACCEPTED ) { continue; }
+			}
+
 			if( !cv::findChessboardCorners( frame,
 			                                _boardSize,
 			                                corners,
@@ -127,6 +146,9 @@ private:
 	WorkerPool _detectorWorkers;
 	ThreadsafeQueue<sensor_msgs::Image::ConstPtr> _imageBuffer;
 
+	bool _enableGating;
+	FrameGate _gate;
+
     std::string _boardName;
 	cv::Size _boardSize;
 	bool _enableRefinement;
@@ -5,6 +5,7 @@
 
 #include "argus_msgs/ImageFiducialDetections.h"
 
+#include "camplex/BackgroundRenderer.h"
 #include "camplex/FiducialCommon.h"
 #include "camplex/FiducialInfoManager.h"
 #include "camplex/FiducialVisualizer.h"
@@ -13,8 +14,16 @@
 
 #include "extrinsics_array/ExtrinsicsInterface.h"
 
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+#include "argus_utils/synchronization/WorkerPool.h"
+
+#include <std_msgs/Empty.h>
+#include <visualization_msgs/MarkerArray.h>
 
 #include <boost/foreach.hpp>
+#include <deque>
+#include <memory>
+#include <unordered_set>
 
 using namespace argus;
 
@@ -29,13 +38,34 @@ public:
 		GetParam<std::string>( ph, "reference_frame", _refFrame, "" );
 		GetParam<std::string>( ph, "body_frame", _robotFrame, "base_link");
 
-		bool combineDetect;
-		GetParam( ph, "combine_detections", combineDetect, true);
+		GetParam( ph, "combine_detections", _combineDetect, true);
 
 		unsigned int inBuffSize, outBuffSize;
 		GetParam( ph, "input_buffer_size", inBuffSize, (unsigned int) 20 );
 		GetParam( ph, "output_buffer_size", outBuffSize, (unsigned int) 20 );
 
+		// Previous estimates older than this are not used to warm-start pose estimation
+		double maxGuessAge;
+		GetParam( ph, "warm_start_max_age", maxGuessAge, 0.5 );
+		_maxGuessAge = ros::Duration( maxGuessAge );
+		_solveTime = 0;
+		_numSolves = 0;
+		_numWarmSolves = 0;
+
+		// Extrinsics of static frames are cached until an update is signaled on
+		// extrinsics_updated, while other frames are cached for a TTL
+		std::vector<std::string> staticFrames;
+		GetParam( ph, "static_frames", staticFrames, std::vector<std::string>() );
+		_staticFrames.insert( staticFrames.begin(), staticFrames.end() );
+		GetParam( ph, "all_frames_static", _allFramesStatic, false );
+		double cacheTtl;
+		GetParam( ph, "extrinsics_cache_ttl", cacheTtl, 0.0 );
+		_cacheTtl = ros::Duration( cacheTtl );
+		_updateSub = nh.subscribe( "extrinsics_updated",
+		                           10,
+		                           &FiducialPoseEstimator::ExtrinsicsUpdatedCallback,
+		                           this );
+
 		_enableVis = ph.hasParam( "visualization" );
 		if( _enableVis )
 		{
@@ -48,32 +78,46 @@ public:
 			GetParamRequired( ph, "visualization/reference_frame", refFrame );
 			_camVis.SetFrameID( refFrame );
 			_fidVis.SetFrameID( refFrame );
-			_visPub = nh.advertise<MarkerMsg>( "markers", 10 );
-		}
+			_visPub = nh.advertise<visualization_msgs::MarkerArray>( "markers", 10 );
 
-		if( combineDetect )
-		{
-			_detSub = nh.subscribe( "detections",
-															inBuffSize,
-															&FiducialPoseEstimator::DetectionsCallbackCombined,
-															this );
+			// Markers are built on a background thread, per camera at up to the rate
+			double visRate;
+			GetParam( ph, "visualization/max_rate", visRate, 10.0 );
+			_renderer = std::make_shared<BackgroundRenderer>( visRate );
 		}
-		else
+
+		// Messages from each camera are processed in order, but different
+		// cameras are processed in parallel
+		unsigned int numWorkers;
+		GetParam( ph, "num_workers", numWorkers, (unsigned int) 4 );
+		GetParam( ph, "camera_queue_size", _maxQueueSize, (unsigned int) 5 );
+		_workers.SetNumWorkers( numWorkers );
+		_workers.StartWorkers();
+
+		double statsPeriod;
+		GetParam( ph, "stats_period", statsPeriod, 10.0 );
+		if( statsPeriod > 0 )
 		{
-			_detSub = nh.subscribe( "detections",
-															inBuffSize,
-															&FiducialPoseEstimator::DetectionsCallbackIndependent,
-															this );
+			_statsTimer = nh.createTimer( ros::Duration( statsPeriod ),
+			                              &FiducialPoseEstimator::StatsCallback,
+			                              this );
 		}
+
 		_posePub = ph.advertise<geometry_msgs::TransformStamped>( "relative_pose",
 		                                                          outBuffSize );
+		_detSub = nh.subscribe( "detections",
+		                        inBuffSize,
+		                        &FiducialPoseEstimator::DetectionsCallback,
+		                        this );
 	}
 
 private:
 
 	std::string _refFrame;
 	std::string _robotFrame;
+	bool _combineDetect;
 	ros::Subscriber _detSub;
+	ros::Subscriber _updateSub;
 	ros::Publisher _posePub;
 
 	LookupInterface _lookupInterface;
@@ -81,16 +125,159 @@ private:
 	ExtrinsicsInterface _extrinsicsInterface;
 
 	bool _enableVis;
-	PoseVisualizer _camVis;
+	PoseVisualizer _camVis; // Only used by the render thread
 	FiducialVisualizer _fidVis;
 	ros::Publisher _visPub;
+	// Declared after the visualization state it draws with, and before the
+	// workers that submit to it, so that it stops after them
+	std::shared_ptr<BackgroundRenderer> _renderer;
+
+	// Copy of the estimate and fiducials visualized for one message
+	struct VisSnapshot
+	{
+		std::string cameraName;
+		PoseSE3 relPose;
+		std::vector<std::string> fidNames;
+		std::vector<Fiducial> fids;
+		std::vector<PoseSE3> fidExts;
+	};
+
+	typedef argus_msgs::ImageFiducialDetections::ConstPtr DetectionsPtr;
 
-	std::unordered_map<std::string, Fiducial> _transformedFiducials;
+	// Pending messages and processing statistics for a single camera. Each camera
+	// has at most one worker job draining its queue at a time.
+	struct CameraQueue
+	{
+		Mutex mutex;
+		std::deque<std::pair<DetectionsPtr, ros::WallTime> > queue;
+		bool active;
+
+		unsigned int numProcessed;
+		unsigned int numDropped;
+		double procTimeSum;
+		double latencySum;
+		double maxLatency;
+
+		CameraQueue()
+			: active( false ), numProcessed( 0 ), numDropped( 0 ),
+			procTimeSum( 0 ), latencySum( 0 ), maxLatency( 0 ) {}
+	};
+	typedef std::shared_ptr<CameraQueue> CameraQueuePtr;
+
+	Mutex _queuesMutex;
+	std::unordered_map<std::string, CameraQueuePtr> _cameraQueues;
+	unsigned int _maxQueueSize;
+	ros::Timer _statsTimer;
+
+	// Guards the fiducial and extrinsics caches and their lookup interfaces
+	Mutex _cacheMutex;
+
+	// Fiducial intrinsics and extrinsics relative to the reference frame
+	struct CachedFiducial
+	{
+		ros::Time time;
+		Fiducial fiducial;
+		Fiducial transformed;
+		PoseSE3 extrinsics;
+	};
+	typedef std::shared_ptr<const CachedFiducial> CachedFiducialPtr;
+	typedef std::unordered_map<std::string, CachedFiducialPtr> FiducialCache;
+	FiducialCache _fiducialCache;
+
+	struct CachedExtrinsics
+	{
+		ros::Time time;
+		PoseSE3 extrinsics;
+	};
+	typedef std::unordered_map<std::string, CachedExtrinsics> ExtrinsicsCache;
+	ExtrinsicsCache _extrinsicsCache;
+
+	std::unordered_set<std::string> _staticFrames;
+	bool _allFramesStatic;
+	ros::Duration _cacheTtl;
+
+	// Last estimated pose per camera-fiducial pair, used to warm-start estimation
+	struct CachedPose
+	{
+		ros::Time time;
+		PoseSE3 pose;
+	};
+	typedef std::unordered_map<std::string, CachedPose> PoseCache;
+	Mutex _poseMutex;
+	PoseCache _poseCache;
+	ros::Duration _maxGuessAge;
+
+	double _solveTime;
+	unsigned int _numSolves;
+	unsigned int _numWarmSolves;
+
+	WorkerPool _workers; // Declared after the state it uses
+
+	// Estimates the pose, warm-starting from and then updating the cache entry for key
+	PoseSE3 EstimatePose( const std::string& key, const ros::Time& time,
+	                      const std::vector<FiducialDetection>& detections,
+	                      const std::vector<Fiducial>& fiducials )
+	{
+		ros::WallTime start = ros::WallTime::now();
+
+		bool warm = false;
+		PoseSE3 guess;
+		{
+			WriteLock lock( _poseMutex );
+			PoseCache::const_iterator iter = _poseCache.find( key );
+			warm = iter != _poseCache.end() &&
+			       time >= iter->second.time &&
+			       ( time - iter->second.time ) <= _maxGuessAge;
+			if( warm ) { guess = iter->second.pose; }
+		}
+
+		PoseSE3 pose = warm ? EstimateArrayPose( detections, fiducials, guess )
+		                    : EstimateArrayPose( detections, fiducials );
+
+		WriteLock lock( _poseMutex );
+		CachedPose& entry = _poseCache[key];
+		entry.time = time;
+		entry.pose = pose;
+
+		if( warm ) { ++_numWarmSolves; }
+		_solveTime += ( ros::WallTime::now() - start ).toSec();
+		++_numSolves;
+		ROS_INFO_STREAM_THROTTLE( 30, "Pose estimation averaged " << 1E3 * _solveTime / _numSolves
+		                          << " ms over " << _numSolves << " calls ("
+		                          << _numWarmSolves << " warm-started)" );
+		return pose;
+	}
+
+	void ExtrinsicsUpdatedCallback( const std_msgs::Empty::ConstPtr& msg )
+	{
+		ROS_INFO_STREAM( "Extrinsics updated, clearing cached fiducials and extrinsics." );
+		WriteLock lock( _cacheMutex );
+		_fiducialCache.clear();
+		_extrinsicsCache.clear();
+	}
+
+	// Returns whether a cache entry created at stamp is still valid at time
+	bool IsCacheValid( const std::string& frame, const ros::Time& stamp,
+	                   const ros::Time& time ) const
+	{
+		if( _allFramesStatic || _staticFrames.count( frame ) > 0 ) { return true; }
+		if( _cacheTtl.isZero() ) { return false; }
+		ros::Duration age = time > stamp ? time - stamp : stamp - time;
+		return age <= _cacheTtl;
+	}
 
 	// Gets the specified fiducial transformed into _refFrame at the specified time
-	bool GetFiducial( const std::string& name, const ros::Time& time,
-	                  Fiducial& fid, PoseSE3& extrinsics )
+	CachedFiducialPtr GetFiducial( const std::string& name, const ros::Time& time )
 	{
+		WriteLock lock( _cacheMutex );
+		std::string key = name + "-" + _refFrame;
+		FiducialCache::const_iterator iter = _fiducialCache.find( key );
+		if( iter != _fiducialCache.end() &&
+		    IsCacheValid( name, iter->second->time, time ) )
+		{
+			return iter->second;
+		}
+
 		// Force lookup of fiducials in case initialization is slow
 		// NOTE This means "rogue" undocumented fiducials will slow the system down
 		if( !_fiducialManager.HasMember( name ) )
@@ -98,26 +285,145 @@ private:
 			if( !_fiducialManager.ReadMemberInfo( name, true ) )
 			{
 				ROS_INFO_STREAM_THROTTLE( 30, "Could not read intrinsics for " << name );
-				return false;
+				return CachedFiducialPtr();
 			}
 		}
-		fid = _fiducialManager.GetInfo( name );
-		extrinsics = PoseSE3();
-		if( _refFrame.empty() ) { return true; }
 
-		try
+		std::shared_ptr<CachedFiducial> entry = std::make_shared<CachedFiducial>();
+		entry->time = time;
+		entry->fiducial = _fiducialManager.GetInfo( name );
+		if( !_refFrame.empty() )
 		{
-			extrinsics = _extrinsicsInterface.GetExtrinsics( name, _refFrame, time );
+			try
+			{
+				entry->extrinsics = _extrinsicsInterface.GetExtrinsics( name, _refFrame, time );
+			}
+			catch( ExtrinsicsException& ex )
+			{
+				ROS_INFO_STREAM_THROTTLE( 30, "Could not get extrinsics for " << name << std::endl << ex.what() );
+				return CachedFiducialPtr();
+			}
+		}
+		entry->transformed = entry->fiducial.Transform( entry->extrinsics );
+		_fiducialCache[key] = entry;
+		return entry;
+	}
+
+	// Gets the camera extrinsics relative to _robotFrame
+	bool GetCameraExtrinsics( const std::string& name, const ros::Time& time,
+	                          PoseSE3& extrinsics )
+	{
+		WriteLock lock( _cacheMutex );
+		std::string key = name + "-" + _robotFrame;
+		ExtrinsicsCache::const_iterator iter = _extrinsicsCache.find( key );
+		if( iter != _extrinsicsCache.end() &&
+		    IsCacheValid( name, iter->second.time, time ) )
+		{
+			extrinsics = iter->second.extrinsics;
 			return true;
 		}
+
+		try
+		{
+			extrinsics = _extrinsicsInterface.GetExtrinsics( name, _robotFrame );
+		}
 		catch( ExtrinsicsException& ex )
 		{
 			ROS_INFO_STREAM_THROTTLE( 30, "Could not get extrinsics for " << name << std::endl << ex.what() );
 			return false;
 		}
+		CachedExtrinsics& entry = _extrinsicsCache[key];
+		entry.time = time;
+		entry.extrinsics = extrinsics;
+		return true;
+	}
+
+	CameraQueuePtr GetCameraQueue( const std::string& cameraName )
+	{
+		WriteLock lock( _queuesMutex );
+		CameraQueuePtr& cq = _cameraQueues[cameraName];
+		if( !cq ) { cq = std::make_shared<CameraQueue>(); }
+		return cq;
+	}
+
+	void DetectionsCallback( const DetectionsPtr& msg )
+	{
+		CameraQueuePtr cq = GetCameraQueue( msg->header.frame_id );
+
+		WriteLock lock( cq->mutex );
+		if( cq->queue.size() >= _maxQueueSize )
+		{
+			cq->queue.pop_front();
+			++cq->numDropped;
+		}
+		cq->queue.emplace_back( msg, ros::WallTime::now() );
+
+		if( !cq->active )
+		{
+			cq->active = true;
+			WorkerPool::Job job = boost::bind( &FiducialPoseEstimator::ProcessCamera, this, cq );
+			_workers.EnqueueJob( job );
+		}
+	}
+
+	// Drains a camera's queue in order, then releases it
+	void ProcessCamera( CameraQueuePtr cq )
+	{
+		while( true )
+		{
+			DetectionsPtr msg;
+			ros::WallTime received;
+			{
+				WriteLock lock( cq->mutex );
+				if( cq->queue.empty() )
+				{
+					cq->active = false;
+					return;
+				}
+				msg = cq->queue.front().first;
+				received = cq->queue.front().second;
+				cq->queue.pop_front();
+			}
+
+			ros::WallTime start = ros::WallTime::now();
+			if( _combineDetect ) { ProcessCombined( msg ); }
+			else { ProcessIndependent( msg ); }
+			ros::WallTime finish = ros::WallTime::now();
+
+			WriteLock lock( cq->mutex );
+			double latency = ( finish - received ).toSec();
+			++cq->numProcessed;
+			cq->procTimeSum += ( finish - start ).toSec();
+			cq->latencySum += latency;
+			cq->maxLatency = std::max( cq->maxLatency, latency );
+		}
 	}
 
-	void DetectionsCallbackCombined( const argus_msgs::ImageFiducialDetections::ConstPtr& msg )
+	void StatsCallback( const ros::TimerEvent& event )
+	{
+		WriteLock lock( _queuesMutex );
+		typedef std::unordered_map<std::string, CameraQueuePtr>::value_type Item;
+		BOOST_FOREACH( const Item& item, _cameraQueues )
+		{
+			CameraQueue& cq = *item.second;
+			WriteLock cqLock( cq.mutex );
+			if( cq.numProcessed == 0 && cq.numDropped == 0 ) { continue; }
+
+			double n = std::max( cq.numProcessed, 1u );
+			ROS_INFO_STREAM( item.first << ": processed " << cq.numProcessed
+			                 << " dropped " << cq.numDropped
+			                 << " mean proc " << 1E3 * cq.procTimeSum / n << " ms"
+			                 << " mean latency " << 1E3 * cq.latencySum / n << " ms"
+			                 << " max latency " << 1E3 * cq.maxLatency << " ms" );
+			cq.numProcessed = 0;
+			cq.numDropped = 0;
+			cq.procTimeSum = 0;
+			cq.latencySum = 0;
+			cq.maxLatency = 0;
+		}
+	}
+
+	void ProcessCombined( const DetectionsPtr& msg )
 	{
 		const std::string& cameraName = msg->header.frame_id;
 		const ros::Time& detTime = msg->header.stamp;
@@ -128,14 +434,12 @@ private:
 		// 1. Process all fiducials
 		BOOST_FOREACH( const argus_msgs::FiducialDetection & det, msg->detections )
 		{
-			Fiducial fid;
-			PoseSE3 extrinsics;
-			if( !GetFiducial( det.name, detTime, fid, extrinsics ) ) { continue; }
+			CachedFiducialPtr fid = GetFiducial( det.name, detTime );
+			if( !fid ) { continue; }
 
-			Fiducial fidTrans = fid.Transform( extrinsics );
-			fids.push_back( fid );
-			arrayFids.push_back( fidTrans );
-			fidExts.push_back( extrinsics );
+			fids.push_back( fid->fiducial );
+			arrayFids.push_back( fid->transformed );
+			fidExts.push_back( fid->extrinsics );
 			detections.push_back( det );
 		}
 
@@ -144,7 +448,7 @@ private:
 			return;
 		}
 
-		PoseSE3 relPose = EstimateArrayPose( detections, arrayFids );
+		PoseSE3 relPose = EstimatePose( cameraName + "-" + _refFrame, detTime, detections, arrayFids );
 
 		geometry_msgs::TransformStamped poseMsg;
 		poseMsg.header.stamp = msg->header.stamp;
@@ -153,56 +457,69 @@ private:
 		poseMsg.transform = PoseToTransform( relPose );
 		_posePub.publish( poseMsg );
 
-		if( _enableVis && _visPub.getNumSubscribers() > 0 )
+		if( _enableVis && _renderer->ShouldRender( cameraName, _visPub.getNumSubscribers() ) )
 		{
-
-			_fidVis.SetFrameID( cameraName );
-			std::vector<PoseSE3> camRelFidPoses;
-			std::vector<std::string> fidNames;
+			VisSnapshot snap;
+			snap.cameraName = cameraName;
+			snap.relPose = relPose;
+			snap.fids = fids;
+			snap.fidExts = fidExts;
 			for( unsigned int i = 0; i < detections.size(); ++i )
 			{
-				const std::string& fidName = detections[i].name;
-				const Fiducial& fid = fids[i];
-				std::string uid = cameraName + "-" + fidName;
-				_fidVis.SetMarkerName( uid );
-				PoseSE3 camRelFidPose = relPose * fidExts[i];
-				std::vector<MarkerMsg> fidMarkers = _fidVis.ToMarkers( camRelFidPose, fid, fidName );
-				PublishMarkers( fidMarkers );
+				snap.fidNames.push_back( detections[i].name );
 			}
+			BackgroundRenderer::Job job = boost::bind( &FiducialPoseEstimator::RenderMarkers,
+			                                           this, snap );
+			_renderer->Submit( cameraName, job );
+		}
+	}
 
-			_camVis.SetFrameID( cameraName );
-			_camVis.SetMarkerName( cameraName );
-			std::vector<PoseSE3> posesToVis;
-			std::vector<std::string> namesToVis;
-			posesToVis.push_back( PoseSE3() ); // Camera pose
-			namesToVis.push_back( cameraName );
-			posesToVis.push_back( relPose ); // Ref frame pose
-			namesToVis.push_back( _refFrame );
-			std::vector<MarkerMsg> camMarkers = _camVis.ToMarkers( posesToVis, namesToVis );
-			PublishMarkers( camMarkers );
+	void RenderMarkers( const VisSnapshot& snap )
+	{
+		const std::string& cameraName = snap.cameraName;
+		visualization_msgs::MarkerArray markers;
+		_fidVis.SetFrameID( cameraName );
+		for( unsigned int i = 0; i < snap.fids.size(); ++i )
+		{
+			const std::string& fidName = snap.fidNames[i];
+			std::string uid = cameraName + "-" + fidName;
+			_fidVis.SetMarkerName( uid );
+			PoseSE3 camRelFidPose = snap.relPose * snap.fidExts[i];
+			std::vector<MarkerMsg> fidMarkers = _fidVis.ToMarkers( camRelFidPose, snap.fids[i], fidName );
+			markers.markers.insert( markers.markers.end(), fidMarkers.begin(), fidMarkers.end() );
 		}
+
+		_camVis.SetFrameID( cameraName );
+		_camVis.SetMarkerName( cameraName );
+		std::vector<PoseSE3> posesToVis;
+		std::vector<std::string> namesToVis;
+		posesToVis.push_back( PoseSE3() ); // Camera pose
+		namesToVis.push_back( cameraName );
+		posesToVis.push_back( snap.relPose ); // Ref frame pose
+		namesToVis.push_back( _refFrame );
+		std::vector<MarkerMsg> camMarkers = _camVis.ToMarkers( posesToVis, namesToVis );
+		markers.markers.insert( markers.markers.end(), camMarkers.begin(), camMarkers.end() );
+		_visPub.publish( markers );
 	}
 
 	// Get pose of each detected tag relative to robot
-	void DetectionsCallbackIndependent( const argus_msgs::ImageFiducialDetections::ConstPtr& msg )
+	void ProcessIndependent( const DetectionsPtr& msg )
 	{
 		const std::string& cameraName = msg->header.frame_id;
 		const ros::Time& detTime = msg->header.stamp;
 
-		std::vector<Fiducial> fids;
-		std::vector<FiducialDetection> detections;
-		std::vector<PoseSE3> fidExts;
-		// 1. Process all fiducials
+		// Pose of camera relative to robot
+		PoseSE3 cameraPose;
+		if( !GetCameraExtrinsics( cameraName, detTime, cameraPose ) ) { return; }
+
 		BOOST_FOREACH( const argus_msgs::FiducialDetection & det, msg->detections )
 		{
-			Fiducial fid;
-			PoseSE3 extrinsics;
-			if( !GetFiducial( det.name, detTime, fid, extrinsics ) ) { continue; }
+			CachedFiducialPtr fid = GetFiducial( det.name, detTime );
+			if( !fid ) { continue; }
 			// Pose of tag relative to camera
-			PoseSE3 relPose = EstimateArrayPose( det, fid );
-			// Pose of camera relative to robot
-			PoseSE3 cameraPose = _extrinsicsInterface.GetExtrinsics(cameraName,
-																															_robotFrame);
+			PoseSE3 relPose = EstimatePose( cameraName + "-" + det.name, detTime,
+			                                std::vector<FiducialDetection>( 1, det ),
+			                                std::vector<Fiducial>( 1, fid->fiducial ) );
 			PoseSE3 tagPose = cameraPose * relPose;
 
 			geometry_msgs::TransformStamped poseMsg;
@@ -214,14 +531,6 @@ private:
 		}
 	}
 
-	void PublishMarkers( const std::vector<MarkerMsg> m )
-	{
-		BOOST_FOREACH( const MarkerMsg& msg, m )
-		{
-			_visPub.publish( msg );
-		}
-	}
-
 };
 
 int main( int argc, char**argv )
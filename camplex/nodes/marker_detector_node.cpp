@@ -0,0 +1,136 @@
+#include <ros/ros.h>
+#include <image_transport/image_transport.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "camplex/SquareMarkerDetector.h"
+#include "camplex/FrameGate.h"
+
+#include "argus_utils/utils/ParamUtils.h"
+#include "argus_utils/synchronization/ThreadsafeQueue.hpp"
+#include "argus_msgs/ImageFiducialDetections.h"
+#include "argus_utils/synchronization/WorkerPool.h"
+
+using namespace argus;
+
+class MarkerDetector
+{
+public:
+
+	MarkerDetector( ros::NodeHandle& nh, ros::NodeHandle& ph )
+		: _imagePort( nh )
+	{
+		SquareMarkerParams params;
+		GetParam( ph, "decimation", params.decimation, params.decimation );
+		GetParam( ph, "threshold_block_dim", params.thresholdBlockDim, params.thresholdBlockDim );
+		GetParam( ph, "threshold_offset", params.thresholdOffset, params.thresholdOffset );
+		GetParam( ph, "min_perimeter_ratio", params.minPerimeterRatio, params.minPerimeterRatio );
+		GetParam( ph, "max_perimeter_ratio", params.maxPerimeterRatio, params.maxPerimeterRatio );
+		GetParam( ph, "min_side_length", params.minSideLength, params.minSideLength );
+		GetParam( ph, "polygon_tolerance", params.polygonTolerance, params.polygonTolerance );
+		GetParam( ph, "enable_refinement", params.enableEdgeRefinement, params.enableEdgeRefinement );
+		GetParam( ph, "edge_search_radius", params.edgeSearchRadius, params.edgeSearchRadius );
+		GetParam( ph, "cell_pixels", params.cellPixels, params.cellPixels );
+		GetParam( ph, "max_border_errors", params.maxBorderErrors, params.maxBorderErrors );
+		GetParam( ph, "name_prefix", params.namePrefix, params.namePrefix );
+		_detector.SetParams( params );
+		ROS_INFO_STREAM( "Detecting markers with parameters: " << std::endl << params );
+
+		FrameGateParams gateParams;
+		GetParam( ph, "gate_thumbnail_width", gateParams.thumbnailWidth, gateParams.thumbnailWidth );
+		GetParam( ph, "gate_min_sharpness", gateParams.minSharpness, gateParams.minSharpness );
+		GetParam( ph, "gate_min_novelty", gateParams.minNovelty, gateParams.minNovelty );
+		_gate.SetParams( gateParams );
+		_enableGating = gateParams.minSharpness > 0 || gateParams.minNovelty > 0;
+		if( _enableGating )
+		{
+			ROS_INFO_STREAM( "Gating frames with parameters: " << std::endl << gateParams );
+		}
+
+		_detPub = ph.advertise<argus_msgs::ImageFiducialDetections>( "detections", 20 );
+
+		unsigned int buffLen;
+		GetParam<unsigned int>( ph, "buffer_length", buffLen, 5 );
+		_imageSub = _imagePort.subscribe( "image",
+		                                  buffLen,
+		                                  &MarkerDetector::ImageCallback, this );
+
+		unsigned int numDetectorThreads;
+		GetParam<unsigned int>( ph, "num_detector_threads", numDetectorThreads, 1 );
+		_detectorWorkers.SetNumWorkers( numDetectorThreads );
+		for( unsigned int i = 0; i < numDetectorThreads; ++i )
+		{
+			WorkerPool::Job job = boost::bind( &MarkerDetector::DetectionSpin, this );
+			_detectorWorkers.EnqueueJob( job );
+		}
+		_detectorWorkers.StartWorkers();
+	}
+
+	void ImageCallback( const sensor_msgs::Image::ConstPtr& msg )
+	{
+		_imageBuffer.PushBack( msg );
+	}
+
+	void DetectionSpin()
+	{
+		sensor_msgs::Image::ConstPtr msg;
+
+		while( ros::ok() )
+		{
+			_imageBuffer.WaitPopBack( msg );
+			cv::Mat msgFrame = cv_bridge::toCvShare( msg )->image;
+			cv::Mat frame;
+			if( msgFrame.channels() > 1 )
+			{
+				cv::cvtColor( msgFrame, frame, CV_BGR2GRAY );
+			}
+			else
+			{
+				frame = msgFrame;
+			}
+
+			if( _enableGating )
+			{
+				FrameGate::Result result = _gate.Evaluate( msg->header.frame_id, frame );
+				ROS_INFO_STREAM_THROTTLE( 10.0, "Frame gate: " << _gate );
+				if( result != FrameGate::FRAME_ACCEPTED ) { continue; }
+			}
+
+			ImageFiducialDetections detections;
+			detections.sourceName = msg->header.frame_id;
+			detections.timestamp = msg->header.stamp;
+			detections.detections = _detector.Detect( frame );
+			if( detections.detections.empty() ) { continue; }
+
+			_detPub.publish( detections.ToMsg() );
+		}
+	}
+
+private:
+
+	image_transport::ImageTransport _imagePort;
+	image_transport::Subscriber _imageSub;
+
+	ros::Publisher _detPub;
+	WorkerPool _detectorWorkers;
+	ThreadsafeQueue<sensor_msgs::Image::ConstPtr> _imageBuffer;
+
+	bool _enableGating;
+	FrameGate _gate;
+
+	SquareMarkerDetector _detector;
+};
+
+int main( int argc, char**argv )
+{
+	ros::init( argc, argv, "marker_detector" );
+
+	ros::NodeHandle nodeHandle;
+	ros::NodeHandle privHandle( "~" );
+	MarkerDetector detector( nodeHandle, privHandle );
+
+	ros::spin();
+
+	return 0;
+}
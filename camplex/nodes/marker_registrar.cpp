@@ -0,0 +1,74 @@
+#include <ros/ros.h>
+#include <boost/foreach.hpp>
+
+#include "extrinsics_array/ExtrinsicsInterface.h"
+#include "camplex/FiducialInfoManager.h"
+#include "camplex/SquareMarkerDetector.h"
+#include "argus_utils/utils/ParamUtils.h"
+
+using namespace argus;
+
+int main( int argc, char**argv )
+{
+	ros::init( argc, argv, "marker_registrar" );
+
+	ros::NodeHandle nh;
+	ros::NodeHandle ph( "~" );
+
+	LookupInterface lookup;
+	FiducialInfoManager manager( lookup );
+	ExtrinsicsInterface extrinsics( nh );
+
+	YAML::Node info;
+	GetParam( ph, "", info );
+	YAML::Node::const_iterator iter;
+	for( iter = info.begin(); iter != info.end(); ++iter )
+	{
+		YAML::Node info = iter->second;
+		std::string targetNamespace = iter->first.as<std::string>();
+
+		// Either a single marker ID or a list of IDs sharing the same size
+		std::vector<unsigned int> ids;
+		unsigned int id;
+		if( GetParam( info, "id", id ) )
+		{
+			ids.push_back( id );
+		}
+		else
+		{
+			GetParamRequired( info, "ids", ids );
+		}
+
+		double dim;
+		std::string prefix;
+		GetParamRequired( info, "dim", dim );
+		GetParam<std::string>( info, "name_prefix", prefix, "aruco_" );
+
+		PoseSE3 pose;
+		std::string parentId;
+		bool hasPose = GetParam( info, "pose", pose ) && GetParam( info, "parent_id", parentId );
+		if( hasPose && ids.size() > 1 )
+		{
+			ROS_WARN_STREAM( "Pose specified for multiple markers in " << targetNamespace
+			                 << ". Ignoring." );
+			hasPose = false;
+		}
+
+		Fiducial intrinsics = SquareMarkerDetector::GenerateMarkerFiducial( dim );
+		BOOST_FOREACH( unsigned int markerId, ids )
+		{
+			std::string markerName = SquareMarkerDetector::GenerateMarkerName( prefix, markerId );
+			lookup.WriteNamespace( markerName, targetNamespace );
+
+			if( hasPose )
+			{
+				ROS_INFO_STREAM( "Populating extrinsics " << pose << " relative to " << parentId );
+				extrinsics.SetStaticExtrinsics( markerName, parentId, pose );
+			}
+
+			manager.WriteMemberInfo( markerName, intrinsics );
+		}
+	}
+
+	exit( 0 );
+}
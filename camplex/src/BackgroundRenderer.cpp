@@ -0,0 +1,130 @@
+#include "camplex/BackgroundRenderer.h"
+
+#include <boost/bind.hpp>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Nice value of the rendering thread
+#define RENDER_NICENESS (19)
+
+namespace argus
+{
+
+BackgroundRenderer::BackgroundRenderer( double rate )
+	: _closed( false ), _numRendered( 0 ), _numDropped( 0 )
+{
+	SetMaxRate( rate );
+	_worker.SetNumWorkers( 1 );
+	_worker.EnqueueJob( boost::bind( &BackgroundRenderer::RenderSpin, this ) );
+	_worker.StartWorkers();
+}
+
+BackgroundRenderer::~BackgroundRenderer()
+{
+	{
+		WriteLock lock( _mutex );
+		_closed = true;
+	}
+	_hasJobCond.notify_all();
+}
+
+void BackgroundRenderer::SetMaxRate( double rate )
+{
+	if( rate < 0 )
+	{
+		throw std::invalid_argument( "BackgroundRenderer: Rate must be non-negative." );
+	}
+
+	WriteLock lock( _mutex );
+	_minInterval = ros::WallDuration( rate > 0 ? 1.0 / rate : 0.0 );
+}
+
+double BackgroundRenderer::GetMaxRate() const
+{
+	ReadLock lock( _mutex );
+	double interval = _minInterval.toSec();
+	return interval > 0 ? 1.0 / interval : 0.0;
+}
+
+bool BackgroundRenderer::ShouldRender( const std::string& key,
+                                       unsigned int numSubscribers )
+{
+	if( numSubscribers == 0 ) { return false; }
+
+	WriteLock lock( _mutex );
+	ros::WallTime now = ros::WallTime::now();
+	ros::WallTime& last = _lastRenderTimes[key];
+	if( !last.isZero() && ( now - last ) < _minInterval ) { return false; }
+	last = now;
+	return true;
+}
+
+void BackgroundRenderer::Submit( const std::string& key, const Job& job )
+{
+	{
+		WriteLock lock( _mutex );
+		Job& slot = _pending[key];
+		if( slot ) { ++_numDropped; }
+		slot = job;
+	}
+	_hasJobCond.notify_one();
+}
+
+unsigned int BackgroundRenderer::NumRendered() const
+{
+	ReadLock lock( _mutex );
+	return _numRendered;
+}
+
+unsigned int BackgroundRenderer::NumDropped() const
+{
+	ReadLock lock( _mutex );
+	return _numDropped;
+}
+
+void BackgroundRenderer::RenderSpin()
+{
+#ifdef __linux__
+	// Linux applies nice values to individual threads
+	setpriority( PRIO_PROCESS, syscall( SYS_gettid ), RENDER_NICENESS );
+#endif
+
+	std::string lastKey;
+	while( true )
+	{
+		Job job;
+		{
+			WriteLock lock( _mutex );
+			while( _pending.empty() && !_closed )
+			{
+				_hasJobCond.wait( lock );
+			}
+			if( _closed ) { return; }
+
+			// Take keys in turn so that a busy output cannot starve the others
+			std::map<std::string, Job>::iterator iter = _pending.upper_bound( lastKey );
+			if( iter == _pending.end() ) { iter = _pending.begin(); }
+			lastKey = iter->first;
+			job = iter->second;
+			_pending.erase( iter );
+		}
+
+		try
+		{
+			job();
+		}
+		catch( const std::exception& e )
+		{
+			ROS_WARN_STREAM( "Background rendering failed: " << e.what() );
+		}
+
+		WriteLock lock( _mutex );
+		++_numRendered;
+	}
+}
+
+}
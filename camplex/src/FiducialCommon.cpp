@@ -270,28 +270,155 @@ double FindMinDistance( const std::vector <argus_msgs::Point2D>& points )
 	return std::sqrt( minSeen );
 }
 
-PoseSE3 EstimateArrayPose( const FiducialDetection& detection,
-                           const Fiducial& fiducial,
-                           const PoseSE3& guess )
+// Max RMS reprojection error in normalized image coordinates for a solution
+// to be accepted without falling back to a cold solve
+#define ARRAY_POSE_MAX_RMS_ERROR (1E-2)
+// Max ratio of the smallest to largest point spread for an array to be planar
+#define ARRAY_POSE_PLANAR_TOL (1E-6)
+
+static void pose_to_cv( const PoseSE3& pose, cv::Mat& rvec, cv::Mat& tvec )
+{
+	PoseSE3 camPose;
+	StandardToCamera( pose, camPose );
+	Eigen::Matrix4d H = camPose.ToTransform().matrix();
+	cv::Matx33d R;
+	tvec.create( 3, 1, CV_64FC1 );
+	for( unsigned int i = 0; i < 3; i++ )
+	{
+		for( unsigned int j = 0; j < 3; j++ )
+		{
+			R(i,j) = H(i,j);
+		}
+		tvec.at<double>(i) = H(i,3);
+	}
+	cv::Rodrigues( R, rvec );
+}
+
+static PoseSE3 cv_to_pose( const cv::Mat& rvec, const cv::Mat& tvec )
 {
-	std::vector<FiducialDetection> detections;
-	detections.push_back( detection );
-	std::vector<Fiducial> camplex;
-	camplex.push_back( fiducial );
-	return EstimateArrayPose( detections, camplex, guess );
+	cv::Matx33d R;
+	cv::Rodrigues( rvec, R );
+	Eigen::Matrix4d H;
+	H << R(0,0), R(0,1), R(0,2), tvec.at<double>(0),
+	     R(1,0), R(1,1), R(1,2), tvec.at<double>(1),
+	     R(2,0), R(2,1), R(2,2), tvec.at<double>(2),
+	          0,      0,      0,      1;
+	PoseSE3 pose;
+	CameraToStandard( PoseSE3( H ), pose );
+	return pose;
 }
 
-// TODO if info is null, assume normalized and undistorted detections
-PoseSE3 EstimateArrayPose( const std::vector<FiducialDetection>& detections,
-                           const std::vector<Fiducial>& camplex,
-                           const PoseSE3& guess )
+static double reprojection_rms( const std::vector<cv::Point3f>& points3d,
+                                const std::vector<cv::Point2f>& points2d,
+                                const cv::Mat& rvec, const cv::Mat& tvec )
+{
+	std::vector<cv::Point2f> projected;
+	cv::projectPoints( points3d, rvec, tvec, cv::Matx33d::eye(), cv::noArray(), projected );
+	double acc = 0;
+	for( unsigned int i = 0; i < projected.size(); ++i )
+	{
+		cv::Point2f d = projected[i] - points2d[i];
+		acc += d.dot( d );
+	}
+	return std::sqrt( acc / projected.size() );
+}
+
+// Finds the closed-form pose of a planar point array from the homography between
+// the array plane and the normalized image. Returns false if the array is not
+// planar or the homography is degenerate.
+static bool planar_pose_init( const std::vector<cv::Point3f>& points3d,
+                              const std::vector<cv::Point2f>& points2d,
+                              cv::Mat& rvec, cv::Mat& tvec )
+{
+	if( points3d.size() < 4 ) { return false; }
+
+	Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+	BOOST_FOREACH( const cv::Point3f& p, points3d )
+	{
+		centroid += Eigen::Vector3d( p.x, p.y, p.z );
+	}
+	centroid /= points3d.size();
+
+	Eigen::Matrix3d scatter = Eigen::Matrix3d::Zero();
+	BOOST_FOREACH( const cv::Point3f& p, points3d )
+	{
+		Eigen::Vector3d d = Eigen::Vector3d( p.x, p.y, p.z ) - centroid;
+		scatter += d * d.transpose();
+	}
+	Eigen::JacobiSVD<Eigen::Matrix3d> scatterSvd( scatter, Eigen::ComputeFullU );
+	Eigen::Vector3d spread = scatterSvd.singularValues();
+	if( spread(0) <= 0 || spread(2) > ARRAY_POSE_PLANAR_TOL * spread(0) ) { return false; }
+
+	// Rotation from array coordinates to plane coordinates with z along the normal
+	Eigen::Matrix3d Rplane = scatterSvd.matrixU().transpose();
+	if( Rplane.determinant() < 0 ) { Rplane.row(2) *= -1; }
+
+	std::vector<cv::Point2f> planePoints;
+	planePoints.reserve( points3d.size() );
+	BOOST_FOREACH( const cv::Point3f& p, points3d )
+	{
+		Eigen::Vector3d q = Rplane * ( Eigen::Vector3d( p.x, p.y, p.z ) - centroid );
+		planePoints.emplace_back( q(0), q(1) );
+	}
+
+	cv::Mat Hcv = cv::findHomography( planePoints, points2d, 0 );
+	if( Hcv.empty() ) { return false; }
+	Eigen::Matrix3d H = MatToEigen<double>( Hcv );
+
+	// H ~ [r1 r2 t] for a normalized camera
+	double n1 = H.col(0).norm();
+	double n2 = H.col(1).norm();
+	if( n1 < 1E-12 || n2 < 1E-12 ) { return false; }
+	double scale = 2.0 / ( n1 + n2 );
+	Eigen::Vector3d t = scale * H.col(2);
+	if( t(2) < 0 )
+	{
+		scale = -scale;
+		t = -t;
+	}
+	Eigen::Matrix3d Rapprox;
+	Rapprox.col(0) = scale * H.col(0);
+	Rapprox.col(1) = scale * H.col(1);
+	Rapprox.col(2) = Rapprox.col(0).cross( Rapprox.col(1) );
+
+	// Project onto the nearest rotation
+	Eigen::JacobiSVD<Eigen::Matrix3d> rotSvd( Rapprox, Eigen::ComputeFullU | Eigen::ComputeFullV );
+	Eigen::Matrix3d Rpc = rotSvd.matrixU() * rotSvd.matrixV().transpose();
+	if( Rpc.determinant() < 0 )
+	{
+		Eigen::Matrix3d D = Eigen::Matrix3d::Identity();
+		D(2,2) = -1;
+		Rpc = rotSvd.matrixU() * D * rotSvd.matrixV().transpose();
+	}
+
+	// Compose the array to plane and plane to camera transforms
+	Eigen::Matrix3d R = Rpc * Rplane;
+	Eigen::Vector3d T = t - R * centroid;
+
+	cv::Matx33d Rcv;
+	tvec.create( 3, 1, CV_64FC1 );
+	for( unsigned int i = 0; i < 3; i++ )
+	{
+		for( unsigned int j = 0; j < 3; j++ )
+		{
+			Rcv(i,j) = R(i,j);
+		}
+		tvec.at<double>(i) = T(i);
+	}
+	cv::Rodrigues( Rcv, rvec );
+	return true;
+}
+
+static void collect_array_points( const std::vector<FiducialDetection>& detections,
+                                  const std::vector<Fiducial>& fiducials,
+                                  std::vector<cv::Point2f>& points2d,
+                                  std::vector<cv::Point3f>& points3d )
 {
 	if( detections.empty() )
 	{
 		throw std::runtime_error( "Cannot estimate pose with no detections." );
 	}
 
-	std::vector<cv::Point2f> points2d;
 	BOOST_FOREACH( const FiducialDetection& det, detections )
 	{
 		if( !det.normalized )
@@ -302,41 +429,79 @@ PoseSE3 EstimateArrayPose( const std::vector<FiducialDetection>& detections,
 		points2d.insert( points2d.end(), pts.begin(), pts.end() );
 	}
 
-	std::vector<cv::Point3f> points3d;
-	BOOST_FOREACH( const Fiducial& fid, camplex )
+	BOOST_FOREACH( const Fiducial& fid, fiducials )
 	{
 		std::vector<cv::Point3f> pts = PointsToCv( fid.points );
 		points3d.insert( points3d.end(), pts.begin(), pts.end() );
 	}
 
-	// Initialize guess
-	cv::Mat rvec;
-	cv::Mat tvec( 3, 1, CV_64FC1 ); // Must allocate tvec
-	cv::Matx33d R;
-	PoseSE3 postGuess;
-	StandardToCamera( guess, postGuess );
-	Eigen::Matrix4d H = postGuess.ToTransform().matrix();
-	for( unsigned int i = 0; i < 3; i++ )
+	if( points2d.size() != points3d.size() )
 	{
-		for( unsigned int j = 0; j < 3; j++ )
+		throw std::runtime_error( "EstimateArrayPose: Detection and fiducial point counts do not match." );
+	}
+}
+
+static PoseSE3 solve_cold( const std::vector<cv::Point3f>& points3d,
+                           const std::vector<cv::Point2f>& points2d )
+{
+	cv::Mat rvec, tvec;
+	cv::Mat distortionCoeffs;
+	cv::Matx33d cameraMat = cv::Matx33d::eye();
+	if( planar_pose_init( points3d, points2d, rvec, tvec ) )
+	{
+		cv::solvePnP( points3d, points2d, cameraMat, distortionCoeffs, rvec, tvec, true );
+		if( reprojection_rms( points3d, points2d, rvec, tvec ) < ARRAY_POSE_MAX_RMS_ERROR )
 		{
-			R(i,j) = H(i,j);
+			return cv_to_pose( rvec, tvec );
 		}
-		tvec.at<double>(i) = H(i,3);
 	}
 
-	cv::Mat distortionCoeffs;
-	cv::Matx33f cameraMat = cv::Matx33f::eye();
-	cv::Rodrigues( R, rvec );
 	cv::solvePnP( points3d, points2d, cameraMat, distortionCoeffs, rvec, tvec, false );
-	cv::Rodrigues( rvec, R );
-	H << R(0,0), R(0,1), R(0,2), tvec.at<double>(0),
-	     R(1,0), R(1,1), R(1,2), tvec.at<double>(1),
-	     R(2,0), R(2,1), R(2,2), tvec.at<double>(2),
-	          0,      0,      0,      1;
-	PoseSE3 Hout;
-	CameraToStandard( PoseSE3( H ), Hout );
-	return Hout;
+	return cv_to_pose( rvec, tvec );
+}
+
+PoseSE3 EstimateArrayPose( const FiducialDetection& detection,
+                           const Fiducial& fiducial )
+{
+	return EstimateArrayPose( std::vector<FiducialDetection>( 1, detection ),
+	                          std::vector<Fiducial>( 1, fiducial ) );
+}
+
+PoseSE3 EstimateArrayPose( const std::vector<FiducialDetection>& detections,
+                           const std::vector<Fiducial>& fiducials )
+{
+	std::vector<cv::Point2f> points2d;
+	std::vector<cv::Point3f> points3d;
+	collect_array_points( detections, fiducials, points2d, points3d );
+	return solve_cold( points3d, points2d );
+}
+
+PoseSE3 EstimateArrayPose( const FiducialDetection& detection,
+                           const Fiducial& fiducial,
+                           const PoseSE3& guess )
+{
+	return EstimateArrayPose( std::vector<FiducialDetection>( 1, detection ),
+	                          std::vector<Fiducial>( 1, fiducial ),
+	                          guess );
+}
+
+PoseSE3 EstimateArrayPose( const std::vector<FiducialDetection>& detections,
+                           const std::vector<Fiducial>& fiducials,
+                           const PoseSE3& guess )
+{
+	std::vector<cv::Point2f> points2d;
+	std::vector<cv::Point3f> points3d;
+	collect_array_points( detections, fiducials, points2d, points3d );
+
+	cv::Mat rvec, tvec;
+	pose_to_cv( guess, rvec, tvec );
+	cv::solvePnP( points3d, points2d, cv::Matx33d::eye(), cv::noArray(), rvec, tvec, true );
+	if( tvec.at<double>(2) > 0 &&
+	    reprojection_rms( points3d, points2d, rvec, tvec ) < ARRAY_POSE_MAX_RMS_ERROR )
+	{
+		return cv_to_pose( rvec, tvec );
+	}
+	return solve_cold( points3d, points2d );
 }
 
 void CameraToStandard( const PoseSE3& cam, PoseSE3& standard )
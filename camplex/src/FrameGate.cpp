@@ -0,0 +1,155 @@
+#include "camplex/FrameGate.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace argus
+{
+
+FrameGateParams::FrameGateParams()
+	: thumbnailWidth( 160 ),
+	minSharpness( 0 ),
+	minNovelty( 0 ) {}
+
+std::ostream& operator<<( std::ostream& os, const FrameGateParams& params )
+{
+	os << "thumbnail width: " << params.thumbnailWidth << std::endl;
+	os << "min sharpness: " << params.minSharpness << std::endl;
+	os << "min novelty: " << params.minNovelty;
+	return os;
+}
+
+FrameGate::FrameGate( const FrameGateParams& params )
+	: _numAccepted( 0 ), _numBlurry( 0 ), _numRedundant( 0 )
+{
+	SetParams( params );
+}
+
+void FrameGate::SetParams( const FrameGateParams& params )
+{
+	if( params.thumbnailWidth == 0 )
+	{
+		throw std::invalid_argument( "FrameGate: Thumbnail width must be positive." );
+	}
+
+	WriteLock lock( _mutex );
+	// Thumbnails of a different size cannot be compared
+	if( params.thumbnailWidth != _params.thumbnailWidth )
+	{
+		_references.clear();
+	}
+	_params = params;
+}
+
+FrameGateParams FrameGate::GetParams() const
+{
+	ReadLock lock( _mutex );
+	return _params;
+}
+
+FrameGate::Result FrameGate::Evaluate( const std::string& source,
+                                       const cv::Mat& image )
+{
+	FrameGateParams params = GetParams();
+	cv::Mat thumbnail = MakeThumbnail( image, params.thumbnailWidth );
+
+	if( params.minSharpness > 0 && ComputeSharpness( thumbnail ) < params.minSharpness )
+	{
+		WriteLock lock( _mutex );
+		++_numBlurry;
+		return FRAME_BLURRY;
+	}
+
+	WriteLock lock( _mutex );
+	if( params.minNovelty > 0 )
+	{
+		std::map<std::string, cv::Mat>::const_iterator iter = _references.find( source );
+		if( iter != _references.end() &&
+		    iter->second.size() == thumbnail.size() &&
+		    ComputeNovelty( thumbnail, iter->second ) < params.minNovelty )
+		{
+			++_numRedundant;
+			return FRAME_REDUNDANT;
+		}
+	}
+
+	_references[source] = thumbnail;
+	++_numAccepted;
+	return FRAME_ACCEPTED;
+}
+
+void FrameGate::Reset()
+{
+	WriteLock lock( _mutex );
+	_references.clear();
+}
+
+unsigned int FrameGate::NumAccepted() const
+{
+	ReadLock lock( _mutex );
+	return _numAccepted;
+}
+
+unsigned int FrameGate::NumBlurry() const
+{
+	ReadLock lock( _mutex );
+	return _numBlurry;
+}
+
+unsigned int FrameGate::NumRedundant() const
+{
+	ReadLock lock( _mutex );
+	return _numRedundant;
+}
+
+unsigned int FrameGate::NumSkipped() const
+{
+	ReadLock lock( _mutex );
+	return _numBlurry + _numRedundant;
+}
+
+double FrameGate::ComputeSharpness( const cv::Mat& thumbnail )
+{
+	cv::Mat laplacian;
+	cv::Laplacian( thumbnail, laplacian, CV_32F );
+	cv::Scalar mean, stddev;
+	cv::meanStdDev( laplacian, mean, stddev );
+	return stddev[0] * stddev[0];
+}
+
+double FrameGate::ComputeNovelty( const cv::Mat& thumbnail,
+                                  const cv::Mat& reference )
+{
+	cv::Mat diff;
+	cv::absdiff( thumbnail, reference, diff );
+	return cv::mean( diff )[0];
+}
+
+cv::Mat FrameGate::MakeThumbnail( const cv::Mat& image, unsigned int width ) const
+{
+	cv::Mat gray;
+	if( image.channels() > 1 )
+	{
+		cv::cvtColor( image, gray, CV_BGR2GRAY );
+	}
+	else
+	{
+		gray = image;
+	}
+
+	if( gray.cols <= (int) width ) { return gray.clone(); }
+
+	double scale = (double) width / gray.cols;
+	cv::Mat thumbnail;
+	cv::resize( gray, thumbnail, cv::Size(), scale, scale, cv::INTER_AREA );
+	return thumbnail;
+}
+
+std::ostream& operator<<( std::ostream& os, const FrameGate& gate )
+{
+	os << "accepted: " << gate.NumAccepted()
+	   << " blurry: " << gate.NumBlurry()
+	   << " redundant: " << gate.NumRedundant();
+	return os;
+}
+
+}
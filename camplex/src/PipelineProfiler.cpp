@@ -0,0 +1,128 @@
+#include "camplex/PipelineProfiler.h"
+
+#include <diagnostic_msgs/KeyValue.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace argus
+{
+template <typename T>
+static void add_value( diagnostic_msgs::DiagnosticStatus& status,
+                       const std::string& key, const T& value )
+{
+	std::stringstream ss;
+	ss << value;
+	diagnostic_msgs::KeyValue kv;
+	kv.key = key;
+	kv.value = ss.str();
+	status.values.push_back( kv );
+}
+
+// Returns the q-quantile of the values by partially sorting them in place
+static double quantile( std::vector<double>& values, double q )
+{
+	size_t ind = std::min( (size_t) ( q * values.size() ), values.size() - 1 );
+	std::nth_element( values.begin(), values.begin() + ind, values.end() );
+	return values[ind];
+}
+
+PipelineProfiler::ScopedTimer::ScopedTimer( PipelineProfiler& profiler,
+                                            const char* stage )
+	: _profiler( profiler ), _stage( stage ), _running( profiler.IsEnabled() )
+{
+	if( _running ) { _start = ros::WallTime::now(); }
+}
+
+PipelineProfiler::ScopedTimer::~ScopedTimer()
+{
+	Stop();
+}
+
+void PipelineProfiler::ScopedTimer::Stop()
+{
+	if( !_running ) { return; }
+	_running = false;
+	_profiler.AddTiming( _stage, ( ros::WallTime::now() - _start ).toSec() );
+}
+
+PipelineProfiler::PipelineProfiler( bool enabled, unsigned int windowSize )
+	: _enabled( enabled ), _windowSize( std::max( windowSize, 1u ) ) {}
+
+void PipelineProfiler::SetEnabled( bool enabled )
+{
+	_enabled = enabled;
+}
+
+bool PipelineProfiler::IsEnabled() const
+{
+	return _enabled;
+}
+
+void PipelineProfiler::AddTiming( const char* stage, double seconds )
+{
+	if( !_enabled ) { return; }
+
+	WriteLock lock( _mutex );
+	StageWindow& window = _stages[stage];
+	if( window.samples.size() < _windowSize )
+	{
+		window.samples.push_back( seconds );
+	}
+	else
+	{
+		window.samples[window.next] = seconds;
+	}
+	window.next = ( window.next + 1 ) % _windowSize;
+	++window.numNew;
+}
+
+void PipelineProfiler::Increment( const char* counter, double amount )
+{
+	if( !_enabled ) { return; }
+
+	WriteLock lock( _mutex );
+	_counters[counter] += amount;
+}
+
+diagnostic_msgs::DiagnosticStatus PipelineProfiler::Report( const std::string& name,
+                                                            const std::string& hardwareId )
+{
+	diagnostic_msgs::DiagnosticStatus status;
+	status.level = diagnostic_msgs::DiagnosticStatus::OK;
+	status.name = name;
+	status.hardware_id = hardwareId;
+	status.message = "OK";
+
+	WriteLock lock( _mutex );
+	std::map<std::string, StageWindow>::iterator iter;
+	for( iter = _stages.begin(); iter != _stages.end(); ++iter )
+	{
+		const std::string& stage = iter->first;
+		StageWindow& window = iter->second;
+		std::vector<double> sorted( window.samples );
+		add_value( status, stage + "/count", window.numNew );
+		add_value( status, stage + "/p50_ms", 1E3 * quantile( sorted, 0.50 ) );
+		add_value( status, stage + "/p95_ms", 1E3 * quantile( sorted, 0.95 ) );
+		add_value( status, stage + "/p99_ms", 1E3 * quantile( sorted, 0.99 ) );
+		add_value( status, stage + "/max_ms",
+		           1E3 * *std::max_element( sorted.begin(), sorted.end() ) );
+		window.numNew = 0;
+	}
+
+	std::map<std::string, double>::iterator citer;
+	for( citer = _counters.begin(); citer != _counters.end(); ++citer )
+	{
+		add_value( status, citer->first, citer->second );
+		citer->second = 0;
+	}
+	return status;
+}
+
+void PipelineProfiler::Reset()
+{
+	WriteLock lock( _mutex );
+	_stages.clear();
+	_counters.clear();
+}
+}
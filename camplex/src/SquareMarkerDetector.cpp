@@ -0,0 +1,512 @@
+#include "camplex/SquareMarkerDetector.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <boost/foreach.hpp>
+#include <sstream>
+#include <set>
+#include <cmath>
+
+#define MARKER_PAYLOAD_DIM (5)
+#define MARKER_GRID_DIM (7) // Payload plus a one-cell black border
+#define MARKER_NUM_IDS (1024)
+#define MARKER_MAX_SEARCH_STEPS (16)
+
+namespace argus
+{
+
+// Each payload row of the original ArUco dictionary encodes two bits of the
+// marker ID using one of these 5-bit words
+static const int marker_row_words[4] = { 0x10, 0x17, 0x09, 0x0e };
+
+typedef bool MarkerPayload[MARKER_PAYLOAD_DIM][MARKER_PAYLOAD_DIM];
+
+static bool decode_payload( const MarkerPayload& payload, unsigned int& id )
+{
+	id = 0;
+	for( unsigned int y = 0; y < MARKER_PAYLOAD_DIM; ++y )
+	{
+		int word = 0;
+		for( unsigned int x = 0; x < MARKER_PAYLOAD_DIM; ++x )
+		{
+			word = (word << 1) | ( payload[y][x] ? 1 : 0 );
+		}
+
+		int index = -1;
+		for( unsigned int i = 0; i < 4; ++i )
+		{
+			if( marker_row_words[i] == word ) { index = i; break; }
+		}
+		if( index < 0 ) { return false; }
+		id = (id << 2) | index;
+	}
+	return true;
+}
+
+static void rotate_payload_ccw( MarkerPayload& payload )
+{
+	MarkerPayload rotated;
+	for( unsigned int y = 0; y < MARKER_PAYLOAD_DIM; ++y )
+	{
+		for( unsigned int x = 0; x < MARKER_PAYLOAD_DIM; ++x )
+		{
+			rotated[y][x] = payload[x][MARKER_PAYLOAD_DIM - 1 - y];
+		}
+	}
+	std::copy( &rotated[0][0], &rotated[0][0] + MARKER_PAYLOAD_DIM * MARKER_PAYLOAD_DIM,
+	           &payload[0][0] );
+}
+
+// Returns false if the sample falls outside of the image
+static bool sample_bilinear( const cv::Mat& image, float x, float y, float& value )
+{
+	int x0 = cvFloor( x );
+	int y0 = cvFloor( y );
+	if( x0 < 0 || y0 < 0 || x0 + 1 >= image.cols || y0 + 1 >= image.rows )
+	{
+		return false;
+	}
+	float ax = x - x0;
+	float ay = y - y0;
+	const uchar* r0 = image.ptr<uchar>( y0 ) + x0;
+	const uchar* r1 = image.ptr<uchar>( y0 + 1 ) + x0;
+	value = ( 1.0f - ay ) * ( ( 1.0f - ax ) * r0[0] + ax * r0[1] ) +
+	        ay * ( ( 1.0f - ax ) * r1[0] + ax * r1[1] );
+	return true;
+}
+
+static bool intersect_lines( const cv::Vec4f& l1, const cv::Vec4f& l2, cv::Point2f& p )
+{
+	cv::Point2f d1( l1[0], l1[1] ), p1( l1[2], l1[3] );
+	cv::Point2f d2( l2[0], l2[1] ), p2( l2[2], l2[3] );
+	float den = d1.x * d2.y - d1.y * d2.x;
+	if( std::abs( den ) < 1E-6 ) { return false; }
+	cv::Point2f w = p2 - p1;
+	float s = ( w.x * d2.y - w.y * d2.x ) / den;
+	p = p1 + s * d1;
+	return true;
+}
+
+SquareMarkerParams::SquareMarkerParams()
+	: decimation( 2 ),
+	thresholdBlockDim( 7 ),
+	thresholdOffset( 7.0 ),
+	minPerimeterRatio( 0.03 ),
+	maxPerimeterRatio( 4.0 ),
+	minSideLength( 10.0 ),
+	polygonTolerance( 0.05 ),
+	enableEdgeRefinement( true ),
+	edgeSearchRadius( 2.0 ),
+	cellPixels( 6 ),
+	maxBorderErrors( 0 ),
+	namePrefix( "aruco_" ) {}
+
+std::ostream& operator<<( std::ostream& os, const SquareMarkerParams& params )
+{
+	os << "decimation: " << params.decimation << std::endl;
+	os << "threshold block dim: " << params.thresholdBlockDim << std::endl;
+	os << "threshold offset: " << params.thresholdOffset << std::endl;
+	os << "perimeter ratio: [" << params.minPerimeterRatio << ", "
+	   << params.maxPerimeterRatio << "]" << std::endl;
+	os << "min side length: " << params.minSideLength << std::endl;
+	os << "polygon tolerance: " << params.polygonTolerance << std::endl;
+	os << "edge refinement: " << params.enableEdgeRefinement << std::endl;
+	os << "edge search radius: " << params.edgeSearchRadius << std::endl;
+	os << "cell pixels: " << params.cellPixels << std::endl;
+	os << "max border errors: " << params.maxBorderErrors << std::endl;
+	os << "name prefix: " << params.namePrefix;
+	return os;
+}
+
+/*! \brief Refines and decodes a range of quad candidates. */
+class SquareMarkerDecodeBody
+	: public cv::ParallelLoopBody
+{
+public:
+
+	SquareMarkerDecodeBody( const SquareMarkerDetector& detector,
+	                        const cv::Mat& image,
+	                        std::vector<SquareMarkerDetector::Quad>& quads,
+	                        std::vector<int>& ids )
+		: _detector( detector ), _image( image ), _quads( quads ), _ids( ids ) {}
+
+	virtual void operator()( const cv::Range& range ) const
+	{
+		for( int i = range.start; i < range.end; ++i )
+		{
+			SquareMarkerDetector::Quad& quad = _quads[i];
+			// NOTE Failed refinement leaves the decimated quad untouched
+			if( _detector._params.enableEdgeRefinement )
+			{
+				_detector.RefineEdges( _image, quad );
+			}
+
+			unsigned int id;
+			if( _detector.DecodeQuad( _image, quad, id ) )
+			{
+				_ids[i] = id;
+			}
+		}
+	}
+
+private:
+
+	const SquareMarkerDetector& _detector;
+	const cv::Mat& _image;
+	std::vector<SquareMarkerDetector::Quad>& _quads;
+	std::vector<int>& _ids;
+};
+
+SquareMarkerDetector::SquareMarkerDetector( const SquareMarkerParams& params )
+{
+	SetParams( params );
+}
+
+void SquareMarkerDetector::SetParams( const SquareMarkerParams& params )
+{
+	if( params.decimation == 0 )
+	{
+		throw std::invalid_argument( "SquareMarkerDetector: Decimation must be positive." );
+	}
+	if( params.cellPixels < 3 )
+	{
+		throw std::invalid_argument( "SquareMarkerDetector: Cell pixels must be at least 3." );
+	}
+	if( params.edgeSearchRadius <= 0 )
+	{
+		throw std::invalid_argument( "SquareMarkerDetector: Edge search radius must be positive." );
+	}
+	_params = params;
+}
+
+const SquareMarkerParams& SquareMarkerDetector::GetParams() const
+{
+	return _params;
+}
+
+std::vector<FiducialDetection> SquareMarkerDetector::Detect( const cv::Mat& image ) const
+{
+	std::vector<FiducialDetection> detections;
+	if( image.empty() ) { return detections; }
+	if( image.type() != CV_8UC1 )
+	{
+		throw std::invalid_argument( "SquareMarkerDetector: Image must be 8-bit grayscale." );
+	}
+
+	std::vector<Quad> quads;
+	FindQuads( image, quads );
+	if( quads.empty() ) { return detections; }
+
+	std::vector<int> ids( quads.size(), -1 );
+	cv::parallel_for_( cv::Range( 0, quads.size() ),
+	                   SquareMarkerDecodeBody( *this, image, quads, ids ) );
+
+	// Quads are sorted by decreasing size, so we keep the outermost of any
+	// duplicates
+	std::set<int> seen;
+	for( unsigned int i = 0; i < quads.size(); ++i )
+	{
+		if( ids[i] < 0 || seen.count( ids[i] ) > 0 ) { continue; }
+		seen.insert( ids[i] );
+
+		FiducialDetection det;
+		det.name = GenerateMarkerName( _params.namePrefix, ids[i] );
+		det.undistorted = false;
+		det.normalized = false;
+		det.points = CvToPoints( quads[i] );
+		detections.push_back( det );
+	}
+	return detections;
+}
+
+void SquareMarkerDetector::FindQuads( const cv::Mat& image,
+                                      std::vector<Quad>& quads ) const
+{
+	quads.clear();
+
+	// Quad detection runs at decimated resolution
+	const unsigned int dec = _params.decimation;
+	cv::Mat small;
+	if( dec > 1 )
+	{
+		cv::resize( image, small, cv::Size(), 1.0 / dec, 1.0 / dec, cv::INTER_AREA );
+	}
+	else
+	{
+		small = image;
+	}
+
+	unsigned int blockDim = std::max( _params.thresholdBlockDim, 3u ) | 1; // Must be odd
+	cv::Mat binary;
+	cv::adaptiveThreshold( small,
+	                       binary,
+	                       255,
+	                       cv::ADAPTIVE_THRESH_MEAN_C,
+	                       cv::THRESH_BINARY_INV,
+	                       blockDim,
+	                       _params.thresholdOffset );
+
+	std::vector<std::vector<cv::Point> > contours;
+	cv::findContours( binary, contours, cv::RETR_LIST, cv::CHAIN_APPROX_NONE );
+
+	double maxDim = std::max( small.cols, small.rows );
+	double minPerimeter = _params.minPerimeterRatio * maxDim;
+	double maxPerimeter = _params.maxPerimeterRatio * maxDim;
+	double minSide = _params.minSideLength / dec;
+
+	typedef std::pair<double, Quad> SizedQuad;
+	std::vector<SizedQuad> candidates;
+	std::vector<cv::Point> approx;
+	BOOST_FOREACH( const std::vector<cv::Point>& contour, contours )
+	{
+		double perimeter = contour.size();
+		if( perimeter < minPerimeter || perimeter > maxPerimeter ) { continue; }
+
+		cv::approxPolyDP( contour, approx, perimeter * _params.polygonTolerance, true );
+		if( approx.size() != 4 || !cv::isContourConvex( approx ) ) { continue; }
+
+		bool tooSmall = false;
+		for( unsigned int i = 0; i < 4; ++i )
+		{
+			cv::Point d = approx[i] - approx[(i + 1) % 4];
+			if( d.dot( d ) < minSide * minSide )
+			{
+				tooSmall = true;
+				break;
+			}
+		}
+		if( tooSmall ) { continue; }
+
+		// Map pixel centers back to full resolution
+		Quad quad( 4 );
+		for( unsigned int i = 0; i < 4; ++i )
+		{
+			quad[i] = cv::Point2f( ( approx[i].x + 0.5f ) * dec - 0.5f,
+			                       ( approx[i].y + 0.5f ) * dec - 0.5f );
+		}
+
+		// Enforce clockwise ordering in image coordinates
+		cv::Point2f v1 = quad[1] - quad[0];
+		cv::Point2f v2 = quad[2] - quad[0];
+		if( v1.x * v2.y - v1.y * v2.x < 0 )
+		{
+			std::swap( quad[1], quad[3] );
+		}
+		candidates.push_back( SizedQuad( perimeter, quad ) );
+	}
+
+	std::sort( candidates.begin(), candidates.end(),
+	           []( const SizedQuad& a, const SizedQuad& b ) { return a.first > b.first; } );
+
+	// Reject candidates that coincide with a larger one
+	BOOST_FOREACH( const SizedQuad& candidate, candidates )
+	{
+		const Quad& quad = candidate.second;
+		float tol = std::max( 2.0 * dec, 0.025 * candidate.first * dec );
+		bool duplicate = false;
+		BOOST_FOREACH( const Quad& other, quads )
+		{
+			unsigned int numClose = 0;
+			for( unsigned int i = 0; i < 4; ++i )
+			{
+				for( unsigned int j = 0; j < 4; ++j )
+				{
+					cv::Point2f d = quad[i] - other[j];
+					if( d.dot( d ) < tol * tol )
+					{
+						++numClose;
+						break;
+					}
+				}
+			}
+			if( numClose == 4 )
+			{
+				duplicate = true;
+				break;
+			}
+		}
+		if( !duplicate ) { quads.push_back( quad ); }
+	}
+}
+
+bool SquareMarkerDetector::RefineEdges( const cv::Mat& image, Quad& quad ) const
+{
+	const float step = 0.5f;
+	const int numSteps = std::min( (int) std::ceil( _params.edgeSearchRadius / step ),
+	                               MARKER_MAX_SEARCH_STEPS );
+	const int profileSize = 2 * numSteps + 1;
+	float profile[2 * MARKER_MAX_SEARCH_STEPS + 1];
+
+	cv::Vec4f lines[4];
+	std::vector<cv::Point2f> edgePoints;
+	for( unsigned int k = 0; k < 4; ++k )
+	{
+		const cv::Point2f& a = quad[k];
+		const cv::Point2f& b = quad[(k + 1) % 4];
+		cv::Point2f dir = b - a;
+		float len = std::sqrt( dir.dot( dir ) );
+		if( len < 1.0f ) { return false; }
+		dir *= 1.0f / len;
+		// Points into the marker for clockwise quads
+		cv::Point2f normal( -dir.y, dir.x );
+
+		// Skip the ends of each side, where the adjacent edges interfere
+		unsigned int numSamples = std::min( std::max( (int) ( len / 2 ), 4 ), 32 );
+		edgePoints.clear();
+		for( unsigned int i = 0; i < numSamples; ++i )
+		{
+			float t = len * ( 0.15f + 0.7f * ( i + 0.5f ) / numSamples );
+			cv::Point2f p = a + t * dir;
+
+			bool valid = true;
+			for( int j = 0; j < profileSize && valid; ++j )
+			{
+				cv::Point2f q = p + ( ( j - numSteps ) * step ) * normal;
+				valid = sample_bilinear( image, q.x, q.y, profile[j] );
+			}
+			if( !valid ) { continue; }
+
+			// Marker border is black, so look for the strongest falling edge
+			int bestInd = -1;
+			float bestGrad = 0;
+			for( int j = 1; j < profileSize - 1; ++j )
+			{
+				float grad = profile[j - 1] - profile[j + 1];
+				if( grad > bestGrad )
+				{
+					bestGrad = grad;
+					bestInd = j;
+				}
+			}
+			if( bestInd < 0 ) { continue; }
+
+			// Parabolic sub-step interpolation of the gradient peak
+			float offset = 0;
+			if( bestInd > 1 && bestInd < profileSize - 2 )
+			{
+				float gl = profile[bestInd - 2] - profile[bestInd];
+				float gr = profile[bestInd] - profile[bestInd + 2];
+				float den = gl - 2 * bestGrad + gr;
+				if( den < 0 ) { offset = 0.5f * ( gl - gr ) / den; }
+			}
+			float s = ( bestInd - numSteps + offset ) * step;
+			edgePoints.push_back( p + s * normal );
+		}
+
+		if( edgePoints.size() < 3 ) { return false; }
+		cv::fitLine( edgePoints, lines[k], cv::DIST_HUBER, 0, 0.01, 0.01 );
+	}
+
+	// Each corner is the intersection of its two adjacent sides
+	float maxShift = 2 * _params.edgeSearchRadius + _params.decimation;
+	Quad refined( 4 );
+	for( unsigned int k = 0; k < 4; ++k )
+	{
+		if( !intersect_lines( lines[(k + 3) % 4], lines[k], refined[k] ) ) { return false; }
+		cv::Point2f d = refined[k] - quad[k];
+		if( d.dot( d ) > maxShift * maxShift ) { return false; }
+	}
+	quad = refined;
+	return true;
+}
+
+bool SquareMarkerDetector::DecodeQuad( const cv::Mat& image,
+                                       Quad& quad,
+                                       unsigned int& id ) const
+{
+	const int cellDim = _params.cellPixels;
+	const float dim = MARKER_GRID_DIM * cellDim;
+	std::vector<cv::Point2f> rectCorners;
+	rectCorners.emplace_back( 0, 0 );
+	rectCorners.emplace_back( dim, 0 );
+	rectCorners.emplace_back( dim, dim );
+	rectCorners.emplace_back( 0, dim );
+
+	cv::Mat H = cv::getPerspectiveTransform( quad, rectCorners );
+	cv::Mat rectified, binary;
+	cv::warpPerspective( image, rectified, H, cv::Size( dim, dim ), cv::INTER_LINEAR );
+	cv::threshold( rectified, binary, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU );
+
+	// Vote on the center region of each cell
+	const int margin = cellDim / 4;
+	const int voteDim = cellDim - 2 * margin;
+	unsigned int borderErrors = 0;
+	MarkerPayload payload;
+	for( unsigned int y = 0; y < MARKER_GRID_DIM; ++y )
+	{
+		for( unsigned int x = 0; x < MARKER_GRID_DIM; ++x )
+		{
+			cv::Rect roi( x * cellDim + margin, y * cellDim + margin, voteDim, voteDim );
+			bool white = 2 * cv::countNonZero( binary( roi ) ) > roi.area();
+
+			bool isBorder = x == 0 || y == 0 || x == MARKER_GRID_DIM - 1 || y == MARKER_GRID_DIM - 1;
+			if( isBorder )
+			{
+				if( white && ++borderErrors > _params.maxBorderErrors ) { return false; }
+			}
+			else
+			{
+				payload[y - 1][x - 1] = white;
+			}
+		}
+	}
+
+	// The marker top-left is at quad corner r if the payload decodes after r
+	// counter-clockwise rotations
+	for( unsigned int r = 0; r < 4; ++r )
+	{
+		if( decode_payload( payload, id ) )
+		{
+			Quad ordered( 4 );
+			for( unsigned int i = 0; i < 4; ++i )
+			{
+				ordered[i] = quad[(i + r) % 4];
+			}
+			quad = ordered;
+			return true;
+		}
+		rotate_payload_ccw( payload );
+	}
+	return false;
+}
+
+std::vector<std::vector<bool> > SquareMarkerDetector::GenerateMarkerBits( unsigned int id )
+{
+	if( id >= MARKER_NUM_IDS )
+	{
+		throw std::invalid_argument( "SquareMarkerDetector: Marker ID out of range." );
+	}
+
+	std::vector<std::vector<bool> > bits( MARKER_PAYLOAD_DIM,
+	                                      std::vector<bool>( MARKER_PAYLOAD_DIM ) );
+	for( unsigned int y = 0; y < MARKER_PAYLOAD_DIM; ++y )
+	{
+		int word = marker_row_words[( id >> 2 * ( MARKER_PAYLOAD_DIM - 1 - y ) ) & 0x3];
+		for( unsigned int x = 0; x < MARKER_PAYLOAD_DIM; ++x )
+		{
+			bits[y][x] = ( word >> ( MARKER_PAYLOAD_DIM - 1 - x ) ) & 0x1;
+		}
+	}
+	return bits;
+}
+
+std::string SquareMarkerDetector::GenerateMarkerName( const std::string& prefix,
+                                                      unsigned int id )
+{
+	std::stringstream ss;
+	ss << prefix << id;
+	return ss.str();
+}
+
+Fiducial SquareMarkerDetector::GenerateMarkerFiducial( double dim )
+{
+	// Follows the checkerboard convention of image rows along y and columns along z
+	double h = 0.5 * dim;
+	Fiducial fid;
+	fid.points.emplace_back( 0, -h, -h );
+	fid.points.emplace_back( 0, -h, h );
+	fid.points.emplace_back( 0, h, h );
+	fid.points.emplace_back( 0, h, -h );
+	return fid;
+}
+
+}
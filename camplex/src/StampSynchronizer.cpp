@@ -0,0 +1,193 @@
+#include "camplex/StampSynchronizer.h"
+
+#include <stdexcept>
+
+namespace argus
+{
+
+StampSynchronizer::StampSynchronizer( unsigned int numInputs,
+                                      unsigned int queueSize,
+                                      double window )
+	: _numMatched( 0 ), _numDropped( 0 ), _numLate( 0 )
+{
+	if( numInputs == 0 || queueSize == 0 )
+	{
+		throw std::invalid_argument( "StampSynchronizer: Number of inputs and queue size must be positive." );
+	}
+
+	SetWindow( window );
+	_inputs.resize( numInputs );
+	for( unsigned int i = 0; i < numInputs; ++i )
+	{
+		_inputs[i].slots.resize( queueSize );
+	}
+	_matchedSlots.resize( numInputs );
+	_matchedSet.resize( numInputs );
+}
+
+void StampSynchronizer::RegisterCallback( const Callback& callback )
+{
+	WriteLock lock( _mutex );
+	_callback = callback;
+}
+
+void StampSynchronizer::SetWindow( double window )
+{
+	if( window < 0 )
+	{
+		throw std::invalid_argument( "StampSynchronizer: Window must be non-negative." );
+	}
+
+	WriteLock lock( _mutex );
+	_window = ros::Duration( window );
+}
+
+double StampSynchronizer::GetWindow() const
+{
+	ReadLock lock( _mutex );
+	return _window.toSec();
+}
+
+bool StampSynchronizer::Add( unsigned int input, const ros::Time& stamp,
+                             const Message& msg )
+{
+	if( input >= _inputs.size() )
+	{
+		throw std::out_of_range( "StampSynchronizer: Invalid input index." );
+	}
+
+	WriteLock lock( _mutex );
+	InputBuffer& buffer = _inputs[input];
+	if( !buffer.lastMatched.isZero() && stamp <= buffer.lastMatched )
+	{
+		++_numLate;
+		return false;
+	}
+
+	// Take an empty slot, or else overwrite the oldest message
+	int target = -1;
+	for( unsigned int i = 0; i < buffer.slots.size(); ++i )
+	{
+		const Slot& slot = buffer.slots[i];
+		if( !slot.msg )
+		{
+			target = i;
+			break;
+		}
+		if( target < 0 || slot.stamp < buffer.slots[target].stamp )
+		{
+			target = i;
+		}
+	}
+	Slot& added = buffer.slots[target];
+	if( added.msg ) { ++_numDropped; }
+	added.stamp = stamp;
+	added.msg = msg;
+
+	for( unsigned int i = 0; i < _inputs.size(); ++i )
+	{
+		_matchedSlots[i] = ( i == input ) ? target : FindMatch( _inputs[i], stamp );
+		if( _matchedSlots[i] < 0 ) { return false; }
+	}
+
+	for( unsigned int i = 0; i < _inputs.size(); ++i )
+	{
+		InputBuffer& matched = _inputs[i];
+		Slot& slot = matched.slots[_matchedSlots[i]];
+		_matchedSet[i] = slot.msg;
+		matched.lastMatched = slot.stamp;
+		slot.msg.reset();
+		EvictThrough( matched, matched.lastMatched );
+	}
+	++_numMatched;
+
+	if( _callback ) { _callback( _matchedSet ); }
+
+	// Do not hold on to the messages until the next set
+	for( unsigned int i = 0; i < _matchedSet.size(); ++i )
+	{
+		_matchedSet[i].reset();
+	}
+	return true;
+}
+
+void StampSynchronizer::Reset()
+{
+	WriteLock lock( _mutex );
+	for( unsigned int i = 0; i < _inputs.size(); ++i )
+	{
+		InputBuffer& buffer = _inputs[i];
+		for( unsigned int j = 0; j < buffer.slots.size(); ++j )
+		{
+			buffer.slots[j].msg.reset();
+		}
+		buffer.lastMatched = ros::Time();
+	}
+}
+
+unsigned int StampSynchronizer::NumInputs() const
+{
+	return _inputs.size();
+}
+
+unsigned int StampSynchronizer::NumMatched() const
+{
+	ReadLock lock( _mutex );
+	return _numMatched;
+}
+
+unsigned int StampSynchronizer::NumDropped() const
+{
+	ReadLock lock( _mutex );
+	return _numDropped;
+}
+
+unsigned int StampSynchronizer::NumLate() const
+{
+	ReadLock lock( _mutex );
+	return _numLate;
+}
+
+int StampSynchronizer::FindMatch( const InputBuffer& buffer,
+                                  const ros::Time& stamp ) const
+{
+	int best = -1;
+	ros::Duration bestDiff;
+	for( unsigned int i = 0; i < buffer.slots.size(); ++i )
+	{
+		const Slot& slot = buffer.slots[i];
+		if( !slot.msg ) { continue; }
+
+		ros::Duration diff = ( slot.stamp > stamp ) ? slot.stamp - stamp : stamp - slot.stamp;
+		if( diff > _window ) { continue; }
+		if( best < 0 || diff < bestDiff )
+		{
+			best = i;
+			bestDiff = diff;
+		}
+	}
+	return best;
+}
+
+void StampSynchronizer::EvictThrough( InputBuffer& buffer, const ros::Time& stamp )
+{
+	for( unsigned int i = 0; i < buffer.slots.size(); ++i )
+	{
+		Slot& slot = buffer.slots[i];
+		if( slot.msg && slot.stamp <= stamp )
+		{
+			slot.msg.reset();
+			++_numDropped;
+		}
+	}
+}
+
+std::ostream& operator<<( std::ostream& os, const StampSynchronizer& sync )
+{
+	os << "matched: " << sync.NumMatched()
+	   << " dropped: " << sync.NumDropped()
+	   << " late: " << sync.NumLate();
+	return os;
+}
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+// Runs BPVO on grayscale and disparity frames with argus prediction and outputs
+
+#include <ros/ros.h>
+#include <cv_bridge/cv_bridge.h>
+#include <geometry_msgs/TwistStamped.h>
+#include <nav_msgs/Odometry.h>
+
+#include <dynamic_reconfigure/server.h>
+#include "dispair/DisparityVOConfig.h"
+
+#include "bpvo/vo.h"
+
+#include "argus_utils/geometry/PoseSE3.h"
+#include "argus_utils/geometry/VelocityIntegrator.hpp"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+#include "argus_utils/synchronization/WorkerPool.h"
+#include "extrinsics_array/ExtrinsicsInterface.h"
+
+#include "camplex/CameraCalibration.h"
+#include "camplex/LatestFrameMailbox.hpp"
+#include "camplex/PipelineProfiler.h"
+
+#include <boost/function.hpp>
+#include <memory>
+
+namespace argus
+{
+
+// Writes disparities into out, marking values outside [minDisp, maxDisp] and
+// NaNs as invalid (-1) for BPVO in the same pass. The upper bound only applies
+// if maxDisp is greater than minDisp. Reuses out if possible.
+void MarkValidDisparities( const cv::Mat& disparity, float minDisp, float maxDisp,
+                           cv::Mat& out );
+
+// A synchronized frame whose disparity has not been computed yet
+struct BPVOFrame
+{
+	ros::Time time;
+	std::string frameId;
+	cv_bridge::CvImageConstPtr image; // Grayscale reference image
+	cv_bridge::CvImageConstPtr source; // Disparity or right image, interpreted by the disparity function
+	float minDisparity;
+	float maxDisparity;
+	CameraCalibration model;
+	double baseline;
+
+	BPVOFrame() : minDisparity( 0 ), maxDisparity( 0 ), baseline( 0 ) {}
+};
+
+// Runs BPVO on a separate thread that always takes the newest posted frame, so
+// that the output stays fresh when VO is slower than the camera. Disparities are
+// computed on that thread, so skipped frames cost nothing. Publishes the integrated
+// pose and twist, and reads the BPVO parameters from dynamic_reconfigure.
+class BPVOOdometry
+{
+public:
+
+	// Computes the validity-marked float disparity of a frame into a buffer reused
+	// across frames. BPVO only uses pyramid levels at and above the given level.
+	typedef boost::function<bool( const BPVOFrame&, unsigned int, cv::Mat& )> DisparityFunction;
+
+	BPVOOdometry( ros::NodeHandle& nh, ros::NodeHandle& ph,
+	              const DisparityFunction& disparityFunc );
+	~BPVOOdometry();
+
+	void PostFrame( const BPVOFrame& frame );
+
+private:
+
+	DisparityFunction _disparityFunc;
+
+	std::shared_ptr<bpvo::VisualOdometry> _vo;
+	bpvo::AlgorithmParameters _voParams;
+	dynamic_reconfigure::Server<dispair::DisparityVOConfig> _voConfigServer;
+
+	PoseSE3 _integratedPose;
+
+	ros::Publisher _posePub;
+	ros::Publisher _twistPub;
+	ros::Subscriber _trueSub;
+
+	bool _camXForward;
+	ExtrinsicsInterface _extrinsics;
+
+	// Guards the VO and its parameters against reconfiguration
+	Mutex _voMutex;
+
+	// Guards the buffered prediction velocities
+	Mutex _predictMutex;
+	bool _enablePrediction;
+	std::string _odomFrame;
+	double _maxPredictEntropy;
+	VelocityIntegratorSE3 _velIntegrator;
+	ros::Time _lastTime;
+
+	PipelineProfiler _profiler;
+	ros::Publisher _diagPub;
+	ros::Timer _statsTimer;
+
+	cv::Mat _disparity; // Reused by the process thread
+
+	LatestFrameMailbox<BPVOFrame> _mailbox;
+	WorkerPool _processWorker; // Declared after the state it uses
+
+	// TODO Group the velocity prediction functionality into an abstract superclass?
+	void OdomCallback( const nav_msgs::Odometry::ConstPtr& msg );
+	void TwistStampedCallback( const geometry_msgs::TwistStamped::ConstPtr& msg );
+	PoseSE3 PredictMotion( const ros::Time& currTime, const std::string& camFrame );
+
+	// Callback for dynamic_reconfigure
+	void ReconfigureCallback( dispair::DisparityVOConfig& config,
+	                          unsigned int level );
+	void InitializeVO( const BPVOFrame& frame );
+
+	void ProcessSpin();
+	bool ProcessFrame( const BPVOFrame& frame );
+
+	void StatsCallback( const ros::TimerEvent& event );
+};
+
+}
@@ -1,24 +1,19 @@
 #pragma once
 
-// Class for synchronizing image inputs
-// Currently we only support image/disparity pairs
+// Classes for synchronizing image inputs
+// We support image/disparity pairs and left/right stereo pairs
 
+#include <ros/ros.h>
 #include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
 #include <stereo_msgs/DisparityImage.h>
+#include <image_transport/image_transport.h>
 
-#include <message_filters/subscriber.h>
-#include <message_filters/synchronizer.h>
-#include <message_filters/sync_policies/exact_time.h>
-#include <message_filters/sync_policies/approximate_time.h>
-#include <image_transport/subscriber_filter.h>
-
-#include <memory>
+#include "camplex/StampSynchronizer.h"
 
 namespace argus
 {
 
-// TODO StereoImageSync for image pairs
-
 // NOTE This is based off of stereo_processor.h from viso2_ros
 // This class should be derived and the callback implemented
 class DisparityImageSync
@@ -32,29 +27,76 @@ public:
 
 private:
 
-	image_transport::ImageTransport _imageTransport;
-	image_transport::SubscriberFilter _imageSub;
-	message_filters::Subscriber<stereo_msgs::DisparityImage> _disparitySub;
-	message_filters::Subscriber<sensor_msgs::CameraInfo> _infoSub;
+	enum Input
+	{
+		IMAGE_INPUT = 0,
+		DISPARITY_INPUT,
+		INFO_INPUT,
+		NUM_INPUTS
+	};
 
-	typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image,
-	                                                  stereo_msgs::DisparityImage,
-	                                                  sensor_msgs::CameraInfo>
-	ExactPolicy;
-	typedef message_filters::Synchronizer<ExactPolicy> ExactSync;
+	StampSynchronizer _sync;
 
-	typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image,
-	                                                        stereo_msgs::DisparityImage,
-	                                                        sensor_msgs::CameraInfo>
-	ApproximatePolicy;
-	typedef message_filters::Synchronizer<ApproximatePolicy> ApproximateSync;
+	image_transport::ImageTransport _imageTransport;
+	image_transport::Subscriber _imageSub;
+	ros::Subscriber _disparitySub;
+	ros::Subscriber _infoSub;
+
+	ros::Timer _statsTimer;
 
-	std::shared_ptr<ExactSync> _exactSync;
-	std::shared_ptr<ApproximateSync> _approxSync;
+	void ImageCallback( const sensor_msgs::ImageConstPtr& msg );
+	void DisparityCallback( const stereo_msgs::DisparityImageConstPtr& msg );
+	void InfoCallback( const sensor_msgs::CameraInfoConstPtr& msg );
+	void SetCallback( const StampSynchronizer::MessageSet& set );
+	void StatsCallback( const ros::TimerEvent& event );
 
 	// Method to be implemented by derived class
 	virtual void DataCallback( const sensor_msgs::ImageConstPtr& image,
 	                           const stereo_msgs::DisparityImageConstPtr& disparity,
 	                           const sensor_msgs::CameraInfoConstPtr& info ) = 0;
 };
-}
\ No newline at end of file
+
+// Synchronizes left and right rectified images and their infos, such as from
+// a split stereo camera. This class should be derived and the callback implemented
+class StereoImageSync
+{
+public:
+
+	// Construct the synchronizer
+	// nh specifies the subscription namespace
+	// ph provides parameters for queueing, sync types
+	StereoImageSync( ros::NodeHandle& nh, ros::NodeHandle& ph );
+
+private:
+
+	enum Input
+	{
+		LEFT_INPUT = 0,
+		RIGHT_INPUT,
+		LEFT_INFO_INPUT,
+		RIGHT_INFO_INPUT,
+		NUM_INPUTS
+	};
+
+	StampSynchronizer _sync;
+
+	image_transport::ImageTransport _imageTransport;
+	image_transport::Subscriber _leftSub;
+	image_transport::Subscriber _rightSub;
+	ros::Subscriber _leftInfoSub;
+	ros::Subscriber _rightInfoSub;
+
+	ros::Timer _statsTimer;
+
+	void ImageCallback( const sensor_msgs::ImageConstPtr& msg, unsigned int input );
+	void InfoCallback( const sensor_msgs::CameraInfoConstPtr& msg, unsigned int input );
+	void SetCallback( const StampSynchronizer::MessageSet& set );
+	void StatsCallback( const ros::TimerEvent& event );
+
+	// Method to be implemented by derived class
+	virtual void DataCallback( const sensor_msgs::ImageConstPtr& left,
+	                           const sensor_msgs::ImageConstPtr& right,
+	                           const sensor_msgs::CameraInfoConstPtr& leftInfo,
+	                           const sensor_msgs::CameraInfoConstPtr& rightInfo ) = 0;
+};
+}
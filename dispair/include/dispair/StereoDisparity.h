@@ -0,0 +1,82 @@
+#pragma once
+
+// Computes BPVO disparities from rectified stereo pairs in-process
+
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+#include <iostream>
+
+namespace argus
+{
+
+// Block matching parameters, specified at full resolution
+struct StereoDisparityParams
+{
+	enum Method
+	{
+		METHOD_BM = 0, // Local block matching, fastest
+		METHOD_SGBM    // Semi-global matching, denser and smoother
+	};
+
+	Method method;
+	int minDisparity;
+	unsigned int numDisparities; // Rounded up to a multiple of 16 at each level
+	unsigned int blockSize;      // Must be odd, applied at the matched level
+	unsigned int uniquenessRatio;
+	unsigned int speckleWindowSize; // 0 disables speckle filtering
+	unsigned int speckleRange;
+	// SGBM smoothness penalties, 0 uses 8 and 32 times the block area
+	unsigned int p1;
+	unsigned int p2;
+
+	StereoDisparityParams();
+};
+
+std::ostream& operator<<( std::ostream& os, const StereoDisparityParams& params );
+
+// Matches rectified grayscale pairs with OpenCV's multi-threaded, vectorized
+// BM or 3-way SGBM. Pairs are downsampled to a pyramid level before matching so
+// that only the resolution BPVO uses is computed. Thread-safe, but matching
+// calls are serialized since the buffers are reused between calls.
+class StereoDisparity
+{
+public:
+
+	StereoDisparity( const StereoDisparityParams& params = StereoDisparityParams() );
+
+	void SetParams( const StereoDisparityParams& params );
+	StereoDisparityParams GetParams() const;
+
+	// Returns the range of valid disparities at full resolution
+	float GetMinDisparity() const;
+	float GetMaxDisparity() const;
+
+	// Matches the pair at the given pyramid level and writes float disparities
+	// in full resolution pixels at full size into out, with unmatched pixels
+	// marked invalid (-1). Reuses out if possible. Returns false if the images
+	// are unsuitable or too small for the level.
+	bool Compute( const cv::Mat& left, const cv::Mat& right,
+	              unsigned int level, cv::Mat& out );
+
+private:
+
+	mutable Mutex _mutex;
+	StereoDisparityParams _params;
+
+	// Matcher configured for the level it was last used at
+	cv::Ptr<cv::StereoMatcher> _matcher;
+	int _matcherLevel;
+
+	// Buffers reused between calls
+	cv::Mat _leftLevel;
+	cv::Mat _rightLevel;
+	cv::Mat _rawDisparity;
+	cv::Mat _levelDisparity;
+
+	void ConfigureMatcher( unsigned int level );
+};
+
+}
@@ -0,0 +1,127 @@
+#include <ros/ros.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include "dispair/ImageSync.h"
+#include "dispair/BPVOOdometry.h"
+#include "dispair/StereoDisparity.h"
+
+#include "argus_utils/utils/ParamUtils.h"
+
+#include <boost/bind.hpp>
+
+using namespace argus;
+
+// A node that runs BPVO on rectified stereo pairs, computing the disparities
+// in-process only at the resolution BPVO uses
+class StereoVO
+	: public StereoImageSync
+{
+public:
+
+	StereoVO( ros::NodeHandle& nh, ros::NodeHandle& ph )
+		: StereoImageSync( nh, ph ),
+		_odometry( nh, ph, boost::bind( &StereoVO::ComputeDisparity, this, _1, _2, _3 ) )
+	{
+		StereoDisparityParams params;
+		std::string method;
+		GetParam<std::string>( ph, "matcher/method", method, "sgbm" );
+		if( method == "bm" )
+		{
+			params.method = StereoDisparityParams::METHOD_BM;
+		}
+		else if( method == "sgbm" )
+		{
+			params.method = StereoDisparityParams::METHOD_SGBM;
+		}
+		else
+		{
+			throw std::invalid_argument( "Unknown matcher method: " + method );
+		}
+
+		int minDisparity, numDisparities, blockSize, uniqueness, speckleWindow,
+		    speckleRange, p1, p2;
+		GetParam( ph, "matcher/min_disparity", minDisparity, 0 );
+		GetParam( ph, "matcher/num_disparities", numDisparities, 64 );
+		GetParam( ph, "matcher/block_size", blockSize, 5 );
+		GetParam( ph, "matcher/uniqueness_ratio", uniqueness, 10 );
+		GetParam( ph, "matcher/speckle_window_size", speckleWindow, 0 );
+		GetParam( ph, "matcher/speckle_range", speckleRange, 0 );
+		GetParam( ph, "matcher/p1", p1, 0 );
+		GetParam( ph, "matcher/p2", p2, 0 );
+		params.minDisparity = minDisparity;
+		params.numDisparities = numDisparities;
+		params.blockSize = blockSize;
+		params.uniquenessRatio = uniqueness;
+		params.speckleWindowSize = speckleWindow;
+		params.speckleRange = speckleRange;
+		params.p1 = p1;
+		params.p2 = p2;
+
+		_matcher.SetParams( params );
+		ROS_INFO_STREAM( "Stereo matcher parameters: " << std::endl << params );
+	}
+
+private:
+
+	StereoDisparity _matcher;
+	BPVOOdometry _odometry; // Declared after the matcher it uses
+
+	virtual void DataCallback( const sensor_msgs::ImageConstPtr& left,
+	                           const sensor_msgs::ImageConstPtr& right,
+	                           const sensor_msgs::CameraInfoConstPtr& leftInfo,
+	                           const sensor_msgs::CameraInfoConstPtr& rightInfo )
+	{
+		BPVOFrame frame;
+		try
+		{
+			frame.image = cv_bridge::toCvShare( left, "mono8" );
+			frame.source = cv_bridge::toCvShare( right, "mono8" );
+		}
+		catch( cv_bridge::Exception& e )
+		{
+			ROS_ERROR( "Error in conversion: %s", e.what() );
+			return;
+		}
+
+		// The right projection holds -fx * baseline for rectified pairs
+		frame.baseline = -rightInfo->P[3] / rightInfo->P[0];
+		if( !( frame.baseline > 0 ) )
+		{
+			ROS_WARN_THROTTLE( 5.0, "Right camera info has no valid baseline. Are the images rectified?" );
+			return;
+		}
+
+		frame.time = left->header.stamp;
+		frame.frameId = left->header.frame_id;
+		frame.minDisparity = _matcher.GetMinDisparity();
+		frame.maxDisparity = _matcher.GetMaxDisparity();
+		frame.model = CameraCalibration( leftInfo->header.frame_id, *leftInfo );
+		frame.model.SetScale( frame.image->image.size() );
+		_odometry.PostFrame( frame );
+	}
+
+	bool ComputeDisparity( const BPVOFrame& frame, unsigned int level,
+	                       cv::Mat& disparity )
+	{
+		if( !_matcher.Compute( frame.image->image, frame.source->image,
+		                       level, disparity ) )
+		{
+			ROS_WARN_THROTTLE( 5.0, "Could not match stereo pair at level %d", level );
+			return false;
+		}
+		return true;
+	}
+};
+
+int main( int argc, char** argv )
+{
+	ros::init( argc, argv, "stereo_vo" );
+
+	ros::NodeHandle nh;
+	ros::NodeHandle ph( "~" );
+	StereoVO vo( nh, ph );
+
+	ros::spin();
+
+	return 0;
+}
@@ -0,0 +1,358 @@
+#include "dispair/BPVOOdometry.h"
+
+#include "geometry_msgs/PoseStamped.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
+
+#include "argus_utils/utils/ParamUtils.h"
+#include "argus_utils/random/MultivariateGaussian.hpp"
+
+#include "camplex/FiducialCommon.h"
+
+#include <boost/bind.hpp>
+
+namespace argus
+{
+
+void MarkValidDisparities( const cv::Mat& disparity, float minDisp, float maxDisp,
+                           cv::Mat& out )
+{
+	// Reallocate rather than overwrite data still referenced elsewhere
+	if( out.u && out.u->refcount > 1 ) { out.release(); }
+	out.create( disparity.size(), CV_32FC1 );
+
+	// Producers that leave max_disparity unset report 0, so no upper bound
+	const bool checkMax = maxDisp > minDisp;
+	for( int i = 0; i < disparity.rows; ++i )
+	{
+		const float* src = disparity.ptr<float>( i );
+		float* dst = out.ptr<float>( i );
+		for( int j = 0; j < disparity.cols; ++j )
+		{
+			const float d = src[j];
+			dst[j] = ( d >= minDisp && ( !checkMax || d <= maxDisp ) ) ? d : -1.0f;
+		}
+	}
+}
+
+BPVOOdometry::BPVOOdometry( ros::NodeHandle& nh, ros::NodeHandle& ph,
+                            const DisparityFunction& disparityFunc )
+	: _disparityFunc( disparityFunc ), _extrinsics( nh, ph )
+{
+	_posePub = ph.advertise<geometry_msgs::PoseStamped>( "pose", 10 );
+	_twistPub = ph.advertise<geometry_msgs::TwistStamped>( "twist", 10 );
+
+	GetParam( ph, "camera_x_forward", _camXForward, true );
+
+	GetParam( ph, "max_predict_entropy", _maxPredictEntropy, 3.0 );
+	GetParam( ph, "enable_prediction", _enablePrediction, false );
+	if( _enablePrediction )
+	{
+		std::string predictionMode;
+		GetParam<std::string>( ph, "prediction_mode", predictionMode );
+		if( predictionMode == "odometry" )
+		{
+			_trueSub = nh.subscribe( "truth", 10, &BPVOOdometry::OdomCallback, this );
+		}
+		else if( predictionMode == "twist_stamped" )
+		{
+			_trueSub = nh.subscribe( "truth", 10, &BPVOOdometry::TwistStampedCallback, this );
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown prediction mode");
+		}
+	}
+
+	dynamic_reconfigure::Server<dispair::DisparityVOConfig>::CallbackType cb;
+	cb = boost::bind( &BPVOOdometry::ReconfigureCallback, this, _1, _2 );
+	_voConfigServer.setCallback( cb );
+
+	// Stage timings and counters are only recorded if they are published
+	double statsPeriod;
+	GetParam( ph, "stats_period", statsPeriod, 10.0 );
+	_profiler.SetEnabled( statsPeriod > 0 );
+	if( statsPeriod > 0 )
+	{
+		_diagPub = nh.advertise<diagnostic_msgs::DiagnosticArray>( "diagnostics", 10 );
+		_statsTimer = nh.createTimer( ros::Duration( statsPeriod ),
+		                              &BPVOOdometry::StatsCallback,
+		                              this );
+	}
+
+	_processWorker.SetNumWorkers( 1 );
+	_processWorker.EnqueueJob( boost::bind( &BPVOOdometry::ProcessSpin, this ) );
+	_processWorker.StartWorkers();
+}
+
+BPVOOdometry::~BPVOOdometry()
+{
+	_mailbox.Close();
+}
+
+void BPVOOdometry::PostFrame( const BPVOFrame& frame )
+{
+	_mailbox.Post( frame );
+}
+
+void BPVOOdometry::OdomCallback( const nav_msgs::Odometry::ConstPtr& msg )
+{
+	PoseSE3::TangentVector vel = MsgToTangent( msg->twist.twist );
+	PoseSE3::CovarianceMatrix cov;
+	ParseMatrix( msg->twist.covariance, cov );
+
+	WriteLock lock( _predictMutex );
+	_velIntegrator.BufferInfo( msg->header.stamp.toSec(), vel, cov );
+	_odomFrame = msg->child_frame_id;
+}
+
+void BPVOOdometry::TwistStampedCallback( const geometry_msgs::TwistStamped::ConstPtr& msg )
+{
+	PoseSE3::TangentVector vel = MsgToTangent( msg->twist );
+	PoseSE3::CovarianceMatrix cov = PoseSE3::CovarianceMatrix::Zero();
+
+	WriteLock lock( _predictMutex );
+	_velIntegrator.BufferInfo( msg->header.stamp.toSec(), vel, cov );
+	_odomFrame = msg->header.frame_id;		
+}
+
+PoseSE3 BPVOOdometry::PredictMotion( const ros::Time& currTime, const std::string& camFrame )
+{
+	WriteLock lock( _predictMutex );
+	// Can't predict motion if we haven't received any odom messages
+	if( !_enablePrediction || _odomFrame.empty() )
+	{
+		// ROS_WARN_STREAM( "No odometry messages received" );
+		return PoseSE3();
+	}
+
+	PoseSE3 odomDisp;
+	PoseSE3::CovarianceMatrix odomCov;
+	if( !_velIntegrator.Integrate( _lastTime.toSec(), currTime.toSec(),
+	                               odomDisp, odomCov ) )
+	{
+		ROS_WARN_STREAM( "Could not predict motion from " << _lastTime << " to " << currTime );
+		odomDisp = PoseSE3(); // Unnecessary
+		odomCov = PoseSE3::CovarianceMatrix::Identity(); // TODO
+	}
+
+	PoseSE3 odomToCam;
+	PoseSE3 camDisp;
+	PoseSE3::CovarianceMatrix guessCov; // TODO Use the covariance?
+	try
+	{
+		odomToCam = _extrinsics.GetExtrinsics( _odomFrame,
+		                                       camFrame,
+		                                       currTime );
+	}
+	catch( ExtrinsicsException& e )
+	{
+		ROS_WARN_STREAM( "Could not get extrinsics: " << e.what() );
+		return PoseSE3();
+	}
+
+	camDisp = odomToCam * odomDisp * odomToCam.Inverse();
+	guessCov = TransformCovariance( odomCov, odomToCam );
+	double entropy = GaussianEntropy( guessCov );
+	if( entropy > _maxPredictEntropy )
+	{
+		ROS_WARN_STREAM( "Motion prediction entropy exceeds limit! Using default prior" );
+		return PoseSE3();
+	}
+
+	static PoseSE3 xToZ( 0, 0, 0, -0.5, -0.5, 0.5, -0.5 );
+	if( _camXForward )
+	{
+		camDisp = xToZ * camDisp * xToZ.Inverse();
+	}
+
+	return camDisp;
+}
+
+void BPVOOdometry::ReconfigureCallback( dispair::DisparityVOConfig& config,
+                                        unsigned int level )
+{
+	WriteLock lock( _voMutex );
+	_vo.reset();
+	_voParams.numPyramidLevels = config.num_pyramid_levels;
+	_voParams.minImageDimensionForPyramid = config.min_pyramid_img_dim;
+
+	// TODO Give feedback when changing descriptor-specific parameters but not using that descriptor
+	_voParams.sigmaPriorToCensusTransform = config.bitplanes_sigma_census;
+	_voParams.sigmaBitPlanes = config.bitplanes_sigma_smooth;
+
+	_voParams.dfSigma1 = config.descfield_sigma_1;
+	_voParams.dfSigma2 = config.descfield_sigma_2;
+
+	_voParams.latchNumBytes = config.latch_num_bytes;
+	_voParams.latchRotationInvariance = config.latch_rotation_invariance;
+	_voParams.latchHalfSsdSize = config.latch_half_ssd_size;
+
+	_voParams.centralDifferenceRadius = config.centdiff_radius;
+	_voParams.centralDifferenceSigmaBefore = config.centdiff_sigma_before;
+	_voParams.centralDifferenceSigmaAfter = config.centdiff_sigma_after;
+
+	_voParams.laplacianKernelSize = config.laplacian_kernel_size;
+
+	_voParams.maxIterations = config.opt_max_iters;
+	_voParams.parameterTolerance = std::pow( 10.0, config.opt_log_param_tol );
+	_voParams.functionTolerance = std::pow( 10.0, config.opt_log_func_tol );
+	_voParams.gradientTolerance = std::pow( 10.0, config.opt_log_grad_tol );
+	_voParams.relaxTolerancesForCoarseLevels = config.opt_relax_coarse_tols;
+
+	_voParams.gradientEstimation = bpvo::GradientEstimationType( config.gradient_estimation );
+	_voParams.interp = bpvo::InterpolationType( config.interpolation );
+	_voParams.lossFunction = bpvo::LossFunctionType( config.loss_function );
+	_voParams.descriptor = bpvo::DescriptorType( config.descriptor );
+	_voParams.verbosity = bpvo::VerbosityType( config.verbosity );
+
+	_voParams.minTranslationMagToKeyFrame = config.keyframe_min_translation;
+	_voParams.minRotationMagToKeyFrame = config.keyframe_min_rotation;
+	_voParams.maxFractionOfGoodPointsToKeyFrame = config.keyframe_min_inlier_ratio;
+	_voParams.goodPointThreshold = config.keyframe_inlier_threshold;
+	_voParams.maxSolutionError = config.max_solution_error;
+
+	_voParams.minNumPixelsForNonMaximaSuppression = config.min_pix_nms;
+	_voParams.nonMaxSuppRadius = config.radius_nms;
+	_voParams.minRatioPixelsToWork = config.min_disparity_pix_ratio;
+	_voParams.minSaliency = config.min_saliency;
+
+	if( config.min_valid_disparity > config.max_valid_disparity )
+	{
+		ROS_WARN_STREAM( "Requested min valid disparity " << config.min_valid_disparity <<
+		" greater than max valid disparity " << config.max_valid_disparity << "! Increasing max.");
+		config.max_valid_disparity = config.min_valid_disparity;
+	}
+	_voParams.minValidDisparity = config.min_valid_disparity;
+	_voParams.maxValidDisparity = config.max_valid_disparity;
+
+	// NOTE test level cannot be lower than num_pyramid_levels
+	// NOTE In the case of auto pyramid, we can't tell what the depth will be
+	if( config.num_pyramid_levels > 0 && (config.max_test_level >= config.num_pyramid_levels) )
+	{
+		ROS_WARN_STREAM( "Requested test level " << config.max_test_level << " with " <<
+		                 config.num_pyramid_levels << " pyramid levels! Shrinking test level appropriately." );
+		config.max_test_level = config.num_pyramid_levels - 1;
+	}
+	_voParams.maxTestLevel = config.max_test_level;
+	_voParams.withNormalization = config.normalize_linsys;
+}
+
+void BPVOOdometry::InitializeVO( const BPVOFrame& frame )
+{
+	// TODO Parameters?
+	bpvo::Matrix33 K;
+	const cv::Matx33d& Km = frame.model.GetIntrinsicMatrix();
+	for( unsigned int i = 0; i < K.rows(); ++i )
+	{
+		for( unsigned int j = 0; j < K.cols(); ++j )
+		{
+			K( i, j ) = Km( i, j );
+		}
+	}
+
+	bpvo::ImageSize imgSize;
+	imgSize.rows = frame.image->image.size().height;
+	imgSize.cols = frame.image->image.size().width;
+
+	_vo = std::make_shared<bpvo::VisualOdometry>( K, frame.baseline, imgSize, _voParams );
+}
+
+void BPVOOdometry::ProcessSpin()
+{
+	BPVOFrame frame;
+	unsigned int skipped;
+	while( _mailbox.WaitTake( frame, skipped ) )
+	{
+		_profiler.Increment( "skipped_frames", skipped );
+
+		PipelineProfiler::ScopedTimer timer( _profiler, "process" );
+		bool success = ProcessFrame( frame );
+		timer.Stop();
+
+		_profiler.Increment( "frames" );
+		if( !success ) { _profiler.Increment( "failures" ); }
+		if( _profiler.IsEnabled() )
+		{
+			double latency = ( ros::Time::now() - frame.time ).toSec();
+			_profiler.AddTiming( "latency", latency );
+		}
+	}
+}
+
+bool BPVOOdometry::ProcessFrame( const BPVOFrame& frame )
+{
+	const ros::Time& now = frame.time;
+	if( _lastTime.isZero() ) { _lastTime = now; }
+
+	double dt = (now - _lastTime).toSec();
+	PoseSE3 guessDisp = PredictMotion( now, frame.frameId ).Inverse();
+	_lastTime = now;
+	bpvo::Matrix44 guessH = guessDisp.ToMatrix().cast<float>();
+
+	// Disparities are only needed down to the finest level BPVO tests
+	unsigned int finestLevel;
+	{
+		WriteLock lock( _voMutex );
+		finestLevel = _voParams.maxTestLevel;
+	}
+	PipelineProfiler::ScopedTimer disparityTimer( _profiler, "disparity" );
+	if( !_disparityFunc( frame, finestLevel, _disparity ) )
+	{
+		return false;
+	}
+	disparityTimer.Stop();
+
+	bpvo::Result res;
+	{
+		PipelineProfiler::ScopedTimer alignTimer( _profiler, "alignment" );
+		WriteLock lock( _voMutex );
+		if( !_vo ) { InitializeVO( frame ); }
+		res = _vo->addFrame( frame.image->image,
+		                     _disparity,
+		                     guessH );
+	}
+	if( !res.success )
+	{ 
+	  //ROS_WARN_STREAM( "VO Failed!" );
+		return false; 
+	}
+
+	FixedMatrixType<4, 4> delta = res.displacement.cast<double>();
+	delta(3,3) = 1.0; // NOTE Sometimes bad conditioning inside BPVO's optimization
+	PoseSE3 camDisplacement = PoseSE3( delta ).Inverse();
+
+	static PoseSE3 zToX( 0, 0, 0, -0.5, 0.5, -0.5, 0.5 );
+	if( _camXForward )
+	{
+		camDisplacement = zToX * camDisplacement * zToX.Inverse();
+	}
+
+	_integratedPose = _integratedPose * camDisplacement;
+
+	geometry_msgs::PoseStamped poseMsg;
+	poseMsg.header.frame_id = frame.frameId;
+	poseMsg.header.stamp = frame.time;
+	poseMsg.pose = PoseToMsg( _integratedPose );
+	_posePub.publish( poseMsg );
+
+	if( dt > 0 )
+	{
+		geometry_msgs::TwistStamped twistMsg;
+		twistMsg.header.frame_id = frame.frameId;
+		twistMsg.header.stamp = frame.time;
+		PoseSE3::TangentVector tang = PoseSE3::Log( camDisplacement ) / dt;
+		twistMsg.twist = TangentToMsg( tang );
+		_twistPub.publish( twistMsg );
+	}
+	return true;
+}
+
+void BPVOOdometry::StatsCallback( const ros::TimerEvent& event )
+{
+	diagnostic_msgs::DiagnosticArray msg;
+	msg.header.stamp = event.current_real;
+	msg.status.push_back( _profiler.Report( ros::this_node::getName() ) );
+	_diagPub.publish( msg );
+}
+
+}
@@ -2,41 +2,141 @@
 
 #include "argus_utils/utils/ParamUtils.h"
 
+#include <boost/bind.hpp>
+
 namespace argus
 {
+
+static unsigned int read_sync_queue_size( ros::NodeHandle& ph )
+{
+	unsigned int syncQueueSize;
+	GetParam( ph, "sync_queue_size", syncQueueSize, (unsigned int) 5 );
+	return syncQueueSize;
+}
+
+// Exact sync is approximate sync with a zero window
+static double read_sync_window( ros::NodeHandle& ph )
+{
+	bool approximateSync;
+	double window = 0;
+	GetParam( ph, "approximate_sync", approximateSync, false );
+	if( approximateSync )
+	{
+		GetParam( ph, "approximate_window", window, 0.01 );
+	}
+	return window;
+}
+
 DisparityImageSync::DisparityImageSync( ros::NodeHandle& nh, ros::NodeHandle& ph )
-	: _imageTransport( nh )
+	: _sync( NUM_INPUTS, read_sync_queue_size( ph ), read_sync_window( ph ) ),
+	_imageTransport( nh )
 {
+	_sync.RegisterCallback( boost::bind( &DisparityImageSync::SetCallback, this, _1 ) );
+
 	unsigned int imgQueueSize;
 	std::string transport;
 	GetParam( ph, "image_queue_size", imgQueueSize, (unsigned int) 3 );
 	GetParam<std::string>( ph, "image_transport", transport, "raw" );
 
-	_imageSub.subscribe( _imageTransport, "image", imgQueueSize, transport );
-	_disparitySub.subscribe( nh, "disparity", imgQueueSize );
-	_infoSub.subscribe( nh, "camera_info", imgQueueSize );
+	_imageSub = _imageTransport.subscribe( "image", imgQueueSize,
+	                                       &DisparityImageSync::ImageCallback, this,
+	                                       image_transport::TransportHints( transport ) );
+	_disparitySub = nh.subscribe( "disparity", imgQueueSize,
+	                              &DisparityImageSync::DisparityCallback, this );
+	_infoSub = nh.subscribe( "camera_info", imgQueueSize,
+	                         &DisparityImageSync::InfoCallback, this );
 
-	unsigned int syncQueueSize;
-	bool approximateSync;
-	GetParam( ph, "sync_queue_size", syncQueueSize, (unsigned int) 5 );
-	GetParam( ph, "approximate_sync", approximateSync, false );
-	if( approximateSync )
+	double statsPeriod;
+	GetParam( ph, "sync_stats_period", statsPeriod, 10.0 );
+	if( statsPeriod > 0 )
 	{
-		_approxSync = std::make_shared<ApproximateSync>( ApproximatePolicy( syncQueueSize ),
-		                                                 _imageSub,
-		                                                 _disparitySub,
-		                                                 _infoSub );
-		_approxSync->registerCallback( boost::bind( &DisparityImageSync::DataCallback,
-		                                            this, _1, _2, _3 ) );
+		_statsTimer = nh.createTimer( ros::Duration( statsPeriod ),
+		                              &DisparityImageSync::StatsCallback, this );
 	}
-	else
+}
+
+void DisparityImageSync::ImageCallback( const sensor_msgs::ImageConstPtr& msg )
+{
+	_sync.Add( IMAGE_INPUT, msg );
+}
+
+void DisparityImageSync::DisparityCallback( const stereo_msgs::DisparityImageConstPtr& msg )
+{
+	_sync.Add( DISPARITY_INPUT, msg );
+}
+
+void DisparityImageSync::InfoCallback( const sensor_msgs::CameraInfoConstPtr& msg )
+{
+	_sync.Add( INFO_INPUT, msg );
+}
+
+void DisparityImageSync::SetCallback( const StampSynchronizer::MessageSet& set )
+{
+	DataCallback( StampSynchronizer::Get<sensor_msgs::Image>( set, IMAGE_INPUT ),
+	              StampSynchronizer::Get<stereo_msgs::DisparityImage>( set, DISPARITY_INPUT ),
+	              StampSynchronizer::Get<sensor_msgs::CameraInfo>( set, INFO_INPUT ) );
+}
+
+void DisparityImageSync::StatsCallback( const ros::TimerEvent& event )
+{
+	ROS_INFO_STREAM( "Image/disparity sync " << _sync );
+}
+
+StereoImageSync::StereoImageSync( ros::NodeHandle& nh, ros::NodeHandle& ph )
+	: _sync( NUM_INPUTS, read_sync_queue_size( ph ), read_sync_window( ph ) ),
+	_imageTransport( nh )
+{
+	_sync.RegisterCallback( boost::bind( &StereoImageSync::SetCallback, this, _1 ) );
+
+	unsigned int imgQueueSize;
+	std::string transport;
+	GetParam( ph, "image_queue_size", imgQueueSize, (unsigned int) 3 );
+	GetParam<std::string>( ph, "image_transport", transport, "raw" );
+	image_transport::TransportHints hints( transport );
+
+	typedef boost::function<void( const sensor_msgs::ImageConstPtr& )> ImageCallbackType;
+	_leftSub = _imageTransport.subscribe( "left/image_rect", imgQueueSize,
+	                                      ImageCallbackType( boost::bind( &StereoImageSync::ImageCallback, this, _1, (unsigned int) LEFT_INPUT ) ),
+	                                      ros::VoidPtr(), hints );
+	_rightSub = _imageTransport.subscribe( "right/image_rect", imgQueueSize,
+	                                       ImageCallbackType( boost::bind( &StereoImageSync::ImageCallback, this, _1, (unsigned int) RIGHT_INPUT ) ),
+	                                       ros::VoidPtr(), hints );
+	_leftInfoSub = nh.subscribe<sensor_msgs::CameraInfo>( "left/camera_info", imgQueueSize,
+	                                                       boost::bind( &StereoImageSync::InfoCallback, this, _1, (unsigned int) LEFT_INFO_INPUT ) );
+	_rightInfoSub = nh.subscribe<sensor_msgs::CameraInfo>( "right/camera_info", imgQueueSize,
+	                                                        boost::bind( &StereoImageSync::InfoCallback, this, _1, (unsigned int) RIGHT_INFO_INPUT ) );
+
+	double statsPeriod;
+	GetParam( ph, "sync_stats_period", statsPeriod, 10.0 );
+	if( statsPeriod > 0 )
 	{
-		_exactSync = std::make_shared<ExactSync>( ExactPolicy( syncQueueSize ),
-		                                          _imageSub,
-		                                          _disparitySub,
-		                                          _infoSub );
-		_exactSync->registerCallback( boost::bind( &DisparityImageSync::DataCallback,
-		                                           this, _1, _2, _3 ) );
+		_statsTimer = nh.createTimer( ros::Duration( statsPeriod ),
+		                              &StereoImageSync::StatsCallback, this );
 	}
 }
-}
\ No newline at end of file
+
+void StereoImageSync::ImageCallback( const sensor_msgs::ImageConstPtr& msg,
+                                     unsigned int input )
+{
+	_sync.Add( input, msg );
+}
+
+void StereoImageSync::InfoCallback( const sensor_msgs::CameraInfoConstPtr& msg,
+                                    unsigned int input )
+{
+	_sync.Add( input, msg );
+}
+
+void StereoImageSync::SetCallback( const StampSynchronizer::MessageSet& set )
+{
+	DataCallback( StampSynchronizer::Get<sensor_msgs::Image>( set, LEFT_INPUT ),
+	              StampSynchronizer::Get<sensor_msgs::Image>( set, RIGHT_INPUT ),
+	              StampSynchronizer::Get<sensor_msgs::CameraInfo>( set, LEFT_INFO_INPUT ),
+	              StampSynchronizer::Get<sensor_msgs::CameraInfo>( set, RIGHT_INFO_INPUT ) );
+}
+
+void StereoImageSync::StatsCallback( const ros::TimerEvent& event )
+{
+	ROS_INFO_STREAM( "Stereo sync " << _sync );
+}
+}
@@ -0,0 +1,182 @@
+#include "dispair/StereoDisparity.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace argus
+{
+
+// Converts fixed-point matcher disparities at a level to float disparities in
+// full resolution pixels, marking unmatched values as invalid (-1) in the same pass
+static void convert_raw_disparities( const cv::Mat& raw, short minRaw, float scale,
+                                     cv::Mat& out )
+{
+	// Reallocate rather than overwrite data still referenced elsewhere
+	if( out.u && out.u->refcount > 1 ) { out.release(); }
+	out.create( raw.size(), CV_32FC1 );
+
+	const float rawScale = scale / cv::StereoMatcher::DISP_SCALE;
+	for( int i = 0; i < raw.rows; ++i )
+	{
+		const short* src = raw.ptr<short>( i );
+		float* dst = out.ptr<float>( i );
+		for( int j = 0; j < raw.cols; ++j )
+		{
+			const short d = src[j];
+			dst[j] = ( d >= minRaw ) ? d * rawScale : -1.0f;
+		}
+	}
+}
+
+StereoDisparityParams::StereoDisparityParams()
+	: method( METHOD_SGBM ), minDisparity( 0 ), numDisparities( 64 ),
+	blockSize( 5 ), uniquenessRatio( 10 ), speckleWindowSize( 0 ),
+	speckleRange( 0 ), p1( 0 ), p2( 0 ) {}
+
+std::ostream& operator<<( std::ostream& os, const StereoDisparityParams& params )
+{
+	os << "method: " << ( params.method == StereoDisparityParams::METHOD_BM ? "bm" : "sgbm" ) << std::endl;
+	os << "min_disparity: " << params.minDisparity << std::endl;
+	os << "num_disparities: " << params.numDisparities << std::endl;
+	os << "block_size: " << params.blockSize << std::endl;
+	os << "uniqueness_ratio: " << params.uniquenessRatio << std::endl;
+	os << "speckle_window_size: " << params.speckleWindowSize << std::endl;
+	os << "speckle_range: " << params.speckleRange << std::endl;
+	os << "p1: " << params.p1 << std::endl;
+	os << "p2: " << params.p2;
+	return os;
+}
+
+StereoDisparity::StereoDisparity( const StereoDisparityParams& params )
+	: _matcherLevel( -1 )
+{
+	SetParams( params );
+}
+
+void StereoDisparity::SetParams( const StereoDisparityParams& params )
+{
+	if( params.numDisparities == 0 )
+	{
+		throw std::invalid_argument( "StereoDisparity: Number of disparities must be positive." );
+	}
+	if( params.blockSize % 2 == 0 )
+	{
+		throw std::invalid_argument( "StereoDisparity: Block size must be odd." );
+	}
+	if( params.method == StereoDisparityParams::METHOD_BM &&
+	    ( params.blockSize < 5 || params.blockSize > 255 ) )
+	{
+		throw std::invalid_argument( "StereoDisparity: BM block size must be in [5, 255]." );
+	}
+
+	WriteLock lock( _mutex );
+	_params = params;
+	_matcher.release();
+	_matcherLevel = -1;
+}
+
+StereoDisparityParams StereoDisparity::GetParams() const
+{
+	ReadLock lock( _mutex );
+	return _params;
+}
+
+float StereoDisparity::GetMinDisparity() const
+{
+	ReadLock lock( _mutex );
+	return _params.minDisparity;
+}
+
+float StereoDisparity::GetMaxDisparity() const
+{
+	ReadLock lock( _mutex );
+	return _params.minDisparity + _params.numDisparities - 1;
+}
+
+bool StereoDisparity::Compute( const cv::Mat& left, const cv::Mat& right,
+                               unsigned int level, cv::Mat& out )
+{
+	if( left.empty() || left.type() != CV_8UC1 ||
+	    right.type() != CV_8UC1 || left.size() != right.size() )
+	{
+		return false;
+	}
+
+	WriteLock lock( _mutex );
+	if( !_matcher || _matcherLevel != (int) level )
+	{
+		ConfigureMatcher( level );
+	}
+
+	// Match at the level resolution directly instead of building a full pyramid
+	const double scale = 1 << level;
+	const cv::Mat* leftIn = &left;
+	const cv::Mat* rightIn = &right;
+	if( level > 0 )
+	{
+		cv::resize( left, _leftLevel, cv::Size(), 1.0 / scale, 1.0 / scale, cv::INTER_AREA );
+		cv::resize( right, _rightLevel, cv::Size(), 1.0 / scale, 1.0 / scale, cv::INTER_AREA );
+		leftIn = &_leftLevel;
+		rightIn = &_rightLevel;
+	}
+
+	const int minDisp = _matcher->getMinDisparity();
+	const int numDisp = _matcher->getNumDisparities();
+	if( leftIn->cols <= numDisp + _matcher->getBlockSize() ||
+	    leftIn->rows <= _matcher->getBlockSize() )
+	{
+		return false;
+	}
+
+	_matcher->compute( *leftIn, *rightIn, _rawDisparity );
+
+	const short minRaw = minDisp * cv::StereoMatcher::DISP_SCALE;
+	if( level == 0 )
+	{
+		convert_raw_disparities( _rawDisparity, minRaw, scale, out );
+		return true;
+	}
+
+	// Nearest neighbor upsampling keeps invalid markers intact
+	convert_raw_disparities( _rawDisparity, minRaw, scale, _levelDisparity );
+	if( out.u && out.u->refcount > 1 ) { out.release(); }
+	cv::resize( _levelDisparity, out, left.size(), 0, 0, cv::INTER_NEAREST );
+	return true;
+}
+
+void StereoDisparity::ConfigureMatcher( unsigned int level )
+{
+	// Disparity ranges shrink with resolution, but block sizes do not
+	const int scale = 1 << level;
+	const int minDisp = (int) std::floor( _params.minDisparity / (double) scale );
+	int numDisp = ( _params.numDisparities + scale - 1 ) / scale;
+	numDisp = std::max( 16, ( ( numDisp + 15 ) / 16 ) * 16 );
+
+	const int blockSize = _params.blockSize;
+	if( _params.method == StereoDisparityParams::METHOD_BM )
+	{
+		cv::Ptr<cv::StereoBM> bm = cv::StereoBM::create( numDisp, blockSize );
+		bm->setMinDisparity( minDisp );
+		bm->setUniquenessRatio( _params.uniquenessRatio );
+		bm->setSpeckleWindowSize( _params.speckleWindowSize );
+		bm->setSpeckleRange( _params.speckleRange );
+		_matcher = bm;
+	}
+	else
+	{
+		const int area = blockSize * blockSize;
+		const int p1 = _params.p1 > 0 ? _params.p1 : 8 * area;
+		const int p2 = _params.p2 > 0 ? _params.p2 : 32 * area;
+		_matcher = cv::StereoSGBM::create( minDisp, numDisp, blockSize, p1, p2, 0, 0,
+		                                   _params.uniquenessRatio,
+		                                   _params.speckleWindowSize,
+		                                   _params.speckleRange,
+		                                   cv::StereoSGBM::MODE_SGBM_3WAY );
+	}
+	_matcherLevel = level;
+}
+
+}
@@ -2,12 +2,41 @@
 
 #include "odoflow/InterestPointDetector.h"
 #include "paraset/ParameterManager.hpp"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+#include <iostream>
 
-// TODO This class is not thread-safe!
 namespace argus
 {
+/*! \brief Parameters for corner interest point detection. */
+struct CornerPointDetectorParams
+{
+	/*! \brief Maximum number of points to find. */
+	unsigned int maxNumPoints;
+	/*! \brief Minimum corner quality relative to the best corner. */
+	double minQuality;
+	/*! \brief Minimum point separation, normalized by the mean image dimension. */
+	double minSeparation;
+	/*! \brief Corner covariation window size (pix). */
+	unsigned int blockDim;
+	bool useHarris;
+	double harrisK;
+
+	bool enableRefine;
+	/*! \brief Subpixel refinement search window half-dim (pix). */
+	unsigned int refineWindowDim;
+	/*! \brief Subpixel refinement zero window half-dim (pix). -1 disables it. */
+	int refineZeroDim;
+	unsigned int refineMaxIters;
+	/*! \brief Minimum refinement iteration log10 improvement. */
+	double refineMinLogEps;
+
+	CornerPointDetectorParams();
+};
+std::ostream& operator<<( std::ostream& os, const CornerPointDetectorParams& params );
+
 /*! \brief Finds strong corner interest points in an image for
- * optical flow tracking.
+ * optical flow tracking. Thread-safe.
  */
 class CornerPointDetector
 	: public InterestPointDetector
@@ -16,13 +45,25 @@ public:
 
 	typedef std::shared_ptr<CornerPointDetector> Ptr;
 
+	CornerPointDetector( const CornerPointDetectorParams& params = CornerPointDetectorParams() );
+
+	/*! \brief Reads runtime parameters from the private handle and follows
+	 * their updates. */
 	CornerPointDetector( ros::NodeHandle& nh, ros::NodeHandle& ph );
 
+	void SetParams( const CornerPointDetectorParams& params );
+	CornerPointDetectorParams GetParams() const;
+
 	/*! \brief Return interest points in a target grayscale image. */
 	virtual InterestPoints FindInterestPoints( const cv::Mat& image );
+	virtual InterestPoints FindInterestPoints( const cv::Mat& image,
+	                                           const cv::Mat& mask );
 
 private:
 
+	mutable Mutex _mutex;
+	CornerPointDetectorParams _params;
+
 	NumericParam _featureMaxPoints;
 	NumericParam _featureMinQuality;
 	NumericParam _featureMinSeparation;
@@ -36,5 +77,8 @@ private:
 	NumericParam _refineZeroDim;
 	NumericParam _refineMaxIters;
 	NumericParam _refineMinLogEps;
+
+	// Copies the runtime parameters into the parameter struct
+	void ReadParams();
 };
 } // end namespace
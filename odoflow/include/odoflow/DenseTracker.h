@@ -0,0 +1,39 @@
+#pragma once
+
+#include <ros/ros.h>
+
+#include <memory>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "argus_utils/geometry/PoseSE2.h"
+
+namespace argus
+{
+/*! \brief Base for classes that align two images using direct
+ * intensity values.
+ */
+class DenseTracker
+{
+public:
+
+	typedef std::shared_ptr<DenseTracker> Ptr;
+
+	DenseTracker() {}
+
+	virtual ~DenseTracker() {}
+
+	/*! \brief Notifies the tracker that levels of this pyramid will be passed
+	 * as the keyframe in subsequent calls, letting it cache per-keyframe data.
+	 * The image data must stay valid while it is the keyframe.
+	 */
+	virtual void SetKeyFrame( const std::vector<cv::Mat>& pyramid ) {}
+
+	/*! \brief Finds a transformation that matches from to to, using pose
+	 * as the initial guess. Returns success.
+	 */
+	virtual bool TrackImages( const cv::Mat& to, const cv::Mat& from,
+	                          PoseSE2& pose ) = 0;
+};
+} // end namespace argus
@@ -1,33 +1,85 @@
 #pragma once
 
-#include <ros/ros.h>
-
-#include <opencv2/core/core.hpp>
+#include "odoflow/DenseTracker.h"
 #include "paraset/ParameterManager.hpp"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
 
-#include "argus_utils/geometry/PoseSE2.h"
+#include <iostream>
 
 namespace argus
 {
+/*! \brief Parameters for ECC dense tracking. */
+struct ECCDenseTrackerParams
+{
+	/*! \brief Log10 minimum solver tolerance. */
+	double logMinEpsilon;
+	unsigned int maxIters;
+	/*! \brief Log10 of 1.0 minus the minimum solution correlation. Negative. */
+	double logMinCorrelation;
+	/*! \brief Ratio of highest-gradient keyframe pixels to use, 1 for all. */
+	double selectionRatio;
+	/*! \brief Side length in pixels of the pixel selection grid cells. */
+	unsigned int selectionCellDim;
+	/*! \brief Minimum gradient magnitude of selected pixels. */
+	double selectionMinGradient;
+
+	ECCDenseTrackerParams();
+};
+std::ostream& operator<<( std::ostream& os, const ECCDenseTrackerParams& params );
+
 /*! \brief Uses OpenCV's findTransformECC to match two images using
-   direct intensity values.
+   direct intensity values. If the selection ratio is less than one, the
+   keyframe is masked to its highest-gradient pixels.
  */
 class ECCDenseTracker
+	: public DenseTracker
 {
 public:
 
+	typedef std::shared_ptr<ECCDenseTracker> Ptr;
+
+	ECCDenseTracker( const ECCDenseTrackerParams& params = ECCDenseTrackerParams() );
+
+	/*! \brief Reads runtime parameters from the private handle and follows
+	 * their updates. */
 	ECCDenseTracker( ros::NodeHandle& nh, ros::NodeHandle& ph );
 
-	/*! \brief Finds a transformation that matches from to to.
-	   Returns success.
-	 */
-	bool TrackImages( const cv::Mat& to, const cv::Mat& from,
-	                  PoseSE2& pose );
+	void SetParams( const ECCDenseTrackerParams& params );
+	ECCDenseTrackerParams GetParams() const;
+
+	virtual void SetKeyFrame( const std::vector<cv::Mat>& pyramid );
+
+	virtual bool TrackImages( const cv::Mat& to, const cv::Mat& from,
+	                          PoseSE2& pose );
 
 private:
 
+	mutable Mutex _paramsMutex;
+	ECCDenseTrackerParams _params;
+
 	NumericParam _logMinEps;
 	NumericParam _maxIters;
 	NumericParam _logMinCorrelation;
+	NumericParam _selectionRatio;
+	NumericParam _selectionCellDim;
+	NumericParam _selectionMinGradient;
+
+	// Semi-dense selection mask for one keyframe level
+	struct LevelMask
+	{
+		cv::Mat image; // Source image, used to identify the level
+		cv::Mat mask;
+		double selectionRatio;
+		unsigned int selectionCellDim;
+		double selectionMinGradient;
+	};
+	std::vector<LevelMask> _masks;
+
+	// Copies the runtime parameters into the parameter struct
+	void ReadParams();
+	cv::Mat GetMask( const cv::Mat& image, const ECCDenseTrackerParams& params );
+	void ComputeMask( const cv::Mat& image, const ECCDenseTrackerParams& params,
+	                  LevelMask& level ) const;
+	bool IsMaskCurrent( const LevelMask& level, const ECCDenseTrackerParams& params ) const;
 };
 }
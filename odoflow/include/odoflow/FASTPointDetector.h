@@ -2,10 +2,29 @@
 
 #include "odoflow/InterestPointDetector.h"
 #include "paraset/ParameterManager.hpp"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+#include <iostream>
 
 namespace argus
 {
+/*! \brief Parameters for FAST interest point detection. */
+struct FASTPointDetectorParams
+{
+	/*! \brief Minimum central pixel intensity difference. */
+	int intensityThreshold;
+	bool enableNMS;
+	/*! \brief Maximum number of points to find. */
+	unsigned int maxNumPoints;
+	/*! \brief One of FAST_5_8, FAST_7_12, or FAST_9_16. */
+	std::string detectorType;
+
+	FASTPointDetectorParams();
+};
+std::ostream& operator<<( std::ostream& os, const FASTPointDetectorParams& params );
+
 /*! \brief FAST interest point detector. Uses OpenCV implementation.
+ * Thread-safe.
  */
 class FASTPointDetector
 	: public InterestPointDetector
@@ -14,17 +33,33 @@ public:
 
 	typedef std::shared_ptr<FASTPointDetector> Ptr;
 
+	FASTPointDetector( const FASTPointDetectorParams& params = FASTPointDetectorParams() );
+
+	/*! \brief Reads runtime parameters from the private handle and follows
+	 * their updates. */
 	FASTPointDetector( ros::NodeHandle& nh, ros::NodeHandle& ph );
 
+	void SetParams( const FASTPointDetectorParams& params );
+	FASTPointDetectorParams GetParams() const;
+
 	virtual InterestPoints FindInterestPoints( const cv::Mat& image );
 
+	/*! \brief Converts a FAST_X_Y name to the OpenCV detector type. Throws
+	 * if the name is invalid. */
+	static int StringToDetector( const std::string& str );
+
 private:
 
+	mutable Mutex _mutex;
+	FASTPointDetectorParams _params;
+	int _type;
+
 	NumericParam _intensityThreshold;
 	BooleanParam _enableNMS;
 	NumericParam _maxNumPoints;
 	StringParam _detectorType;
 
-	static int StringToDetector( const std::string& str );
+	// Copies the runtime parameters into the parameter struct
+	void ReadParams();
 };
 } // end namespace argus
@@ -2,10 +2,23 @@
 
 #include "odoflow/InterestPointDetector.h"
 #include "paraset/ParameterManager.hpp"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+#include <iostream>
 
 namespace argus
 {
-/*! \brief Returns a fixed grid of interest points.
+/*! \brief Parameters for fixed grid interest points. */
+struct FixedPointDetectorParams
+{
+	/*! \brief Interest point grid width and height. */
+	unsigned int gridDim;
+
+	FixedPointDetectorParams();
+};
+std::ostream& operator<<( std::ostream& os, const FixedPointDetectorParams& params );
+
+/*! \brief Returns a fixed grid of interest points. Thread-safe.
  */
 class FixedPointDetector
 	: public InterestPointDetector
@@ -14,8 +27,15 @@ public:
 
 	typedef std::shared_ptr<FixedPointDetector> Ptr;
 
+	FixedPointDetector( const FixedPointDetectorParams& params = FixedPointDetectorParams() );
+
+	/*! \brief Reads runtime parameters from the private handle and follows
+	 * their updates. */
 	FixedPointDetector( ros::NodeHandle& nh, ros::NodeHandle& ph );
 
+	void SetParams( const FixedPointDetectorParams& params );
+	FixedPointDetectorParams GetParams() const;
+
 	/*! \brief Return fixed interest points. Image dimensions
 	 * are used for coordinate  scaling.
 	 */
@@ -31,11 +51,16 @@ private:
 
 	typedef std::pair<unsigned int, unsigned int> GridSize;
 
+	mutable Mutex _mutex;
+	FixedPointDetectorParams _params;
 	GridSize _cachedGridSize;
 	InterestPoints _cachedGrid;
 
 	NumericParam _gridDim;
 
+	// Copies the runtime parameters into the parameter struct
+	void ReadParams();
+	// Recomputes the cached grid if its size changed. Requires the lock.
 	void UpdateInterestPoints();
 };
 } // end namespace argus
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "odoflow/InterestPointDetector.h"
+#include "paraset/ParameterManager.hpp"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+#include <iostream>
+
+namespace argus
+{
+/*! \brief Parameters for grid FAST interest point detection. */
+struct GridPointDetectorParams
+{
+	unsigned int gridRows;
+	unsigned int gridCols;
+	/*! \brief Maximum number of points to keep per cell. */
+	unsigned int pointsPerCell;
+	/*! \brief Initial, minimum, and maximum cell FAST thresholds. */
+	double initialThreshold;
+	double minThreshold;
+	double maxThreshold;
+	/*! \brief Fractional cell threshold change per detection. */
+	double adaptRate;
+	bool enableNMS;
+	/*! \brief One of FAST_5_8, FAST_7_12, or FAST_9_16. */
+	std::string detectorType;
+
+	GridPointDetectorParams();
+};
+std::ostream& operator<<( std::ostream& os, const GridPointDetectorParams& params );
+
+/*! \brief Detects FAST interest points independently in each cell of a
+ * grid so that points are spread across the image. Cells are processed in
+ * parallel, and each keeps at most a fixed number of its strongest points.
+ * Each cell also adapts its own FAST threshold towards finding that many
+ * points, so the point count stays steady between bland and textured scenes.
+ * Thread-safe.
+ */
+class GridPointDetector
+	: public InterestPointDetector
+{
+public:
+
+	typedef std::shared_ptr<GridPointDetector> Ptr;
+
+	GridPointDetector( const GridPointDetectorParams& params = GridPointDetectorParams() );
+
+	/*! \brief Reads runtime parameters from the private handle and follows
+	 * their updates. */
+	GridPointDetector( ros::NodeHandle& nh, ros::NodeHandle& ph );
+
+	void SetParams( const GridPointDetectorParams& params );
+	GridPointDetectorParams GetParams() const;
+
+	virtual InterestPoints FindInterestPoints( const cv::Mat& image );
+	virtual InterestPoints FindInterestPoints( const cv::Mat& image,
+	                                           const cv::Mat& mask );
+
+private:
+
+	mutable Mutex _mutex;
+	GridPointDetectorParams _params;
+	int _type;
+
+	NumericParam _gridRows;
+	NumericParam _gridCols;
+	NumericParam _pointsPerCell;
+	NumericParam _initialThreshold;
+	NumericParam _minThreshold;
+	NumericParam _maxThreshold;
+	NumericParam _adaptRate;
+	BooleanParam _enableNMS;
+	StringParam _detectorType;
+
+	// Copies the runtime parameters into the parameter struct
+	void ReadParams();
+
+	// Current FAST threshold of each cell, in row-major order
+	std::vector<double> _thresholds;
+};
+} // end namespace argus
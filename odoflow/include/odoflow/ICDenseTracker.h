@@ -0,0 +1,67 @@
+#pragma once
+
+#include "odoflow/DenseTracker.h"
+#include "paraset/ParameterManager.hpp"
+
+#include <Eigen/Dense>
+
+namespace argus
+{
+/*! \brief Aligns images with an inverse-compositional Gauss-Newton solver
+ * over SE(2). The keyframe acts as the template, so its gradients,
+ * steepest-descent images and Hessian are computed once per keyframe level
+ * and reused for every tracked frame. Each iteration only warps the
+ * current frame and accumulates the residual.
+ *
+ * If the selection ratio is less than one, only the highest-gradient
+ * template pixels of each grid cell are used, and the current frame is
+ * sampled at just those pixels.
+ */
+class ICDenseTracker
+	: public DenseTracker
+{
+public:
+
+	typedef std::shared_ptr<ICDenseTracker> Ptr;
+
+	ICDenseTracker( ros::NodeHandle& nh, ros::NodeHandle& ph );
+
+	virtual void SetKeyFrame( const std::vector<cv::Mat>& pyramid );
+
+	virtual bool TrackImages( const cv::Mat& to, const cv::Mat& from,
+	                          PoseSE2& pose );
+
+private:
+
+	NumericParam _logMinEps;
+	NumericParam _maxIters;
+	NumericParam _logMinCorrelation;
+	NumericParam _minValidRatio;
+	NumericParam _selectionRatio;
+	NumericParam _selectionCellDim;
+	NumericParam _selectionMinGradient;
+
+	// Precomputed template data for one keyframe level
+	struct LevelCache
+	{
+		cv::Mat image; // Source image, used to identify the level
+		cv::Mat templ; // Single-precision template intensities
+		cv::Mat steepest; // 3-channel steepest-descent images
+		Eigen::Matrix3d hessian;
+		cv::Point2d center; // Rotation center of the warp increment
+
+		// Semi-dense selection, empty if all pixels are used
+		double selectionRatio;
+		unsigned int selectionCellDim;
+		double selectionMinGradient;
+		std::vector<cv::Point> pixels;
+		std::vector<float> pixelTempl;
+		std::vector<cv::Vec3f> pixelSteepest;
+	};
+	std::vector<LevelCache> _levels;
+
+	const LevelCache& GetLevel( const cv::Mat& image );
+	void ComputeLevel( const cv::Mat& image, LevelCache& level ) const;
+	bool IsLevelCurrent( const LevelCache& level ) const;
+};
+}
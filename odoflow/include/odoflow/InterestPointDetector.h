@@ -1,7 +1,5 @@
 #pragma once
 
-#include <ros/ros.h>
-
 #include <memory>
 #include <vector>
 
@@ -20,8 +18,7 @@ public:
 
 	typedef std::shared_ptr<InterestPointDetector> Ptr;
 
-	InterestPointDetector( ros::NodeHandle& nh, ros::NodeHandle& ph )
-		: nodeHandle( nh ), privHandle( ph ) {}
+	InterestPointDetector() {}
 
 	virtual ~InterestPointDetector() {}
 
@@ -29,9 +26,27 @@ public:
 	 */
 	virtual InterestPoints FindInterestPoints( const cv::Mat& image ) = 0;
 
-protected:
-
-	ros::NodeHandle nodeHandle;
-	ros::NodeHandle privHandle;
+	/*! \brief Return interest points in a target image where a same-size
+	 * CV_8U mask is nonzero. By default, filters the unmasked result.
+	 */
+	virtual InterestPoints FindInterestPoints( const cv::Mat& image,
+	                                           const cv::Mat& mask )
+	{
+		InterestPoints points = FindInterestPoints( image );
+		if( mask.empty() ) { return points; }
+
+		InterestPoints masked;
+		masked.reserve( points.size() );
+		for( unsigned int i = 0; i < points.size(); ++i )
+		{
+			cv::Point p( points[i].x, points[i].y );
+			if( p.x >= 0 && p.y >= 0 && p.x < mask.cols && p.y < mask.rows &&
+			    mask.at<uchar>( p ) != 0 )
+			{
+				masked.push_back( points[i] );
+			}
+		}
+		return masked;
+	}
 };
 } // end namespace argus
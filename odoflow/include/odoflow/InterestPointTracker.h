@@ -14,21 +14,25 @@ public:
 
 	typedef std::shared_ptr<InterestPointTracker> Ptr;
 
-	InterestPointTracker( ros::NodeHandle& nh, ros::NodeHandle& ph )
-		: nodeHandle( nh ), privHandle( ph ) {}
+	InterestPointTracker() {}
 
 	virtual ~InterestPointTracker() {}
 
-	/*! \brief Tracks points in first image to second image. If guess
-	 * is empty, firstPoints are used as initialization.
+	/*! \brief Notifies the tracker that key will be passed as the keyframe
+	 * in subsequent calls, letting it cache per-keyframe data. The image data
+	 * must stay valid while it is the keyframe.
+	 */
+	virtual void SetKeyFrame( const cv::Mat& key ) {}
+
+	/*! \brief Tracks points in first image to second image. If tarPoints
+	 * is empty, keyPoints are used as initialization. Both are reduced to the
+	 * successfully tracked points, whose original indices are returned in
+	 * inlierInds.
 	 */
 	virtual bool TrackInterestPoints( const cv::Mat& key,
 	                                  InterestPoints& keyPoints,
 	                                  const cv::Mat& tar,
-	                                  InterestPoints& tarPoints ) = 0;
-protected:
-
-	ros::NodeHandle nodeHandle;
-	ros::NodeHandle privHandle;
+	                                  InterestPoints& tarPoints,
+	                                  std::vector<unsigned int>& inlierInds ) = 0;
 };
 } // end namespace argus
@@ -4,13 +4,36 @@
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "paraset/ParameterManager.hpp"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
 
 #include "odoflow/InterestPointTracker.h"
 
+#include <iostream>
+
 namespace argus
 {
+/*! \brief Parameters for Lucas-Kanade point tracking. */
+struct LKPointTrackerParams
+{
+	/*! \brief Max pyramid level. 0 uses only the full image. */
+	unsigned int pyramidLevel;
+	/*! \brief Search window width and height (pix). At least 3. */
+	unsigned int windowDim;
+	/*! \brief Spatial gradient log10 eigenvalue threshold. */
+	double logEigenThreshold;
+	unsigned int maxIters;
+	/*! \brief Solver log10 min epsilon. */
+	double logMinEpsilon;
+	/*! \brief Max solution error for a point to be tracked. */
+	double maxFlowError;
+
+	LKPointTrackerParams();
+};
+std::ostream& operator<<( std::ostream& os, const LKPointTrackerParams& params );
+
 /*! \brief Finds correspondences in images using the Lucas-Kanade
- * optical flow algorithm.
+ * optical flow algorithm. Caches the keyframe pyramid and the most
+ * recent target pyramid so that each image's pyramid is built once.
  */
 class LKPointTracker
 	: public InterestPointTracker
@@ -19,15 +42,49 @@ public:
 
 	typedef std::shared_ptr<LKPointTracker> Ptr;
 
+	LKPointTracker( const LKPointTrackerParams& params = LKPointTrackerParams() );
+
+	/*! \brief Reads runtime parameters from the private handle and follows
+	 * their updates. */
 	LKPointTracker( ros::NodeHandle& nh, ros::NodeHandle& ph );
 
+	void SetParams( const LKPointTrackerParams& params );
+	LKPointTrackerParams GetParams() const;
+
+	virtual void SetKeyFrame( const cv::Mat& key );
+
 	virtual bool TrackInterestPoints( const cv::Mat& key,
 	                                  InterestPoints& keyPoints,
 	                                  const cv::Mat& tar,
-	                                  InterestPoints& tarPoints );
+	                                  InterestPoints& tarPoints,
+	                                  std::vector<unsigned int>& inlierInds );
 
 private:
 
+	// An image and the LK pyramid built from it with the current parameters
+	struct PyramidCache
+	{
+		cv::Mat image;
+		std::vector<cv::Mat> pyramid;
+		bool hasDerivatives;
+
+		PyramidCache();
+		bool Matches( const cv::Mat& img ) const;
+		void Clear();
+	};
+
+	mutable Mutex _paramsMutex;
+	LKPointTrackerParams _params;
+
+	PyramidCache _keyCache;
+	PyramidCache _tarCache;
+	int _cachedWindowDim;
+	int _cachedPyramidLevel;
+
+	// Per-point solver outputs, reused across calls
+	std::vector<unsigned char> _status;
+	std::vector<float> _errors;
+
 	// Flow calculation parameters
 	NumericParam _pyramidLevel;
 	NumericParam _flowWindowDim;
@@ -36,8 +93,13 @@ private:
 	NumericParam _solverMinLogEpsilon;
 	NumericParam _maxFlowError;
 
-	cv::TermCriteria _flowTermCriteria;
-
-	cv::Size _flowWindowSize;
+	// Copies the runtime parameters into the parameter struct
+	void ReadParams();
+	// Clears the caches if the pyramid parameters changed since they were built
+	void CheckCacheParameters( const LKPointTrackerParams& params );
+	void BuildPyramid( const cv::Mat& image, bool withDerivatives,
+	                   PyramidCache& cache );
+	// Adds Scharr derivative levels to a pyramid built without them
+	void AddDerivatives( PyramidCache& cache );
 };
 } // end namespace argus
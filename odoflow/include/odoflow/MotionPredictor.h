@@ -3,7 +3,8 @@
 #include <ros/ros.h>
 
 #include "extrinsics_array/ExtrinsicsInterface.h"
-#include "argus_utils/geometry/VelocityIntegrator.hpp"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+#include "odoflow/VelocityBuffer.h"
 
 #include <geometry_msgs/TwistStamped.h>
 #include <nav_msgs/Odometry.h>
@@ -11,10 +12,15 @@
 #include "argus_utils/geometry/PoseSE2.h"
 #include "paraset/ParameterManager.hpp"
 
+#include <map>
+
 namespace argus
 {
 /*! \brief Subscribes to odometry/velocity messages to predict the
- * displacement of the camera between two times.
+ * displacement of the camera between two times. Odometry-to-camera
+ * extrinsics are cached per camera frame and refreshed after a TTL or when
+ * the odometry frame changes. Predictions may be requested concurrently from
+ * multiple threads.
  */
 class MotionPredictor
 {
@@ -30,19 +36,42 @@ public:
 	                       const std::string& camFrame,
 	                       double scale );
 
-	/*! \brief Clears all bufferered odometry/velocity messages.
+	/*! \brief Clears all bufferered odometry/velocity messages and cached
+	 * extrinsics.
 	*/
-    void Reset();
+	void Reset();
 
 private:
 
 	void OdometryCallback( const nav_msgs::Odometry::ConstPtr& msg );
 	void TwistStampedCallback( const geometry_msgs::TwistStamped::ConstPtr& msg );
+	void SetOdomFrame( const std::string& frame );
+
+	// Returns the odometry and odometry-to-camera transform, or false if
+	// either is not available
+	bool GetOdomToCamera( const std::string& camFrame, const ros::Time& time,
+	                      std::string& odomFrame, PoseSE3& odomToCam );
+
+	struct CachedExtrinsics
+	{
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+		ros::Time time;
+		PoseSE3 odomToCam;
+	};
+	typedef std::map<std::string, CachedExtrinsics, std::less<std::string>,
+	                 Eigen::aligned_allocator<std::pair<const std::string, CachedExtrinsics> > >
+	ExtrinsicsCache;
 
 	bool _enablePrediction;
 	ros::Subscriber _motionSub;
+	VelocityBuffer _velBuffer;
+
+	// Guards the odometry frame and extrinsics cache
+	Mutex _mutex;
 	std::string _odomFrame;
-	VelocityIntegratorSE3 _velIntegrator;
+	ExtrinsicsCache _extrinsicsCache;
+	double _extrinsicsTtl;
 	ExtrinsicsInterface _extrinsics;
 
 	NumericParam _maxPredictEntropy;    
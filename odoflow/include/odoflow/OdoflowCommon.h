@@ -5,23 +5,52 @@
 #include "argus_utils/geometry/PoseSE2.h"
 #include "camplex/CameraCalibration.h"
 
+#include <cassert>
+
 namespace argus
 {
+class PointTransformTable;
 
-/*! \brief Typedef for describing a collection of image points.
+/*! \brief Typedef for describing a collection of image points. Single
+ * precision, as consumed by the OpenCV trackers and estimators.
 */
-typedef cv::Point2d InterestPoint;
+typedef cv::Point2f InterestPoint;
 typedef std::vector<InterestPoint> InterestPoints;
 
-typedef cv::Point2f InterestPointf;
-typedef std::vector<InterestPointf> InterestPointsf;
-
 /*! \brief Convenience method for printing a collection of image points. 
 */
 std::ostream& operator<<( std::ostream& os, const InterestPoints& points );
 
-InterestPointsf DowncastInterestPoints( const InterestPoints& in );
-InterestPoints UpcastInterestPoints( const InterestPointsf& in );
+/*! \brief Keeps the values whose mask entries are nonzero, in order and in
+ * place. The mask must be at least as long as the values.
+ */
+template <typename T>
+void CompactByMask( std::vector<T>& values, const std::vector<unsigned char>& mask )
+{
+	size_t n = 0;
+	for( size_t i = 0; i < values.size(); ++i )
+	{
+		if( !mask[i] ) { continue; }
+		if( n != i ) { values[n] = values[i]; }
+		++n;
+	}
+	values.erase( values.begin() + n, values.end() );
+}
+
+/*! \brief Keeps the values at strictly ascending indices, in place. The
+ * indices must be valid for the values.
+ */
+template <typename T>
+void CompactByIndices( std::vector<T>& values, const std::vector<unsigned int>& inds )
+{
+	assert( inds.size() <= values.size() );
+	assert( inds.empty() || inds.back() < values.size() );
+	for( size_t i = 0; i < inds.size(); ++i )
+	{
+		if( inds[i] != i ) { values[i] = values[inds[i]]; }
+	}
+	values.erase( values.begin() + inds.size(), values.end() );
+}
 
 // TODO Move into a utils package for open cv? Shared functionality with fiducials package
 
@@ -56,8 +85,58 @@ InterestPoints UnnormalizePoints( const InterestPoints& points,
 InterestPoints DistortAndUnnormalizePoints( const InterestPoints& points,
                                             const CameraCalibration& model );
 
+/*! \brief Overloads that use a lookup table when it is given and was
+ * built for the calibration, and the exact transforms otherwise. The
+ * output overloads reuse the storage of out, which must not be points.
+ */
+InterestPoints UndistortPoints( const InterestPoints& points,
+                                const CameraCalibration& model,
+                                const PointTransformTable* table );
+InterestPoints UndistortAndNormalizePoints( const InterestPoints& points,
+                                            const CameraCalibration& model,
+                                            const PointTransformTable* table );
+InterestPoints DistortAndUnnormalizePoints( const InterestPoints& points,
+                                            const CameraCalibration& model,
+                                            const PointTransformTable* table );
+void UndistortPoints( const InterestPoints& points,
+                      const CameraCalibration& model,
+                      const PointTransformTable* table,
+                      InterestPoints& out );
+void DistortAndUnnormalizePoints( const InterestPoints& points,
+                                  const CameraCalibration& model,
+                                  const PointTransformTable* table,
+                                  InterestPoints& out );
+
+/*! \brief Normalizes points from pixel coordinates to the unit plane without
+ * undistortion. out may be points.
+ */
+void NormalizePoints( const InterestPoints& points,
+                      const CameraCalibration& model,
+                      InterestPoints& out );
+
 /*! \brief Applies a transform to image points.
  */
 InterestPoints TransformPoints( const InterestPoints& points,
                                 const PoseSE2& trans );
+/*! \brief Applies a transform to image points, reusing the storage of out,
+ * which may be points.
+ */
+void TransformPoints( const InterestPoints& points,
+                      const PoseSE2& trans,
+                      InterestPoints& out );
+
+/*! \brief Selects high-gradient pixels for semi-dense alignment. The image
+ * is divided into cells of cellDim pixels, and each cell contributes at most
+ * ratio of its pixels with the largest gradient magnitude above minGradient.
+ */
+void SelectGradientPixels( const cv::Mat& image,
+                           unsigned int cellDim,
+                           double ratio,
+                           double minGradient,
+                           std::vector<cv::Point>& pixels );
+
+/*! \brief Returns a CV_8U mask of the specified size with the pixels set.
+ */
+cv::Mat PixelsToMask( const std::vector<cv::Point>& pixels,
+                      const cv::Size& size );
 }
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "odoflow/OdoflowCommon.h"
+
+#include <memory>
+
+namespace argus
+{
+/*! \brief Lookup tables that map pixel coordinates to undistorted unit plane
+ * coordinates and back for one calibration. Each direction samples the exact
+ * transform on a regular grid once at construction, and evaluates points by
+ * bilinear interpolation. Points outside a table's domain fall back to the
+ * exact transform. The tables are immutable, so they can be shared across
+ * threads.
+ */
+class PointTransformTable
+{
+public:
+
+	typedef std::shared_ptr<PointTransformTable> Ptr;
+
+	/*! \brief Builds tables with nodes every cellDim pixels over the scaled
+	 * image of the calibration. */
+	PointTransformTable( const CameraCalibration& model, unsigned int cellDim );
+
+	/*! \brief Returns whether the tables were built for this calibration. */
+	bool Matches( const CameraCalibration& model ) const;
+
+	const CameraCalibration& GetCalibration() const;
+
+	/*! \brief Batch evaluation over single-precision SoA arrays. Sets valid[i]
+	 * to zero for points outside the table domain, whose outputs are undefined.
+	 */
+	void UndistortAndNormalize( const float* x, const float* y,
+	                            float* u, float* v,
+	                            unsigned char* valid, size_t n ) const;
+	void DistortAndUnnormalize( const float* x, const float* y,
+	                            float* u, float* v,
+	                            unsigned char* valid, size_t n ) const;
+
+	InterestPoints UndistortAndNormalize( const InterestPoints& points ) const;
+	InterestPoints DistortAndUnnormalize( const InterestPoints& points ) const;
+
+	/*! \brief Point overloads that reuse the storage of out, which must not
+	 * be points. Only points outside the domain allocate. */
+	void UndistortAndNormalize( const InterestPoints& points, InterestPoints& out ) const;
+	void DistortAndUnnormalize( const InterestPoints& points, InterestPoints& out ) const;
+
+private:
+
+	// Regularly-spaced samples of a 2D function
+	struct Grid
+	{
+		float originX;
+		float originY;
+		float invStep;
+		int cols; // Number of nodes along x
+		int rows; // Number of nodes along y
+		std::vector<float> outX;
+		std::vector<float> outY;
+
+		void Evaluate( const float* x, const float* y,
+		               float* u, float* v,
+		               unsigned char* valid, size_t n ) const;
+
+		// Evaluates one point, returning whether it is inside the domain
+		inline bool EvaluatePoint( float x, float y, float& u, float& v ) const;
+	};
+
+	CameraCalibration _model;
+	Grid _undistort;
+	Grid _distort;
+
+	typedef InterestPoints (*ExactTransform)( const InterestPoints&,
+	                                          const CameraCalibration& );
+	void Transform( const Grid& grid, ExactTransform exact,
+	                const InterestPoints& points, InterestPoints& out ) const;
+};
+}
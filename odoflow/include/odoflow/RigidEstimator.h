@@ -2,11 +2,38 @@
 
 #include "odoflow/OdoflowCommon.h"
 #include "paraset/ParameterManager.hpp"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+#include <Eigen/Dense>
+#include <iostream>
+#include <random>
 
 namespace argus
 {
+/*! \brief Parameters for RANSAC rigid motion estimation. */
+struct RigidEstimatorParams
+{
+	enum Method
+	{
+		METHOD_HOMOGRAPHY = 0,
+		METHOD_TWO_POINT
+	};
+
+	Method method;
+	/*! \brief Log10 reprojection inlier threshold. */
+	double logReprojThreshold;
+	unsigned int maxIters;
+	/*! \brief Two-point termination confidence in (0, 1). */
+	double confidence;
+
+	RigidEstimatorParams();
+};
+std::ostream& operator<<( std::ostream& os, const RigidEstimatorParams& params );
+
 /*! \brief Estimates a 2D rigid transformation with RANSAC outlier
- * rejection.
+ * rejection. Hypotheses are either full homographies from 4-point
+ * samples or closed-form rigid motions from 2-point samples, selected
+ * by the method parameter. Parameters are thread-safe, but estimation is not.
  */
 class RigidEstimator
 {
@@ -14,8 +41,18 @@ public:
 
 	typedef std::shared_ptr<RigidEstimator> Ptr;
 
+	RigidEstimator( const RigidEstimatorParams& params = RigidEstimatorParams() );
+
+	/*! \brief Reads the method and runtime parameters from the private handle
+	 * and follows their updates. */
 	RigidEstimator( ros::NodeHandle& nh, ros::NodeHandle& ph );
 
+	void SetParams( const RigidEstimatorParams& params );
+	RigidEstimatorParams GetParams() const;
+
+	/*! \brief Parses homography or two_point. */
+	static RigidEstimatorParams::Method StringToMethod( const std::string& str );
+
 	/*! \brief Finds a transformation that takes tar points to key
 	 * points. Returns success and a list of inlier point indices.
 	 */
@@ -24,9 +61,66 @@ public:
 	                     std::vector<unsigned int>& inlierInds,
 	                     PoseSE2& transform );
 
+	/*! \brief Returns the number of RANSAC hypotheses tried by the last
+	 * estimate, or 0 if unknown. The homography method always returns 0,
+	 * since OpenCV does not report the count.
+	 */
+	unsigned int GetLastNumIterations() const;
+
 private:
 
+	mutable Mutex _mutex;
+	RigidEstimatorParams _params;
+
 	NumericParam _logReprojThreshold;
 	NumericParam _maxIters;
+	NumericParam _confidence;
+
+	// Copies the runtime parameters into the parameter struct
+	void ReadParams();
+
+	std::mt19937 _generator;
+
+	unsigned int _lastNumIterations;
+
+	// Inlier masks, reused across estimates
+	std::vector<unsigned char> _inliers;
+	std::vector<unsigned char> _bestInliers;
+
+	// Contiguous x and y coordinates and residuals for batch scoring, reused
+	// across estimates
+	std::vector<float> _keyX;
+	std::vector<float> _keyY;
+	std::vector<float> _tarX;
+	std::vector<float> _tarY;
+	std::vector<float> _residualsSq;
+
+	bool EstimateHomography( const RigidEstimatorParams& params,
+	                         InterestPoints& key,
+	                         InterestPoints& tar,
+	                         std::vector<unsigned int>& inlierInds,
+	                         Eigen::Matrix2d& R,
+	                         Eigen::Vector2d& t );
+
+	bool EstimateTwoPoint( const RigidEstimatorParams& params,
+	                       InterestPoints& key,
+	                       InterestPoints& tar,
+	                       std::vector<unsigned int>& inlierInds,
+	                       Eigen::Matrix2d& R,
+	                       Eigen::Vector2d& t );
+
+	// Marks correspondences with squared residual below thresh, returning the
+	// count. Scores all split points at once as column-wise array operations.
+	unsigned int ScoreInliers( const Eigen::Matrix2d& R,
+	                           const Eigen::Vector2d& t,
+	                           double threshSq,
+	                           std::vector<unsigned char>& inliers );
+
+	// Least-squares rigid fit of tar to key over the selected points
+	static bool FitRigid( const InterestPoints& key,
+	                      const InterestPoints& tar,
+	                      const std::vector<unsigned char>& inliers,
+	                      Eigen::Matrix2d& R,
+	                      Eigen::Vector2d& t );
 };
 }
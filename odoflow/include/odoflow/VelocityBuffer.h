@@ -0,0 +1,60 @@
+#pragma once
+
+#include "argus_utils/geometry/PoseSE3.h"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+
+#include <vector>
+
+namespace argus
+{
+/*! \brief A fixed-capacity ring buffer of timestamped velocities that
+ * integrates displacements over time ranges. Velocities are held constant
+ * until the next sample. Samples must be buffered in time order, and the
+ * oldest samples are overwritten when the buffer is full. Range lookups are
+ * binary searches. Thread-safe, with integrations running concurrently.
+ */
+class VelocityBuffer
+{
+public:
+
+	VelocityBuffer( unsigned int capacity = 200 );
+
+	/*! \brief Clears the buffer and sets a new capacity. */
+	void SetCapacity( unsigned int capacity );
+
+	/*! \brief Buffers a sample. Returns false and ignores it if it is older
+	 * than the newest buffered sample. */
+	bool BufferInfo( double time,
+	                 const PoseSE3::TangentVector& vel,
+	                 const PoseSE3::CovarianceMatrix& cov );
+
+	/*! \brief Integrates the displacement and its covariance from fromTime to
+	 * toTime. Returns false if the buffer does not start by fromTime. The last
+	 * velocity is held past the newest sample. */
+	bool Integrate( double fromTime, double toTime,
+	                PoseSE3& disp, PoseSE3::CovarianceMatrix& cov ) const;
+
+	void Reset();
+
+	size_t Size() const;
+
+private:
+
+	struct Sample
+	{
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+		double time;
+		PoseSE3::TangentVector vel;
+		PoseSE3::CovarianceMatrix cov;
+	};
+
+	mutable Mutex _mutex;
+	std::vector<Sample, Eigen::aligned_allocator<Sample> > _samples;
+	size_t _start; // Index of the oldest sample
+	size_t _size;
+
+	// Returns the i-th oldest sample
+	const Sample& At( size_t i ) const;
+};
+}
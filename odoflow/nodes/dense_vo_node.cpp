@@ -4,16 +4,25 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <geometry_msgs/TwistStamped.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <nav_msgs/Odometry.h>
 
 #include "odoflow/ECCDenseTracker.h"
+#include "odoflow/ICDenseTracker.h"
 #include "odoflow/MotionPredictor.h"
 #include "odoflow/VelocityPublisher.h"
 
 #include "argus_utils/geometry/GeometryUtils.h"
 #include "argus_utils/utils/ParamUtils.h"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+#include "argus_utils/synchronization/WorkerPool.h"
 #include "paraset/ParameterManager.hpp"
+#include "camplex/BackgroundRenderer.h"
 #include "camplex/FiducialCommon.h"
+#include "camplex/LatestFrameMailbox.hpp"
+#include "camplex/PipelineProfiler.h"
+
+#include <sstream>
 
 using namespace argus;
 
@@ -22,9 +31,11 @@ class DenseVONode
 public:
 
 	DenseVONode( ros::NodeHandle& nh, ros::NodeHandle& ph )
-		: _imageTrans( nh ), _tracker( nh, ph ),
-		_predictor( nh, ph ), _velPub( nh, ph )
+		: _imageTrans( nh ), _lastQuality( TRACKING_FULL ), _predictor( nh, ph ),
+		_velPub( nh, ph )
 	{
+		InitializeTracker( nh, ph );
+
 		// Initialize all runtime parameters
 		_pyramidDepth.InitializeAndRead( ph, 0, "pyramid_depth",
 		                                 "Number of image pyramids" );
@@ -41,8 +52,38 @@ public:
 		                                     "Minimum raw intensity variance across image" );
 		_minPixelVariance.AddCheck<GreaterThanOrEqual>( 0.0 );
 
+		_levelMaxDisplacement.InitializeAndRead( ph, 0.0, "level_max_displacement",
+		                                         "Predicted displacement in pixels each pyramid level can recover. 0 starts at the deepest level." );
+		_levelMaxDisplacement.AddCheck<GreaterThanOrEqual>( 0.0 );
+
+		_convergenceThreshold.InitializeAndRead( ph, 0.0, "convergence_threshold",
+		                                         "Full resolution pixel update below which finer levels are skipped. 0 disables." );
+		_convergenceThreshold.AddCheck<GreaterThanOrEqual>( 0.0 );
+
+		_timeBudget.InitializeAndRead( ph, 0.0, "time_budget",
+		                               "Per-frame processing time in seconds after which no finer levels are aligned. 0 disables." );
+		_timeBudget.AddCheck<GreaterThanOrEqual>( 0.0 );
+
 		GetParamRequired( ph, "scale", _scale );
 
+		// Stage timings and counters are only recorded if they are published
+		double statsPeriod;
+		GetParam( ph, "stats_period", statsPeriod, 10.0 );
+		_profiler.SetEnabled( statsPeriod > 0 );
+		if( statsPeriod > 0 )
+		{
+			_diagPub = nh.advertise<diagnostic_msgs::DiagnosticArray>( "diagnostics", 10 );
+			_statsTimer = nh.createTimer( ros::Duration( statsPeriod ),
+			                              &DenseVONode::StatsCallback,
+			                              this );
+		}
+
+		// Frames are aligned on a separate thread that always takes the newest
+		// frame, so that the output stays fresh when alignment is slow
+		_processWorker.SetNumWorkers( 1 );
+		_processWorker.EnqueueJob( boost::bind( &DenseVONode::ProcessSpin, this ) );
+		_processWorker.StartWorkers();
+
 		unsigned int buffSize;
 		GetParam<unsigned int>( ph, "buffer_size", buffSize, 2 );
 		_imageSub = _imageTrans.subscribe( "image",
@@ -57,9 +98,19 @@ public:
 			ROS_INFO_STREAM( "Displaying debug output on topic" << debugTopicName );
 			_debugPub = _imageTrans.advertise( "image_debug", 1 );
 			GetParam( ph, "vis_arrow_scale", _visArrowScale, 1.0 );
+
+			// Debug images are drawn off the processing thread, only when watched
+			double debugRate;
+			GetParam( ph, "debug_rate", debugRate, 10.0 );
+			_renderer = std::make_shared<BackgroundRenderer>( debugRate );
 		}
 	}
 
+	~DenseVONode()
+	{
+		_mailbox.Close();
+	}
+
 private:
 
 	image_transport::ImageTransport _imageTrans;
@@ -68,9 +119,33 @@ private:
 	bool _debug;
 	image_transport::Publisher _debugPub;
 	double _visArrowScale;
+	std::shared_ptr<BackgroundRenderer> _renderer;
+
+	// How completely a frame was aligned
+	enum TrackingQuality
+	{
+		TRACKING_FULL = 0, // Aligned down to the full resolution level
+		TRACKING_CONVERGED, // Stopped at a coarser level after converging
+		TRACKING_OVER_BUDGET // Stopped at a coarser level when out of time
+	};
+
+	// Copy of the state drawn by Visualize, taken on the processing thread
+	struct DebugSnapshot
+	{
+		cv_bridge::CvImageConstPtr keySource; // Keep image data alive
+		cv_bridge::CvImageConstPtr currentSource;
+		cv::Mat key;
+		cv::Mat current;
+		PoseSE2 currToKey;
+		PoseSE2::TangentVector vel;
+		TrackingQuality quality;
+		ros::Time time;
+		std::string frameId;
+	};
 
 	struct FrameInfo
 	{
+		cv_bridge::CvImageConstPtr image; // Keeps pyramid base data alive
 		std::vector<cv::Mat> pyramid;
 		ros::Time time;
 		std::string frameId;
@@ -81,19 +156,52 @@ private:
 	FrameInfo _keyFrame;
 	FrameInfo _lastFrame;
 	PoseSE2 _lastToKey;
+	ros::WallTime _frameStart; // When processing of the current frame began
+	TrackingQuality _lastQuality;
 
 	double _scale;
 	NumericParam _pyramidDepth;
 	NumericParam _maxDisplacement;
 	NumericParam _minPixelVariance;
+	NumericParam _levelMaxDisplacement;
+	NumericParam _convergenceThreshold;
+	NumericParam _timeBudget;
 
-	ECCDenseTracker _tracker;
+	DenseTracker::Ptr _tracker;
 	MotionPredictor _predictor;
 	VelocityPublisher _velPub;
 
+	PipelineProfiler _profiler;
+	ros::Publisher _diagPub;
+	ros::Timer _statsTimer;
+	std::vector<std::string> _levelStageNames; // Only used by the process thread
+
+	LatestFrameMailbox<FrameInfo> _mailbox;
+	WorkerPool _processWorker; // Declared after the state it uses
+
+	void InitializeTracker( ros::NodeHandle& nh, ros::NodeHandle& ph )
+	{
+		std::string trackerType;
+		GetParam<std::string>( ph, "tracker_type", trackerType, "ecc" );
+		if( trackerType == "ecc" )
+		{
+			ROS_INFO_STREAM( "Initializing ECC dense tracker" );
+			_tracker = std::make_shared<ECCDenseTracker>( nh, ph );
+		}
+		else if( trackerType == "inverse_compositional" )
+		{
+			ROS_INFO_STREAM( "Initializing inverse-compositional dense tracker" );
+			_tracker = std::make_shared<ICDenseTracker>( nh, ph );
+		}
+		else
+		{
+			throw std::invalid_argument( "Invalid dense tracker type: " + trackerType );
+		}
+	}
 
 	void ImageCallback( const sensor_msgs::ImageConstPtr& msg )
 	{
+		PipelineProfiler::ScopedTimer timer( _profiler, "conversion" );
 		cv_bridge::CvImageConstPtr frame;
 		try
 		{
@@ -105,27 +213,67 @@ private:
 			return;
 		}
 
-		// Check for image having too little variation
-		if( !HasEnoughVariance( frame->image ) ) { return; }
-
 		FrameInfo current;
 		current.time = msg->header.stamp;
 		current.frameId = msg->header.frame_id;
-		CreatePyramid( frame->image, current.pyramid, (unsigned int) _pyramidDepth );
-		ProcessFrame( current );
+		current.image = frame;
+		_mailbox.Post( current );
+	}
+
+	void ProcessSpin()
+	{
+		FrameInfo current;
+		unsigned int skipped;
+		while( _mailbox.WaitTake( current, skipped ) )
+		{
+			_profiler.Increment( "skipped_frames", skipped );
+
+			// Check for image having too little variation
+			if( !HasEnoughVariance( current.image->image ) )
+			{
+				_profiler.Increment( "low_variance_frames" );
+				continue;
+			}
+
+			PipelineProfiler::ScopedTimer timer( _profiler, "process" );
+			_frameStart = ros::WallTime::now();
+			{
+				PipelineProfiler::ScopedTimer pyramidTimer( _profiler, "pyramid" );
+				CreatePyramid( current.image->image, current.pyramid,
+				               (unsigned int) _pyramidDepth );
+			}
+			ProcessFrame( current );
+			timer.Stop();
+
+			_profiler.Increment( "frames" );
+			if( _profiler.IsEnabled() )
+			{
+				_profiler.AddTiming( "latency", ( ros::Time::now() - current.time ).toSec() );
+			}
+		}
+	}
+
+	void StatsCallback( const ros::TimerEvent& event )
+	{
+		diagnostic_msgs::DiagnosticArray msg;
+		msg.header.stamp = event.current_real;
+		msg.status.push_back( _profiler.Report( ros::this_node::getName() ) );
+		_diagPub.publish( msg );
 	}
 
 	void ProcessFrame( FrameInfo& current )
 	{
 		// If initialization and validation fails, reset keyframe
 		PoseSE2 currToKey;
+		_lastQuality = TRACKING_FULL;
 		if( !CheckInitialization( current ) ||
 		    !PredictMotion( current, currToKey ) ||
-		    !PerformTracking( current, currToKey ) )
+		    !PerformTracking( current, currToKey, _lastQuality ) )
 		{
 			if( !_lastFrame.pyramid.empty() )
 			{
 				ROS_INFO_STREAM( "Retrying tracking with previous frame as keyframe" );
+				_profiler.Increment( "retries" );
 				SetKeyframe( _lastFrame );
 				_lastFrame.pyramid.clear();
 				ProcessFrame( current );
@@ -133,6 +281,7 @@ private:
 			else
 			{
 				ROS_INFO_STREAM( "No previous frame, setting current to keyframe and bailing" );
+				_profiler.Increment( "keyframe_resets" );
 				SetKeyframe( current );
 			}
 		}
@@ -145,14 +294,25 @@ private:
 			double scale = _scale / imgWidth;
 			_velPub.ReportPose( current.time, current.frameId, currToKey3, scale );
 			_lastToKey = currToKey;
+			_lastFrame = current;
 		}
 
-		if( _debug )
+		if( _debug && !_keyFrame.pyramid.empty() &&
+		    _renderer->ShouldRender( "", _debugPub.getNumSubscribers() ) )
 		{
 			const PoseSE3::TangentVector& vel3 = _velPub.GetLastVelocity();
-			PoseSE2::TangentVector vel;
-			vel << vel3( 0 ), vel3( 1 ), vel3( 0 );
-			Visualize( current, currToKey, vel );
+			DebugSnapshot snap;
+			snap.keySource = _keyFrame.image;
+			snap.currentSource = current.image;
+			snap.key = _keyFrame.pyramid[0];
+			snap.current = current.pyramid[0];
+			snap.currToKey = currToKey;
+			snap.vel << vel3( 0 ), vel3( 1 ), vel3( 0 );
+			snap.quality = _lastQuality;
+			snap.time = current.time;
+			snap.frameId = current.frameId;
+			BackgroundRenderer::Job job = boost::bind( &DenseVONode::Visualize, this, snap );
+			_renderer->Submit( "", job );
 		}
 	}
 
@@ -184,17 +344,16 @@ private:
 	void SetKeyframe( FrameInfo& current )
 	{
 		_keyFrame = current;
+		_tracker->SetKeyFrame( _keyFrame.pyramid );
 		_lastFrame.pyramid.clear();
 		_velPub.Reset( current.time );
 		_lastToKey = PoseSE2();
 	}
 
-	void Visualize( FrameInfo& current, PoseSE2& pose,
-	                PoseSE2::TangentVector& vel )
+	// Draws a snapshot on the render thread
+	void Visualize( const DebugSnapshot& snap )
 	{
-		if( _keyFrame.pyramid.empty() ) { return; }
-
-		const cv::Mat& key = _keyFrame.pyramid[0];
+		const cv::Mat& key = snap.key;
 		unsigned int width = key.cols;
 		unsigned int height = key.rows;
 
@@ -203,14 +362,14 @@ private:
 		cv::Mat visLeft( visImage, cv::Rect( 0, 0, width, height ) );
 		cv::Mat visRight( visImage, cv::Rect( width, 0, width, height ) );
 		cv::cvtColor( key, visLeft, cv::COLOR_GRAY2BGR );
-		cv::cvtColor( current.pyramid[0], visRight, cv::COLOR_GRAY2BGR );
+		cv::cvtColor( snap.current, visRight, cv::COLOR_GRAY2BGR );
 
 		// Show current frame extents on keyframe
 		FixedMatrixType<3, 4> corners;
 		corners << 1, 1, width - 1, width - 1,
 		1, height - 1, height - 1, 1,
 		1, 1, 1, 1;
-		FixedMatrixType<2, 4> warped = (pose.ToMatrix() * corners).colwise().hnormalized();
+		FixedMatrixType<2, 4> warped = (snap.currToKey.ToMatrix() * corners).colwise().hnormalized();
 
 		std::vector<cv::Point2f> cornerPoints;
 		for( unsigned int i = 0; i < 4; ++i )
@@ -224,12 +383,20 @@ private:
 
 		// Show velocity arrow
 		cv::Point2f center( height / 2, width / 2 );
-		cv::Point2f arrowEnd = cv::Point2f( vel[0], vel[1] ) * _visArrowScale;
+		cv::Point2f arrowEnd = cv::Point2f( snap.vel[0], snap.vel[1] ) * _visArrowScale;
 		cv::arrowedLine( visRight, center, arrowEnd + center, cv::Scalar( 0, 255, 0 ) );
 
+		// Flag frames that were not aligned at full resolution
+		if( snap.quality != TRACKING_FULL )
+		{
+			std::string text = snap.quality == TRACKING_CONVERGED ? "converged" : "over budget";
+			cv::putText( visRight, text, cv::Point( 5, 15 ), cv::FONT_HERSHEY_SIMPLEX,
+			             0.5, cv::Scalar( 0, 255, 255 ) );
+		}
+
 		std_msgs::Header header;
-		header.stamp = current.time;
-		header.frame_id = current.frameId;
+		header.stamp = snap.time;
+		header.frame_id = snap.frameId;
 		cv_bridge::CvImage vimg( header, "bgr8", visImage );
 		_debugPub.publish( vimg.toImageMsg() );
 	}
@@ -267,6 +434,7 @@ private:
 
 	bool PredictMotion( FrameInfo& current, PoseSE2& currToKey )
 	{
+		PipelineProfiler::ScopedTimer timer( _profiler, "prediction" );
 		double predScale = _keyFrame.pyramid[0].size().width / _scale;
 		PoseSE2 disp = _predictor.PredictMotion( _lastFrame.time,
 		                                         current.time,
@@ -284,35 +452,105 @@ private:
 		{
 			ROS_INFO_STREAM( "Predicted displacement " << r <<
 			                 " larger than allowed " << maxR );
+			_profiler.Increment( "prediction_rejections" );
 			return false;
 		}
 		return true;
 	}
 
-	bool PerformTracking( FrameInfo& current, PoseSE2& currToKey )
+	// Returns the timing stage name of a level, built only once per level
+	const std::string& LevelStageName( unsigned int level )
+	{
+		while( _levelStageNames.size() <= level )
+		{
+			std::stringstream ss;
+			ss << "tracking_level_" << _levelStageNames.size();
+			_levelStageNames.push_back( ss.str() );
+		}
+		return _levelStageNames[level];
+	}
+
+	// Returns the coarsest level needed to recover a full resolution displacement
+	unsigned int SelectStartLevel( const PoseSE2& currToKey, unsigned int depth )
+	{
+		double levelMax = _levelMaxDisplacement;
+		if( levelMax <= 0 ) { return depth; }
+
+		FixedVectorType<3> ctkVec = currToKey.ToVector();
+		double r = std::sqrt( ctkVec( 0 ) * ctkVec( 0 ) + ctkVec( 1 ) * ctkVec( 1 ) );
+		unsigned int level = 0;
+		while( level < depth && r > levelMax )
+		{
+			r *= 0.5;
+			++level;
+		}
+		return level;
+	}
+
+	// Aligns coarse to fine from a level chosen by the predicted displacement.
+	// Finer levels are skipped once an update falls below the convergence
+	// threshold or the frame's time budget is used up, in which case the
+	// coarser estimate is returned with the quality flag set.
+	bool PerformTracking( FrameInfo& current, PoseSE2& currToKey,
+	                      TrackingQuality& quality )
 	{
-		PoseSE2::TangentVector logPose = PoseSE2::Log( currToKey );
 		unsigned int depth = current.pyramid.size() - 1;
-		logPose.head<2>() = logPose.head<2>() / std::pow( 2, depth );
+		unsigned int start = SelectStartLevel( currToKey, depth );
+		_profiler.Increment( "skipped_coarse_levels", depth - start );
+
+		PoseSE2::TangentVector logPose = PoseSE2::Log( currToKey );
+		logPose.head<2>() = logPose.head<2>() / std::pow( 2, start );
 
-		for( int i = depth; i >= 0; --i )
+		const double convergenceThreshold = _convergenceThreshold;
+		const double timeBudget = _timeBudget;
+		quality = TRACKING_FULL;
+		int i = start;
+		for( ; i >= 0; --i )
 		{
 			currToKey = PoseSE2::Exp( logPose );
 
 			const cv::Mat& currImg = current.pyramid[i];
 			const cv::Mat& prevImg = _keyFrame.pyramid[i];
 
-			if( !_tracker.TrackImages( prevImg, currImg, currToKey ) )
+			PipelineProfiler::ScopedTimer timer( _profiler, LevelStageName( i ).c_str() );
+			if( !_tracker->TrackImages( prevImg, currImg, currToKey ) )
 			{
+				_profiler.Increment( "tracking_failures" );
 				return false;
 			}
+			timer.Stop();
 			// ROS_INFO_STREAM( "Depth: " << i << " found disp: " << currToKey );
-			// Next level will be twice as much resolution, so we double the translation prediction
-			if( i > 0 )
+			if( i == 0 ) { break; }
+
+			// Measure this level's update in full resolution pixels
+			PoseSE2::TangentVector solved = PoseSE2::Log( currToKey );
+			double update = ( solved.head<2>() - logPose.head<2>() ).norm() * std::pow( 2, i );
+			if( convergenceThreshold > 0 && update < convergenceThreshold )
 			{
-				logPose = PoseSE2::Log( currToKey );
-				logPose.head<2>() *= 2;
+				quality = TRACKING_CONVERGED;
+				_profiler.Increment( "early_exits" );
+				break;
 			}
+			if( timeBudget > 0 &&
+			    ( ros::WallTime::now() - _frameStart ).toSec() > timeBudget )
+			{
+				quality = TRACKING_OVER_BUDGET;
+				_profiler.Increment( "budget_exits" );
+				break;
+			}
+
+			// Next level will be twice as much resolution, so we double the translation prediction
+			logPose = solved;
+			logPose.head<2>() *= 2;
+		}
+
+		// Bring an estimate from a coarser level up to full resolution
+		if( i > 0 )
+		{
+			logPose = PoseSE2::Log( currToKey );
+			logPose.head<2>() *= std::pow( 2, i );
+			currToKey = PoseSE2::Exp( logPose );
+			_profiler.Increment( "skipped_fine_levels", i );
 		}
 		return true;
 	}
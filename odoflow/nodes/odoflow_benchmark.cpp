@@ -0,0 +1,707 @@
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/Image.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "odoflow/CornerPointDetector.h"
+#include "odoflow/ECCDenseTracker.h"
+#include "odoflow/FASTPointDetector.h"
+#include "odoflow/FixedPointDetector.h"
+#include "odoflow/GridPointDetector.h"
+#include "odoflow/LKPointTracker.h"
+#include "odoflow/RigidEstimator.h"
+
+#include "argus_utils/utils/ParamUtils.h"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+#include "argus_utils/synchronization/WorkerPool.h"
+
+#include "camplex/FiducialCommon.h"
+#include "camplex/PipelineProfiler.h"
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace argus;
+
+struct Frame
+{
+	double time;
+	cv::Mat image;
+};
+typedef std::vector<Frame> Sequence;
+
+typedef std::pair<double, PoseSE3> StampedPose;
+typedef std::vector<StampedPose, Eigen::aligned_allocator<StampedPose> > Trajectory;
+
+static bool compare_frames( const Frame& a, const Frame& b )
+{
+	return a.time < b.time;
+}
+
+static bool compare_poses( const StampedPose& a, const StampedPose& b )
+{
+	return a.first < b.first;
+}
+
+// Loads all images in a directory in filename order. Files named by their
+// timestamp in seconds use it, and the rest are spaced by the frame rate.
+static void load_directory( const std::string& dir, double frameRate, Sequence& seq )
+{
+	std::vector<cv::String> files;
+	cv::glob( dir + "/*", files, false );
+	std::sort( files.begin(), files.end() );
+
+	BOOST_FOREACH( const cv::String& file, files )
+	{
+		Frame frame;
+		frame.image = cv::imread( file, cv::IMREAD_GRAYSCALE );
+		if( frame.image.empty() ) { continue; }
+
+		std::string name = file.substr( file.find_last_of( '/' ) + 1 );
+		std::string stem = name.substr( 0, name.find_last_of( '.' ) );
+		char* end;
+		frame.time = std::strtod( stem.c_str(), &end );
+		if( stem.empty() || *end != '\0' )
+		{
+			frame.time = seq.size() / frameRate;
+		}
+		seq.push_back( frame );
+	}
+	std::sort( seq.begin(), seq.end(), compare_frames );
+}
+
+static void load_bag( const std::string& path, const std::string& topic, Sequence& seq )
+{
+	rosbag::Bag bag( path, rosbag::bagmode::Read );
+	rosbag::View view( bag, rosbag::TopicQuery( topic ) );
+	BOOST_FOREACH( const rosbag::MessageInstance& m, view )
+	{
+		sensor_msgs::ImageConstPtr msg = m.instantiate<sensor_msgs::Image>();
+		if( !msg ) { continue; }
+
+		Frame frame;
+		frame.time = msg->header.stamp.toSec();
+		frame.image = cv_bridge::toCvCopy( msg, "mono8" )->image;
+		seq.push_back( frame );
+	}
+	bag.close();
+	std::sort( seq.begin(), seq.end(), compare_frames );
+}
+
+// Loads camera poses as lines of 'time x y z qx qy qz qw'. Lines starting
+// with # are skipped.
+static void load_ground_truth( const std::string& path, Trajectory& traj )
+{
+	std::ifstream file( path.c_str() );
+	if( !file.is_open() )
+	{
+		throw std::runtime_error( "Could not open ground truth " + path );
+	}
+
+	std::string line;
+	while( std::getline( file, line ) )
+	{
+		if( line.empty() || line[0] == '#' ) { continue; }
+		std::stringstream ss( line );
+		double t, x, y, z, qx, qy, qz, qw;
+		if( !( ss >> t >> x >> y >> z >> qx >> qy >> qz >> qw ) )
+		{
+			throw std::runtime_error( "Malformed ground truth line: " + line );
+		}
+
+		FixedMatrixType<4, 4> H = FixedMatrixType<4, 4>::Identity();
+		H.block<3, 3>( 0, 0 ) = Eigen::Quaterniond( qw, qx, qy, qz ).normalized().toRotationMatrix();
+		H.block<3, 1>( 0, 3 ) << x, y, z;
+		traj.push_back( StampedPose( t, PoseSE3( H ) ) );
+	}
+	std::sort( traj.begin(), traj.end(), compare_poses );
+}
+
+// Finds the pose nearest to a time within a tolerance
+static bool lookup_pose( const Trajectory& traj, double time, double tolerance, PoseSE3& pose )
+{
+	if( traj.empty() ) { return false; }
+
+	StampedPose query( time, PoseSE3() );
+	Trajectory::const_iterator iter = std::lower_bound( traj.begin(), traj.end(),
+	                                                    query, compare_poses );
+	if( iter == traj.end() ||
+	    ( iter != traj.begin() && time - ( iter - 1 )->first < iter->first - time ) )
+	{
+		--iter;
+	}
+	if( std::abs( iter->first - time ) > tolerance ) { return false; }
+	pose = iter->second;
+	return true;
+}
+
+static InterestPointDetector::Ptr create_detector( const YAML::Node& info )
+{
+	std::string type;
+	GetParamRequired( info, "type", type );
+	if( type == "corner" )
+	{
+		CornerPointDetectorParams params;
+		GetParam( info, "max_num_points", params.maxNumPoints );
+		GetParam( info, "min_quality", params.minQuality );
+		GetParam( info, "min_separation", params.minSeparation );
+		GetParam( info, "block_dim", params.blockDim );
+		GetParam( info, "use_harris", params.useHarris );
+		GetParam( info, "harris_k", params.harrisK );
+		GetParam( info, "enable_refinement", params.enableRefine );
+		GetParam( info, "refine_window_dim", params.refineWindowDim );
+		GetParam( info, "refine_zero_dim", params.refineZeroDim );
+		GetParam( info, "refine_max_iters", params.refineMaxIters );
+		GetParam( info, "refine_min_log_eps", params.refineMinLogEps );
+		return std::make_shared<CornerPointDetector>( params );
+	}
+	else if( type == "fixed" )
+	{
+		FixedPointDetectorParams params;
+		GetParam( info, "grid_dim", params.gridDim );
+		return std::make_shared<FixedPointDetector>( params );
+	}
+	else if( type == "FAST" )
+	{
+		FASTPointDetectorParams params;
+		GetParam( info, "intensity_threshold", params.intensityThreshold );
+		GetParam( info, "enable_nonmax_suppression", params.enableNMS );
+		GetParam( info, "max_num_points", params.maxNumPoints );
+		GetParam( info, "detector_type", params.detectorType );
+		return std::make_shared<FASTPointDetector>( params );
+	}
+	else if( type == "grid" )
+	{
+		GridPointDetectorParams params;
+		GetParam( info, "grid_rows", params.gridRows );
+		GetParam( info, "grid_cols", params.gridCols );
+		GetParam( info, "points_per_cell", params.pointsPerCell );
+		GetParam( info, "initial_threshold", params.initialThreshold );
+		GetParam( info, "min_threshold", params.minThreshold );
+		GetParam( info, "max_threshold", params.maxThreshold );
+		GetParam( info, "adapt_rate", params.adaptRate );
+		GetParam( info, "enable_nonmax_suppression", params.enableNMS );
+		GetParam( info, "detector_type", params.detectorType );
+		return std::make_shared<GridPointDetector>( params );
+	}
+	throw std::invalid_argument( "Invalid point detector type: " + type );
+}
+
+static InterestPointTracker::Ptr create_tracker( const YAML::Node& info )
+{
+	std::string type;
+	GetParamRequired( info, "type", type );
+	if( type == "lucas_kanade" )
+	{
+		LKPointTrackerParams params;
+		GetParam( info, "pyramid_level", params.pyramidLevel );
+		GetParam( info, "window_dim", params.windowDim );
+		GetParam( info, "log_flow_eigenvalue_threshold", params.logEigenThreshold );
+		GetParam( info, "max_iters", params.maxIters );
+		GetParam( info, "log_min_eps", params.logMinEpsilon );
+		GetParam( info, "flow_error_threshold", params.maxFlowError );
+		return std::make_shared<LKPointTracker>( params );
+	}
+	throw std::invalid_argument( "Invalid point tracker type: " + type );
+}
+
+// Only the ECC tracker can be built from plain parameters. The
+// inverse-compositional tracker still reads them from a node handle.
+static DenseTracker::Ptr create_dense_tracker( const YAML::Node& info )
+{
+	std::string type;
+	GetParamRequired( info, "type", type );
+	if( type == "ecc" )
+	{
+		ECCDenseTrackerParams params;
+		GetParam( info, "log_min_eps", params.logMinEpsilon );
+		GetParam( info, "max_iters", params.maxIters );
+		GetParam( info, "log_min_correlation", params.logMinCorrelation );
+		GetParam( info, "selection_ratio", params.selectionRatio );
+		GetParam( info, "selection_cell_dim", params.selectionCellDim );
+		GetParam( info, "selection_min_gradient", params.selectionMinGradient );
+		return std::make_shared<ECCDenseTracker>( params );
+	}
+	throw std::invalid_argument( "Invalid dense tracker type: " + type );
+}
+
+static RigidEstimator::Ptr create_estimator( const YAML::Node& info )
+{
+	RigidEstimatorParams params;
+	std::string method;
+	if( GetParam( info, "method", method ) )
+	{
+		params.method = RigidEstimator::StringToMethod( method );
+	}
+	GetParam( info, "log_reprojection_threshold", params.logReprojThreshold );
+	GetParam( info, "max_iters", params.maxIters );
+	GetParam( info, "confidence", params.confidence );
+	return std::make_shared<RigidEstimator>( params );
+}
+
+/*! \brief Runs one configuration of the sparse or dense pipeline over a
+ * sequence. Frames are tracked against keyframes as in the sparse and dense VO
+ * nodes, without prediction, look-ahead detection, undistortion, or early
+ * exits, and as fast as possible. A run that throws is recorded as failed.
+ */
+class BenchmarkRun
+{
+public:
+
+	typedef std::shared_ptr<BenchmarkRun> Ptr;
+
+	BenchmarkRun( const std::string& name, const YAML::Node& info, double scale,
+	              const Sequence& sequence, const Trajectory& truth, double truthTolerance )
+		: _name( name ), _scale( scale ), _sequence( sequence ), _truth( truth ),
+		_truthTolerance( truthTolerance ), _dense( false ), _pyramidDepth( 0 ),
+		_originalNumKeypoints( 0 ), _hasLast( false ),
+		_lastTime( 0 ), _failed( false ), _wallTime( 0 ), _numFrames( 0 ),
+		_numCompared( 0 ), _linearSqErr( 0 ), _angularSqErr( 0 )
+	{
+		YAML::Node denseInfo;
+		if( GetParam( info, "dense_tracker", denseInfo ) )
+		{
+			_dense = true;
+			_denseTracker = create_dense_tracker( denseInfo );
+			GetParam( info, "pyramid_depth", _pyramidDepth );
+			return;
+		}
+
+		YAML::Node detectorInfo, trackerInfo, estimatorInfo;
+		GetParamRequired( info, "detector", detectorInfo );
+		GetParamRequired( info, "tracker", trackerInfo );
+		GetParam( info, "estimator", estimatorInfo );
+		_detector = create_detector( detectorInfo );
+		_tracker = create_tracker( trackerInfo );
+		_estimator = create_estimator( estimatorInfo );
+
+		_redetectThresh = 0.75;
+		_minNumKeypoints = 30;
+		GetParam( info, "redetection_threshold", _redetectThresh );
+		GetParam( info, "min_num_keypoints", _minNumKeypoints );
+	}
+
+	const std::string& GetName() const { return _name; }
+	bool HasFailed() const { return _failed; }
+
+	/*! \brief Marks the run as failed, such as when Run throws. */
+	void SetFailed( const std::string& reason )
+	{
+		_failed = true;
+		_failure = reason;
+	}
+
+	void Run()
+	{
+		ros::WallTime start = ros::WallTime::now();
+		for( unsigned int i = 0; i < _sequence.size(); ++i )
+		{
+			PipelineProfiler::ScopedTimer timer( _profiler, "process" );
+			ProcessFrame( _sequence[i] );
+		}
+		_wallTime = ( ros::WallTime::now() - start ).toSec();
+		_numFrames = _sequence.size();
+	}
+
+	void Report( std::ostream& os )
+	{
+		diagnostic_msgs::DiagnosticStatus status = _profiler.Report( _name );
+		os << _name << ":" << std::endl;
+		if( _failed )
+		{
+			os << "  failed: " << _failure << std::endl;
+			return;
+		}
+		os << "  frames: " << _numFrames << std::endl;
+		os << "  wall_time_s: " << _wallTime << std::endl;
+		os << "  throughput_fps: " << ( _wallTime > 0 ? _numFrames / _wallTime : 0 ) << std::endl;
+		BOOST_FOREACH( const diagnostic_msgs::KeyValue& kv, status.values )
+		{
+			os << "  " << kv.key << ": " << kv.value << std::endl;
+		}
+		if( !_truth.empty() )
+		{
+			os << "  velocity_error/num_compared: " << _numCompared << std::endl;
+			if( _numCompared > 0 )
+			{
+				os << "  velocity_error/linear_rms: " << std::sqrt( _linearSqErr / _numCompared ) << std::endl;
+				os << "  velocity_error/angular_rms: " << std::sqrt( _angularSqErr / _numCompared ) << std::endl;
+			}
+		}
+	}
+
+private:
+
+	std::string _name;
+	double _scale;
+	const Sequence& _sequence;
+	const Trajectory& _truth;
+	double _truthTolerance;
+
+	InterestPointDetector::Ptr _detector;
+	InterestPointTracker::Ptr _tracker;
+	RigidEstimator::Ptr _estimator;
+	double _redetectThresh;
+	unsigned int _minNumKeypoints;
+
+	bool _dense;
+	DenseTracker::Ptr _denseTracker;
+	unsigned int _pyramidDepth;
+
+	PipelineProfiler _profiler;
+
+	cv::Mat _keyImage;
+	InterestPoints _keyPoints;
+	InterestPoints _currPoints; // Reused across frames
+	std::vector<unsigned int> _inlierInds;
+	unsigned int _originalNumKeypoints;
+	PoseSE2 _keyToOrigin;
+
+	// Dense keyframe, current and last tracked frame pyramids
+	std::vector<cv::Mat> _keyPyramid;
+	std::vector<cv::Mat> _currPyramid;
+	std::vector<cv::Mat> _lastPyramid;
+	PoseSE2 _lastToKey;
+
+	bool _hasLast;
+	double _lastTime;
+	PoseSE3 _lastPose;
+
+	bool _failed;
+	std::string _failure;
+	double _wallTime;
+	unsigned int _numFrames;
+	unsigned int _numCompared;
+	double _linearSqErr;
+	double _angularSqErr;
+
+	void ProcessFrame( const Frame& frame )
+	{
+		if( _dense )
+		{
+			PipelineProfiler::ScopedTimer timer( _profiler, "pyramid" );
+			CreatePyramid( frame.image );
+		}
+
+		if( !HasKeyFrame() )
+		{
+			StartChain( frame );
+			return;
+		}
+
+		PoseSE2 currToKey;
+		bool tracked = _dense ? TrackDense( currToKey ) : TrackFrame( frame, currToKey );
+		if( !tracked )
+		{
+			_profiler.Increment( "keyframe_resets" );
+			StartChain( frame );
+			return;
+		}
+		_profiler.Increment( "frames" );
+
+		PoseSE2 currToOrigin = _keyToOrigin * currToKey;
+		PoseSE3 currToOrigin3;
+		CameraToStandard( currToOrigin, currToOrigin3 );
+		if( _hasLast && frame.time > _lastTime )
+		{
+			double dt = frame.time - _lastTime;
+			PoseSE3::TangentVector vel = PoseSE3::Log( _lastPose.Inverse() * currToOrigin3 ) / dt;
+			// NOTE Don't scale rotations by image scale!
+			vel.head<3>() *= _scale / frame.image.cols;
+			CompareVelocity( _lastTime, frame.time, vel );
+		}
+		_hasLast = true;
+		_lastTime = frame.time;
+		_lastPose = currToOrigin3;
+
+		// The dense pipeline only changes keyframes when tracking fails
+		if( _dense )
+		{
+			_lastToKey = currToKey;
+			_lastPyramid = _currPyramid;
+			return;
+		}
+
+		double survivingRatio = _keyPoints.size() / (double) _originalNumKeypoints;
+		if( survivingRatio <= _redetectThresh && !SetKeyFrame( frame, currToOrigin ) )
+		{
+			_hasLast = false;
+		}
+	}
+
+	bool HasKeyFrame() const
+	{
+		return _dense ? !_keyPyramid.empty() : !_keyImage.empty();
+	}
+
+	// Builds a new pyramid for the frame, so that earlier pyramids still
+	// referenced as the key or last frame are left intact
+	void CreatePyramid( const cv::Mat& image )
+	{
+		_currPyramid.clear();
+		_currPyramid.resize( _pyramidDepth + 1 );
+		_currPyramid[0] = image;
+		for( unsigned int i = 0; i < _pyramidDepth; ++i )
+		{
+			cv::pyrDown( _currPyramid[i], _currPyramid[i + 1] );
+		}
+	}
+
+	// Aligns the frame from the last frame's pose. On failure, retries once
+	// with the last frame as the keyframe, as the dense node does.
+	bool TrackDense( PoseSE2& currToKey )
+	{
+		currToKey = _lastToKey;
+		if( AlignPyramid( currToKey ) ) { return true; }
+		if( _lastPyramid.empty() ) { return false; }
+
+		_profiler.Increment( "retries" );
+		_keyToOrigin = _keyToOrigin * _lastToKey;
+		SetDenseKeyFrame( _lastPyramid );
+		currToKey = PoseSE2();
+		return AlignPyramid( currToKey );
+	}
+
+	// Aligns the current pyramid to the keyframe coarse to fine
+	bool AlignPyramid( PoseSE2& currToKey )
+	{
+		PipelineProfiler::ScopedTimer timer( _profiler, "tracking" );
+		int depth = _currPyramid.size() - 1;
+		PoseSE2::TangentVector logPose = PoseSE2::Log( currToKey );
+		logPose.head<2>() = logPose.head<2>() / std::pow( 2, depth );
+		for( int i = depth; i >= 0; --i )
+		{
+			currToKey = PoseSE2::Exp( logPose );
+			if( !_denseTracker->TrackImages( _keyPyramid[i], _currPyramid[i], currToKey ) )
+			{
+				_profiler.Increment( "tracking_failures" );
+				return false;
+			}
+			// Next level will be twice as much resolution
+			logPose = PoseSE2::Log( currToKey );
+			logPose.head<2>() *= 2;
+		}
+		return true;
+	}
+
+	void SetDenseKeyFrame( const std::vector<cv::Mat>& pyramid )
+	{
+		_keyPyramid = pyramid;
+		_denseTracker->SetKeyFrame( _keyPyramid );
+		_lastPyramid.clear();
+		_lastToKey = PoseSE2();
+		_profiler.Increment( "keyframes" );
+	}
+
+	// Restarts the pose chain with the frame as the keyframe and origin
+	void StartChain( const Frame& frame )
+	{
+		if( _dense )
+		{
+			_keyToOrigin = PoseSE2();
+			SetDenseKeyFrame( _currPyramid );
+			_hasLast = true;
+		}
+		else
+		{
+			_hasLast = SetKeyFrame( frame, PoseSE2() );
+		}
+		_lastTime = frame.time;
+		_lastPose = PoseSE3();
+	}
+
+	bool TrackFrame( const Frame& frame, PoseSE2& currToKey )
+	{
+		// Cleared so that the tracker seeds from the keyframe points
+		InterestPoints& currPoints = _currPoints;
+		currPoints.clear();
+		std::vector<unsigned int>& inlierInds = _inlierInds;
+		PipelineProfiler::ScopedTimer trackTimer( _profiler, "tracking" );
+		if( !_tracker->TrackInterestPoints( _keyImage, _keyPoints,
+		                                    frame.image, currPoints,
+		                                    inlierInds ) ||
+		    currPoints.size() < _minNumKeypoints )
+		{
+			return false;
+		}
+		trackTimer.Stop();
+		_profiler.Increment( "tracked_points", currPoints.size() );
+
+		PipelineProfiler::ScopedTimer estimateTimer( _profiler, "estimation" );
+		bool estimated = _estimator->EstimateMotion( _keyPoints, currPoints,
+		                                             inlierInds, currToKey );
+		estimateTimer.Stop();
+		unsigned int numIterations = _estimator->GetLastNumIterations();
+		if( numIterations > 0 ) { _profiler.Increment( "ransac_iterations", numIterations ); }
+		if( !estimated || inlierInds.size() < _minNumKeypoints ) { return false; }
+		_profiler.Increment( "motion_inliers", inlierInds.size() );
+
+		CompactByIndices( _keyPoints, inlierInds );
+		return true;
+	}
+
+	// Detects points on a frame to make it the keyframe, returning success
+	bool SetKeyFrame( const Frame& frame, const PoseSE2& toOrigin )
+	{
+		PipelineProfiler::ScopedTimer timer( _profiler, "detection" );
+		_keyPoints = _detector->FindInterestPoints( frame.image );
+		timer.Stop();
+		_profiler.Increment( "keyframes" );
+
+		_originalNumKeypoints = _keyPoints.size();
+		if( _originalNumKeypoints < _minNumKeypoints )
+		{
+			_keyImage = cv::Mat();
+			_keyPoints.clear();
+			return false;
+		}
+		_keyImage = frame.image;
+		_keyToOrigin = toOrigin;
+		_tracker->SetKeyFrame( _keyImage );
+		return true;
+	}
+
+	void CompareVelocity( double fromTime, double toTime,
+	                      const PoseSE3::TangentVector& vel )
+	{
+		PoseSE3 fromPose, toPose;
+		if( !lookup_pose( _truth, fromTime, _truthTolerance, fromPose ) ||
+		    !lookup_pose( _truth, toTime, _truthTolerance, toPose ) )
+		{
+			return;
+		}
+
+		PoseSE3::TangentVector truthVel = PoseSE3::Log( fromPose.Inverse() * toPose ) /
+		                                  ( toTime - fromTime );
+		PoseSE3::TangentVector err = vel - truthVel;
+		_linearSqErr += err.head<3>().squaredNorm();
+		_angularSqErr += err.tail<3>().squaredNorm();
+		++_numCompared;
+	}
+};
+
+// Counts finished runs so that the main thread can wait on them
+struct Completion
+{
+	Mutex mutex;
+	ConditionVariable cond;
+	unsigned int numDone;
+
+	Completion() : numDone( 0 ) {}
+};
+
+// Always counts the run as done, so that a failed run cannot stall main
+static void run_benchmark( const BenchmarkRun::Ptr& run, Completion& completion )
+{
+	try
+	{
+		run->Run();
+	}
+	catch( const std::exception& e )
+	{
+		ROS_ERROR_STREAM( "Configuration " << run->GetName() << " failed: " << e.what() );
+		run->SetFailed( e.what() );
+	}
+
+	WriteLock lock( completion.mutex );
+	++completion.numDone;
+	completion.cond.notify_all();
+}
+
+int main( int argc, char** argv )
+{
+	ros::init( argc, argv, "odoflow_benchmark", ros::init_options::AnonymousName );
+	if( argc < 2 )
+	{
+		std::cerr << "Usage: odoflow_benchmark <config.yaml>" << std::endl;
+		return 1;
+	}
+
+	YAML::Node config = YAML::LoadFile( argv[1] );
+
+	YAML::Node seqInfo;
+	GetParamRequired( config, "sequence", seqInfo );
+	Sequence sequence;
+	std::string imageDir, bagPath;
+	if( GetParam( seqInfo, "image_directory", imageDir ) )
+	{
+		double frameRate = 30.0;
+		GetParam( seqInfo, "frame_rate", frameRate );
+		load_directory( imageDir, frameRate, sequence );
+	}
+	else if( GetParam( seqInfo, "bag_file", bagPath ) )
+	{
+		std::string topic;
+		GetParamRequired( seqInfo, "image_topic", topic );
+		load_bag( bagPath, topic, sequence );
+	}
+	else
+	{
+		throw std::invalid_argument( "Sequence must specify image_directory or bag_file" );
+	}
+	ROS_INFO_STREAM( "Loaded " << sequence.size() << " frames" );
+
+	Trajectory truth;
+	std::string truthPath;
+	double truthTolerance = 0.02;
+	if( GetParam( seqInfo, "ground_truth", truthPath ) )
+	{
+		load_ground_truth( truthPath, truth );
+		GetParam( seqInfo, "ground_truth_tolerance", truthTolerance );
+		ROS_INFO_STREAM( "Loaded " << truth.size() << " ground truth poses" );
+	}
+
+	double scale = 1.0;
+	GetParam( config, "scale", scale );
+
+	YAML::Node runInfos;
+	GetParamRequired( config, "configurations", runInfos );
+	std::vector<BenchmarkRun::Ptr> runs;
+	YAML::Node::const_iterator iter;
+	for( iter = runInfos.begin(); iter != runInfos.end(); ++iter )
+	{
+		std::string name = iter->first.as<std::string>();
+		runs.push_back( std::make_shared<BenchmarkRun>( name, iter->second, scale,
+		                                                sequence, truth, truthTolerance ) );
+	}
+
+	unsigned int numWorkers = runs.size();
+	GetParam( config, "num_workers", numWorkers );
+	ROS_INFO_STREAM( "Running " << runs.size() << " configurations on "
+	                 << numWorkers << " workers" );
+
+	Completion completion;
+	WorkerPool workers;
+	workers.SetNumWorkers( std::max( numWorkers, 1u ) );
+	for( unsigned int i = 0; i < runs.size(); ++i )
+	{
+		WorkerPool::Job job = boost::bind( &run_benchmark, runs[i], boost::ref( completion ) );
+		workers.EnqueueJob( job );
+	}
+	workers.StartWorkers();
+
+	{
+		WriteLock lock( completion.mutex );
+		while( completion.numDone < runs.size() )
+		{
+			completion.cond.wait( lock );
+		}
+	}
+
+	bool anyFailed = false;
+	for( unsigned int i = 0; i < runs.size(); ++i )
+	{
+		runs[i]->Report( std::cout );
+		anyFailed = anyFailed || runs[i]->HasFailed();
+	}
+	return anyFailed ? 1 : 0;
+}
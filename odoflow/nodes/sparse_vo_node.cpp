@@ -3,6 +3,7 @@
 #include <image_transport/image_transport.h>
 #include <cv_bridge/cv_bridge.h>
 #include <geometry_msgs/TwistStamped.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/video/tracking.hpp>
@@ -12,26 +13,63 @@
 #include "odoflow/CornerPointDetector.h"
 #include "odoflow/FASTPointDetector.h"
 #include "odoflow/FixedPointDetector.h"
+#include "odoflow/GridPointDetector.h"
 #include "odoflow/LKPointTracker.h"
 #include "odoflow/RigidEstimator.h"
 #include "odoflow/MotionPredictor.h"
+#include "odoflow/PointTransformTable.h"
 #include "odoflow/VelocityPublisher.h"
 
 #include "argus_utils/geometry/GeometryUtils.h"
 #include "argus_utils/geometry/VelocityIntegrator.hpp"
+#include "argus_utils/synchronization/SynchronizationTypes.h"
+#include "argus_utils/synchronization/WorkerPool.h"
 
+#include "camplex/BackgroundRenderer.h"
 #include "camplex/CameraCalibration.h"
 #include "camplex/FiducialCommon.h"
+#include "camplex/LatestFrameMailbox.hpp"
+#include "camplex/PipelineProfiler.h"
 #include "paraset/ParameterManager.hpp"
 
 using namespace argus;
 
+// Copies a parameter from the node namespace into a camera namespace, keeping
+// any members that the camera namespace already overrides
+static void inherit_param( ros::NodeHandle& ph, ros::NodeHandle& camHandle,
+                           const std::string& name )
+{
+	XmlRpc::XmlRpcValue shared;
+	if( !ph.getParam( name, shared ) ) { return; }
+
+	XmlRpc::XmlRpcValue specific;
+	if( !camHandle.getParam( name, specific ) )
+	{
+		camHandle.setParam( name, shared );
+		return;
+	}
+	if( shared.getType() != XmlRpc::XmlRpcValue::TypeStruct ||
+	    specific.getType() != XmlRpc::XmlRpcValue::TypeStruct )
+	{
+		return;
+	}
+
+	for( XmlRpc::XmlRpcValue::iterator iter = shared.begin(); iter != shared.end(); ++iter )
+	{
+		if( !specific.hasMember( iter->first ) )
+		{
+			specific[iter->first] = iter->second;
+		}
+	}
+	camHandle.setParam( name, specific );
+}
+
 class SparseVONode
 {
 public:
 
 	SparseVONode( ros::NodeHandle& nh, ros::NodeHandle& ph )
-		: _imageTrans( nh ), _predictor( nh, ph ), _velPub( nh, ph )
+		: _imageTrans( nh ), _predictor( nh, ph )
 	{
 		// Initialize all runtime parameters
 		_redetectThresh.InitializeAndRead( ph, 0.75, "redetection_threshold",
@@ -52,108 +90,375 @@ public:
 		_minInlierRatio.AddCheck<GreaterThanOrEqual>( 0 );
 		_minNumKeypoints.AddCheck<IntegerValued>( ROUND_CLOSEST );
 
-		GetParamRequired( ph, "scale", _scale );
+		_replenishGridDim.InitializeAndRead( ph, 4, "replenish_grid_dim",
+		                                     "Number of replenishment grid cells per image side" );
+		_replenishGridDim.AddCheck<GreaterThan>( 0 );
+		_replenishGridDim.AddCheck<IntegerValued>( ROUND_CLOSEST );
+
+		_replenishMinSeparation.InitializeAndRead( ph, 10.0, "replenish_min_separation",
+		                                           "Min distance in pixels between new and existing tracks" );
+		_replenishMinSeparation.AddCheck<GreaterThanOrEqual>( 0.0 );
 
-		InitializeDetector( nh, ph );
-		InitializeTracker( nh, ph );
-		InitializeEstimator( nh, ph );
+		// Detections run on the shared pool, so back to back detections would
+		// take a core away from frame processing
+		_lookaheadMinPeriod.InitializeAndRead( ph, 0.5, "lookahead_min_period",
+		                                       "Minimum time between look-ahead keyframe detections" );
+		_lookaheadMinPeriod.AddCheck<GreaterThanOrEqual>( 0.0 );
 
+		// Frame-to-frame tracking needs only a small search, and tracking against
+		// the keyframe every few frames bounds the drift of the composed poses
+		GetParam( ph, "frame_tracking", _frameTracking, false );
+		_refinePeriod.InitializeAndRead( ph, 5, "keyframe_refine_period",
+		                                 "Number of frame-to-frame tracked frames between keyframe refinements" );
+		_refinePeriod.AddCheck<GreaterThan>( 0 );
+		_refinePeriod.AddCheck<IntegerValued>( ROUND_CLOSEST );
+
+		GetParamRequired( ph, "scale", _scale );
+		GetParam( ph, "undistortion_table_cell_dim", _tableCellDim, 8u );
 		GetParam( ph, "debug", _debug, false );
 		if( _debug )
 		{
-			std::string debugTopicName = ph.resolveName( "image_debug" );
-			ROS_INFO_STREAM( "Displaying debug output on topic" << debugTopicName );
-			_debugPub = _imageTrans.advertise( "image_debug", 1 );
+			// Debug images are drawn off the processing threads, only when watched
+			double debugRate;
+			GetParam( ph, "debug_rate", debugRate, 10.0 );
+			_renderer = std::make_shared<BackgroundRenderer>( debugRate );
+		}
+
+		// Stage timings and counters are only recorded if they are published
+		double statsPeriod;
+		GetParam( ph, "stats_period", statsPeriod, 10.0 );
+		_enableProfiling = statsPeriod > 0;
+		if( _enableProfiling )
+		{
+			_diagPub = nh.advertise<diagnostic_msgs::DiagnosticArray>( "diagnostics", 10 );
+			_statsTimer = nh.createTimer( ros::Duration( statsPeriod ),
+			                              &SparseVONode::StatsCallback,
+			                              this );
+		}
+
+		// Frames and look-ahead detections of all cameras run on a shared pool,
+		// with at most one job of each kind per camera so frames stay in order.
+		// Each camera's processing always takes its newest frame.
+		unsigned int numWorkers;
+		GetParam( ph, "num_workers", numWorkers, 2u );
+		_workers.SetNumWorkers( numWorkers );
+		_workers.StartWorkers();
+
+		unsigned int buffSize;
+		GetParam<unsigned int>( ph, "buffer_size", buffSize, 2 );
+
+		std::vector<std::string> cameraNames;
+		GetParam( ph, "cameras", cameraNames, std::vector<std::string>() );
+		if( cameraNames.empty() )
+		{
+			AddCamera( nh, ph, "", "image", buffSize );
+		}
+		for( unsigned int i = 0; i < cameraNames.size(); ++i )
+		{
+			const std::string& name = cameraNames[i];
+			ros::NodeHandle camHandle( ph, name );
+			inherit_param( ph, camHandle, "detector" );
+			inherit_param( ph, camHandle, "tracker" );
+			inherit_param( ph, camHandle, "frame_tracker" );
+			inherit_param( ph, camHandle, "estimator" );
+			inherit_param( ph, camHandle, "min_time_delta" );
+			AddCamera( nh, camHandle, name, name + "/image", buffSize );
 		}
 	}
 
 private:
 
 	image_transport::ImageTransport _imageTrans;
-	image_transport::CameraSubscriber _imageSub;
 
 	bool _debug;
-	image_transport::Publisher _debugPub;
-
+	bool _frameTracking;
 	double _scale;
-	InterestPointDetector::Ptr _detector;
-	InterestPointTracker::Ptr _tracker;
-	RigidEstimator::Ptr _estimator;
+	unsigned int _tableCellDim; // 0 disables the undistortion lookup table
 	MotionPredictor _predictor;
-	VelocityPublisher _velPub;
+
+	struct TrackInfo
+	{
+		unsigned int id;
+		unsigned int age; // Number of frames tracked
+	};
+	typedef std::vector<TrackInfo> TrackInfos;
 
 	struct FrameInfo
 	{
 		ros::Time time;
 		std::string frameId;
+		cv_bridge::CvImageConstPtr image; // Keeps frame data alive
 		cv::Mat frame;
 		InterestPoints points;
+		TrackInfos tracks; // Aligned with points if assigned
 		CameraCalibration calibration;
+
+		// Pose relative to the first keyframe of a pose chain, if tracked
+		bool hasPose;
+		unsigned int chainId;
+		PoseSE2 toOrigin;
+
+		FrameInfo() : hasPose( false ), chainId( 0 ) {}
+
+		// Exchanges contents without copying the point and track buffers
+		void Swap( FrameInfo& other )
+		{
+			std::swap( time, other.time );
+			frameId.swap( other.frameId );
+			image.swap( other.image );
+			cv::swap( frame, other.frame );
+			points.swap( other.points );
+			tracks.swap( other.tracks );
+			std::swap( calibration, other.calibration );
+			std::swap( hasPose, other.hasPose );
+			std::swap( chainId, other.chainId );
+			std::swap( toOrigin, other.toOrigin );
+		}
 	};
 
-	FrameInfo _keyFrame;
-	FrameInfo _lastFrame;
-	PoseSE2 _lastToKey;
-	size_t _originalNumKeypoints; // Number of keypoints on detection
+	typedef std::pair<sensor_msgs::ImageConstPtr,
+	                  sensor_msgs::CameraInfoConstPtr> ImageData;
+
+	// Copy of the state drawn by Visualize, taken on the processing thread
+	struct DebugSnapshot
+	{
+		cv_bridge::CvImageConstPtr keySource; // Keep image data alive
+		cv_bridge::CvImageConstPtr currentSource;
+		cv::Mat key;
+		cv::Mat current;
+		InterestPoints keyPoints;
+		InterestPoints currentPoints;
+		PoseSE2 currToKey;
+		ros::Time time;
+		std::string frameId;
+		image_transport::Publisher pub;
+	};
+
+	// Pipeline objects and tracking state of one camera
+	struct CameraState
+	{
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+		std::string name;
+		image_transport::CameraSubscriber imageSub;
+		image_transport::Publisher debugPub;
+
+		InterestPointDetector::Ptr detector;
+		InterestPointTracker::Ptr tracker;
+		InterestPointTracker::Ptr frameTracker; // Null unless tracking frame to frame
+		RigidEstimator::Ptr estimator;
+		std::shared_ptr<VelocityPublisher> velPub;
+		PointTransformTable::Ptr pointTable;
+		Mutex detectorMutex;
+
+		// Newest received frame waiting for the processing job
+		LatestFrameMailbox<ImageData> mailbox;
+		Mutex processMutex;
+		bool processing;
+
+		// Tracking state, only used by the processing job. The current frame is
+		// filled in place and swapped with the last frame once tracked, so that
+		// their buffers are reused.
+		FrameInfo keyFrame;
+		FrameInfo currentFrame;
+		FrameInfo lastFrame;
+		PoseSE2 lastToKey;
+		size_t originalNumKeypoints; // Number of keypoints on detection
+		unsigned int framesSinceRefine; // Frames tracked from the last frame
+		ros::Time lastSubmitTime;
+
+		// Point buffers reused across frames by the processing job
+		InterestPoints sourceUndist;
+		InterestPoints currUndist;
+		InterestPoints seedUndist;
+		std::vector<unsigned int> inlierInds;
+		std::vector<bool> replenishOccupied;
+		cv::Mat replenishMask;
+
+		// Keyframes replenished from tracked frames continue the same pose chain,
+		// so the velocity publisher does not have to be reset
+		unsigned int nextTrackId;
+		unsigned int chainId;
+		PoseSE2 keyToOrigin;
+
+		// Look-ahead keyframe detection. Processing submits recently tracked
+		// frames as pending, and the detection job replaces the result with each.
+		Mutex lookaheadMutex;
+		FrameInfo pendingFrame;
+		bool hasPending;
+		bool detecting;
+		FrameInfo lookaheadFrame;
+		bool hasLookahead;
+
+		PipelineProfiler profiler;
+
+		CameraState()
+			: processing( false ), originalNumKeypoints( 0 ), framesSinceRefine( 0 ), nextTrackId( 0 ),
+			chainId( 0 ), hasPending( false ), detecting( false ),
+			hasLookahead( false ) {}
+	};
+	typedef std::shared_ptr<CameraState> CameraStatePtr;
+
+	std::vector<CameraStatePtr> _cameras;
+	std::shared_ptr<BackgroundRenderer> _renderer;
+	bool _enableProfiling;
+	ros::Publisher _diagPub;
+	ros::Timer _statsTimer;
 
 	NumericParam _minNumKeypoints;
 	NumericParam _redetectThresh;
 	NumericParam _minInlierRatio;
 	NumericParam _maxFrameDt;
+	NumericParam _lookaheadMinPeriod;
+	NumericParam _replenishGridDim;
+	NumericParam _replenishMinSeparation;
+	NumericParam _refinePeriod;
+
+	WorkerPool _workers; // Declared after the state its jobs use
+
+	void AddCamera( ros::NodeHandle& nh, ros::NodeHandle& camHandle,
+	                const std::string& name, const std::string& topic,
+	                unsigned int buffSize )
+	{
+		CameraStatePtr cam( new CameraState );
+		cam->name = name;
+		cam->profiler.SetEnabled( _enableProfiling );
+		cam->detector = InitializeDetector( nh, camHandle );
+		cam->tracker = InitializeTracker( nh, camHandle, "tracker" );
+		if( _frameTracking )
+		{
+			cam->frameTracker = InitializeTracker( nh, camHandle, "frame_tracker" );
+		}
+		cam->estimator = InitializeEstimator( nh, camHandle );
+		cam->velPub.reset( new VelocityPublisher( nh, camHandle ) );
+
+		if( _debug )
+		{
+			std::string debugTopic = name.empty() ? "image_debug" : name + "/image_debug";
+			ROS_INFO_STREAM( "Displaying debug output on topic " << nh.resolveName( debugTopic ) );
+			cam->debugPub = _imageTrans.advertise( debugTopic, 1 );
+		}
+		_cameras.push_back( cam );
 
-	void InitializeDetector( ros::NodeHandle& nh, ros::NodeHandle& ph )
+		image_transport::CameraSubscriber::Callback cb =
+		    boost::bind( &SparseVONode::ImageCallback, this, _1, _2, cam );
+		cam->imageSub = _imageTrans.subscribeCamera( topic, buffSize, cb );
+	}
+
+	InterestPointDetector::Ptr InitializeDetector( ros::NodeHandle& nh, ros::NodeHandle& ph )
 	{
 		std::string detectorType;
 		GetParamRequired( ph, "detector/type", detectorType );
 
-		ros::NodeHandle detectorHandle( "~detector" );
+		ros::NodeHandle detectorHandle( ph, "detector" );
 		if( detectorType == "corner" )
 		{
 			ROS_INFO_STREAM( "Initializing corner-based point detector" );
-			_detector = std::make_shared<CornerPointDetector>( nh, detectorHandle );
+			return std::make_shared<CornerPointDetector>( nh, detectorHandle );
 		}
 		else if( detectorType == "fixed" )
 		{
 			ROS_INFO_STREAM( "Initializing fixed-grid point detector" );
-			_detector = std::make_shared<FixedPointDetector>( nh, detectorHandle );
+			return std::make_shared<FixedPointDetector>( nh, detectorHandle );
 		}
 		else if( detectorType == "FAST" )
 		{
 			ROS_INFO_STREAM( "Initializing FAST point detector" );
-			_detector = std::make_shared<FASTPointDetector>( nh, detectorHandle );
+			return std::make_shared<FASTPointDetector>( nh, detectorHandle );
 		}
-		else
+		else if( detectorType == "grid" )
 		{
-			ROS_ERROR_STREAM( "Invalid point detector type: " + detectorType );
+			ROS_INFO_STREAM( "Initializing grid-bucketed FAST point detector" );
+			return std::make_shared<GridPointDetector>( nh, detectorHandle );
 		}
+		throw std::invalid_argument( "Invalid point detector type: " + detectorType );
 	}
 
-	void InitializeTracker( ros::NodeHandle& nh, ros::NodeHandle& ph )
+	InterestPointTracker::Ptr InitializeTracker( ros::NodeHandle& nh, ros::NodeHandle& ph,
+	                                             const std::string& ns )
 	{
 		std::string trackerType;
-		GetParamRequired( ph, "tracker/type", trackerType );
-		ros::NodeHandle trackerHandle( "~tracker" );
+		GetParamRequired( ph, ns + "/type", trackerType );
+		ros::NodeHandle trackerHandle( ph, ns );
 		if( trackerType == "lucas_kanade" )
 		{
 			ROS_INFO_STREAM( "Initializing Lucas-Kanade point tracker" );
-			_tracker = std::make_shared<LKPointTracker>( nh, trackerHandle );
-		}
-		else
-		{
-			ROS_ERROR_STREAM( "Invalid point tracker type." );
+			return std::make_shared<LKPointTracker>( nh, trackerHandle );
 		}
+		throw std::invalid_argument( "Invalid point tracker type: " + trackerType );
 	}
 
-	void InitializeEstimator( ros::NodeHandle& nh, ros::NodeHandle& ph )
+	RigidEstimator::Ptr InitializeEstimator( ros::NodeHandle& nh, ros::NodeHandle& ph )
 	{
-		ros::NodeHandle estimatorHandle( "~estimator" );
+		ros::NodeHandle estimatorHandle( ph, "estimator" );
 		ROS_INFO_STREAM( "Initializing robust rigid motion estimator" );
-		_estimator = std::make_shared<RigidEstimator>( nh, estimatorHandle );
+		return std::make_shared<RigidEstimator>( nh, estimatorHandle );
 	}
 
 	void ImageCallback( const sensor_msgs::ImageConstPtr& msg,
-	                    const sensor_msgs::CameraInfoConstPtr& info_msg )
+	                    const sensor_msgs::CameraInfoConstPtr& info_msg,
+	                    const CameraStatePtr& cam )
+	{
+		cam->mailbox.Post( ImageData( msg, info_msg ) );
+
+		WriteLock lock( cam->processMutex );
+		if( !cam->processing )
+		{
+			cam->processing = true;
+			WorkerPool::Job job = boost::bind( &SparseVONode::ProcessCamera, this, cam );
+			_workers.EnqueueJob( job );
+		}
+	}
+
+	// Processes a camera's newest frame. Another job is queued behind the
+	// other cameras' jobs if a frame arrived meanwhile, so that one busy camera
+	// does not hold a pool worker.
+	void ProcessCamera( const CameraStatePtr& cam )
+	{
+		ImageData data;
+		unsigned int skipped;
+		{
+			// Checked under the lock so that a frame posted after the last
+			// take always finds either this job or none running
+			WriteLock lock( cam->processMutex );
+			if( !cam->mailbox.TryTake( data, skipped ) )
+			{
+				cam->processing = false;
+				return;
+			}
+		}
+		cam->profiler.Increment( "skipped_frames", skipped );
+
+		PipelineProfiler::ScopedTimer timer( cam->profiler, "process" );
+		bool processed = ProcessImage( cam, data.first, data.second );
+		timer.Stop();
+		if( processed )
+		{
+			cam->profiler.Increment( "frames" );
+			if( cam->profiler.IsEnabled() )
+			{
+				double latency = ( ros::Time::now() - data.first->header.stamp ).toSec();
+				cam->profiler.AddTiming( "latency", latency );
+			}
+		}
+
+		WriteLock lock( cam->processMutex );
+		if( cam->mailbox.HasItem() )
+		{
+			WorkerPool::Job job = boost::bind( &SparseVONode::ProcessCamera, this, cam );
+			_workers.EnqueueJob( job );
+		}
+		else
+		{
+			cam->processing = false;
+		}
+	}
+
+	bool ProcessImage( const CameraStatePtr& cam,
+	                   const sensor_msgs::ImageConstPtr& msg,
+	                   const sensor_msgs::CameraInfoConstPtr& info_msg )
 	{
+		PipelineProfiler::ScopedTimer timer( cam->profiler, "conversion" );
 		cv_bridge::CvImageConstPtr frame;
 		try
 		{
@@ -162,82 +467,126 @@ private:
 		catch( cv_bridge::Exception& e )
 		{
 			ROS_ERROR( "cv_bridge exception: %s", e.what() );
-			return;
+			return false;
 		}
 
-		FrameInfo current;
+		FrameInfo& current = cam->currentFrame;
 		current.time = msg->header.stamp;
 		current.frameId = msg->header.frame_id;
+		current.image = frame;
 		current.frame = frame->image;
+		current.points.clear();
+		current.tracks.clear();
 		current.calibration = CameraCalibration( info_msg->header.frame_id, *info_msg );
+		current.hasPose = false;
 
 		// TODO A more complete check of intrinsics validity
 		if( current.calibration.GetFx() == 0.0 || std::isnan( current.calibration.GetFx() ) )
 		{
 			ROS_WARN_STREAM( "Camera " << msg->header.frame_id << " has invalid intrinsics." );
-			return;
+			return false;
 		}
 		current.calibration.SetScale( current.frame.size() );
-		ProcessFrame( current );
+		UpdatePointTable( *cam, current.calibration );
+		timer.Stop();
+
+		ProcessFrame( cam, current );
+		return true;
 	}
 
-	void ProcessFrame( FrameInfo& current )
+	// Rebuilds the undistortion lookup table if the calibration changed
+	void UpdatePointTable( CameraState& cam, const CameraCalibration& calibration )
+	{
+		if( _tableCellDim == 0 ) { return; }
+		if( cam.pointTable && cam.pointTable->Matches( calibration ) ) { return; }
+
+		ROS_INFO_STREAM( "Building undistortion lookup table for " << calibration.GetName() );
+		cam.pointTable = std::make_shared<PointTransformTable>( calibration, _tableCellDim );
+	}
+
+	void ProcessFrame( const CameraStatePtr& cam, FrameInfo& current )
 	{
 		PoseSE2 currToKey;
-		if( !CheckInitialization( current ) ||
-		    !PredictAndTrack( current ) ||
-		    !EstimateMotion( current, currToKey ) )
+		bool success = TrackFrame( *cam, current, currToKey );
+		if( !success && SwitchKeyFrame( *cam, current ) )
 		{
-			if( !_lastFrame.frame.empty() )
-			{
-				ROS_INFO_STREAM( "Retrying tracking with previous frame as keyframe" );
-				SetKeyFrame( _lastFrame );
-				_lastFrame.frame = cv::Mat();
-				ProcessFrame( current );
-			}
-			else
+			ROS_INFO_STREAM( "Retrying tracking with look-ahead keyframe" );
+			cam->profiler.Increment( "retries" );
+			success = TrackFrame( *cam, current, currToKey );
+		}
+
+		if( success )
+		{
+			current.hasPose = true;
+			current.chainId = cam->chainId;
+			current.toOrigin = cam->keyToOrigin * currToKey;
+
+			PoseSE3 currToOrigin3;
+			CameraToStandard( current.toOrigin, currToOrigin3 );
+			double imgWidth = (double) current.frame.size().width;
+			double scale = _scale / imgWidth;
+			cam->velPub->ReportPose( current.time, current.frameId, currToOrigin3, scale );
+			cam->lastToKey = currToKey;
+			cam->lastFrame.Swap( current );
+
+			// Check if we need to replenish
+			double survivingRatio = cam->keyFrame.points.size() / (double) cam->originalNumKeypoints;
+			if( survivingRatio <= _redetectThresh )
 			{
-				ROS_INFO_STREAM( "No previous frame, setting current to keyframe and bailing" );
-				SetKeyFrame( current );
+				ROS_INFO_STREAM( cam->keyFrame.points.size() << " tracks less than "
+				                 << _redetectThresh * cam->originalNumKeypoints
+				                 << ". Replenishing keyframe." );
+				cam->profiler.Increment( "replenishments" );
+				ReplenishKeyFrame( *cam, cam->lastFrame );
 			}
 		}
 		else
 		{
-			PoseSE3 currToKey3;
-			CameraToStandard( currToKey, currToKey3 );
-			double imgWidth = (double) current.frame.size().width;
-			double scale = _scale / imgWidth;
-			_velPub.ReportPose( current.time, current.frameId, currToKey3, scale );
-			_lastToKey = currToKey;
+			// Keep the keyframe, which may still track the next frame, until a
+			// look-ahead result for this one replaces it
+			ROS_INFO_STREAM( "Tracking failed, requesting look-ahead keyframe" );
+			cam->profiler.Increment( "tracking_failures" );
 		}
+		// A tracked frame has been swapped into the last frame
+		const FrameInfo& processed = success ? cam->lastFrame : current;
+		SubmitLookahead( cam, processed, !success );
 
-		if( _debug )
+		if( _debug && !cam->keyFrame.frame.empty() &&
+		    _renderer->ShouldRender( cam->name, cam->debugPub.getNumSubscribers() ) )
 		{
-			const PoseSE3::TangentVector& vel3 = _velPub.GetLastVelocity();
-			PoseSE2::TangentVector vel;
-			vel << vel3( 0 ), vel3( 1 ), vel3( 0 );
-			Visualize( current, currToKey, vel );
+			DebugSnapshot snap;
+			snap.keySource = cam->keyFrame.image;
+			snap.currentSource = processed.image;
+			snap.key = cam->keyFrame.frame;
+			snap.current = processed.frame;
+			snap.keyPoints = cam->keyFrame.points;
+			snap.currentPoints = processed.points;
+			snap.currToKey = currToKey;
+			snap.time = processed.time;
+			snap.frameId = processed.frameId;
+			snap.pub = cam->debugPub;
+			BackgroundRenderer::Job job = boost::bind( &SparseVONode::Visualize, snap );
+			_renderer->Submit( cam->name, job );
 		}
 	}
 
-	void Visualize( FrameInfo& current, PoseSE2& pose, PoseSE2::TangentVector& vel )
+	// Draws a snapshot on the render thread
+	static void Visualize( const DebugSnapshot& snap )
 	{
-		if( _keyFrame.frame.empty() ) { return; }
-
-		unsigned int width = current.frame.cols;
-		unsigned int height = current.frame.rows;
+		unsigned int width = snap.current.cols;
+		unsigned int height = snap.current.rows;
 		cv::Mat visImage( height, 2 * width, CV_8UC3 );
 		cv::Mat visLeft( visImage, cv::Rect( 0, 0, width, height ) );
 		cv::Mat visRight( visImage, cv::Rect( width, 0, width, height ) );
-		cv::cvtColor( _keyFrame.frame, visLeft, cv::COLOR_GRAY2BGR );
-		cv::cvtColor( current.frame, visRight, cv::COLOR_GRAY2BGR );
+		cv::cvtColor( snap.key, visLeft, cv::COLOR_GRAY2BGR );
+		cv::cvtColor( snap.current, visRight, cv::COLOR_GRAY2BGR );
 
 		// Show current frame extents on keyframe
 		FixedMatrixType<3, 4> corners;
 		corners << 1, 1, width - 1, width - 1,
 		1, height - 1, height - 1, 1,
 		1, 1, 1, 1;
-		FixedMatrixType<2, 4> warped = (pose.ToMatrix() * corners).colwise().hnormalized();
+		FixedMatrixType<2, 4> warped = (snap.currToKey.ToMatrix() * corners).colwise().hnormalized();
 
 		std::vector<cv::Point2f> cornerPoints;
 		for( unsigned int i = 0; i < 4; ++i )
@@ -250,59 +599,332 @@ private:
 		cv::line( visLeft, cornerPoints[3], cornerPoints[0], cv::Scalar( 0, 255, 0 ) );
 
 		// Display keypoints
-		cv::Point2d offset( width, 0 );
-		for( unsigned int i = 0; i < _keyFrame.points.size(); i++ )
+		for( unsigned int i = 0; i < snap.keyPoints.size(); i++ )
 		{
-			cv::circle( visLeft, _keyFrame.points[i], 2, cv::Scalar( 0, 255, 0 ), -1, 8 );
+			cv::circle( visLeft, snap.keyPoints[i], 2, cv::Scalar( 0, 255, 0 ), -1, 8 );
 		}
-		for( unsigned int i = 0; i < _lastFrame.points.size(); i++ )
+		for( unsigned int i = 0; i < snap.currentPoints.size(); i++ )
 		{
-			cv::circle( visRight, _lastFrame.points[i], 2, cv::Scalar( 0, 255, 0 ), -1, 8 );
+			cv::circle( visRight, snap.currentPoints[i], 2, cv::Scalar( 0, 255, 0 ), -1, 8 );
 		}
 
 		std_msgs::Header header;
-		header.stamp = _lastFrame.time;
-		header.frame_id = current.frameId;
+		header.stamp = snap.time;
+		header.frame_id = snap.frameId;
 		cv_bridge::CvImage vimg( header, "bgr8", visImage );
-		_debugPub.publish( vimg.toImageMsg() );
+		snap.pub.publish( vimg.toImageMsg() );
+	}
+
+	bool TrackFrame( CameraState& cam, FrameInfo& current, PoseSE2& currToKey )
+	{
+		if( !CheckInitialization( cam, current ) ) { return false; }
+
+		// Between refinements, track from the last frame and compose its motion
+		// onto the last frame's pose
+		if( cam.frameTracker && cam.framesSinceRefine < _refinePeriod )
+		{
+			PoseSE2 currToLast;
+			if( PredictAndTrack( cam, cam.lastFrame, PoseSE2(), *cam.frameTracker,
+			                     "frame_tracking", current ) &&
+			    EstimateMotion( cam, cam.lastFrame, current, currToLast ) )
+			{
+				currToKey = cam.lastToKey * currToLast;
+				++cam.framesSinceRefine;
+				return true;
+			}
+
+			// Fall back to tracking against the keyframe with the surviving points
+			cam.profiler.Increment( "frame_tracking_failures" );
+			if( cam.keyFrame.points.size() < _minNumKeypoints )
+			{
+				ForceRefinement( cam );
+				return false;
+			}
+		}
+
+		if( !PredictAndTrack( cam, cam.keyFrame, cam.lastToKey, *cam.tracker,
+		                      "tracking", current ) ||
+		    !EstimateMotion( cam, cam.keyFrame, current, currToKey ) )
+		{
+			ForceRefinement( cam );
+			return false;
+		}
+		if( cam.frameTracker ) { cam.profiler.Increment( "keyframe_refinements" ); }
+		cam.framesSinceRefine = 0;
+		return true;
+	}
+
+	// Makes the next frame track from the keyframe. Failed keyframe tracking
+	// compacts the keyframe points but not the last frame's, so the last frame
+	// can no longer be a tracking source.
+	void ForceRefinement( CameraState& cam )
+	{
+		cam.framesSinceRefine = (unsigned int) _refinePeriod;
+	}
+
+	void SubmitLookahead( const CameraStatePtr& cam, const FrameInfo& current, bool force )
+	{
+		if( !force && !cam->lastSubmitTime.isZero() &&
+		    ( current.time - cam->lastSubmitTime ).toSec() < _lookaheadMinPeriod )
+		{
+			return;
+		}
+		cam->lastSubmitTime = current.time;
+
+		// Detection only needs the image, so the points and tracks are not copied
+		WriteLock lock( cam->lookaheadMutex );
+		FrameInfo& pending = cam->pendingFrame;
+		pending.time = current.time;
+		pending.frameId = current.frameId;
+		pending.image = current.image;
+		pending.frame = current.frame;
+		pending.points.clear();
+		pending.tracks.clear();
+		pending.calibration = current.calibration;
+		pending.hasPose = current.hasPose;
+		pending.chainId = current.chainId;
+		pending.toOrigin = current.toOrigin;
+		cam->hasPending = true;
+
+		if( !cam->detecting )
+		{
+			cam->detecting = true;
+			WorkerPool::Job job = boost::bind( &SparseVONode::LookaheadDetect, this, cam );
+			_workers.EnqueueJob( job );
+		}
 	}
 
-	bool CheckInitialization( FrameInfo& current )
+	// Makes the latest look-ahead frame the keyframe, returning success
+	bool SwitchKeyFrame( CameraState& cam, const FrameInfo& current )
+	{
+		FrameInfo candidate;
+		{
+			WriteLock lock( cam.lookaheadMutex );
+			if( !cam.hasLookahead )
+			{
+				cam.profiler.Increment( "lookahead_misses" );
+				return false;
+			}
+			candidate.Swap( cam.lookaheadFrame );
+			cam.hasLookahead = false;
+		}
+		cam.profiler.Increment( "keyframe_switches" );
+
+		if( ( current.time - candidate.time ).toSec() > _maxFrameDt )
+		{
+			ROS_INFO_STREAM( "Look-ahead keyframe is too old" );
+			return false;
+		}
+		if( !SetKeyFrame( cam, candidate ) ) { return false; }
+
+		// Continue the pose chain if the new keyframe was tracked within it
+		if( candidate.hasPose && candidate.chainId == cam.chainId )
+		{
+			cam.keyToOrigin = candidate.toOrigin;
+		}
+		else
+		{
+			++cam.chainId;
+			cam.keyToOrigin = PoseSE2();
+			cam.velPub->Reset( candidate.time );
+		}
+		return true;
+	}
+
+	// Makes a tracked frame the keyframe, keeping its surviving tracks and
+	// detecting new points only in grid cells that have emptied. This detects
+	// on the processing thread, since the surviving tracks are only valid for
+	// this frame, so a replenished frame is published later by the masked
+	// detection time. The grid and mask buffers are reused.
+	void ReplenishKeyFrame( CameraState& cam, const FrameInfo& current )
+	{
+		const unsigned int gridDim = _replenishGridDim;
+		const int width = current.frame.cols;
+		const int height = current.frame.rows;
+
+		std::vector<bool>& occupied = cam.replenishOccupied;
+		occupied.assign( gridDim * gridDim, false );
+		for( unsigned int i = 0; i < current.points.size(); ++i )
+		{
+			int c = std::floor( current.points[i].x * gridDim / width );
+			int r = std::floor( current.points[i].y * gridDim / height );
+			if( c < 0 || r < 0 || c >= (int) gridDim || r >= (int) gridDim ) { continue; }
+			occupied[r * gridDim + c] = true;
+		}
+
+		cv::Mat& mask = cam.replenishMask;
+		mask.create( current.frame.size(), CV_8U );
+		mask.setTo( cv::Scalar( 0 ) );
+		unsigned int numEmpty = 0;
+		for( unsigned int r = 0; r < gridDim; ++r )
+		{
+			for( unsigned int c = 0; c < gridDim; ++c )
+			{
+				if( occupied[r * gridDim + c] ) { continue; }
+				cv::Rect cell( c * width / gridDim, r * height / gridDim, 0, 0 );
+				cell.width = ( c + 1 ) * width / gridDim - cell.x;
+				cell.height = ( r + 1 ) * height / gridDim - cell.y;
+				mask( cell ).setTo( 255 );
+				++numEmpty;
+			}
+		}
+
+		// Keep new points away from existing tracks
+		int separation = std::round( (double) _replenishMinSeparation );
+		if( separation > 0 )
+		{
+			for( unsigned int i = 0; i < current.points.size(); ++i )
+			{
+				cv::circle( mask, current.points[i], separation, cv::Scalar( 0 ), -1 );
+			}
+		}
+
+		FrameInfo key = current;
+		if( numEmpty > 0 )
+		{
+			InterestPoints fresh;
+			{
+				PipelineProfiler::ScopedTimer timer( cam.profiler, "replenish_detection" );
+				WriteLock lock( cam.detectorMutex );
+				fresh = cam.detector->FindInterestPoints( current.frame, mask );
+			}
+			for( unsigned int i = 0; i < fresh.size(); ++i )
+			{
+				key.points.push_back( fresh[i] );
+				key.tracks.push_back( NewTrack( cam ) );
+			}
+		}
+
+		if( key.points.size() < _minNumKeypoints )
+		{
+			ROS_INFO_STREAM( "Only " << key.points.size() << " points after replenishing, "
+			                 << "keeping current keyframe" );
+			return;
+		}
+		// current may be the last frame, which SetKeyFrame overwrites
+		if( SetKeyFrame( cam, key ) )
+		{
+			cam.keyToOrigin = key.toOrigin;
+		}
+	}
+
+	static TrackInfo NewTrack( CameraState& cam )
+	{
+		TrackInfo track;
+		track.id = cam.nextTrackId++;
+		track.age = 0;
+		return track;
+	}
+
+	// Detects points on a camera's pending frame. Another job is queued if a
+	// newer frame was submitted meanwhile, so that detection does not hold a
+	// pool worker while other cameras wait.
+	void LookaheadDetect( const CameraStatePtr& cam )
+	{
+		FrameInfo frame;
+		{
+			WriteLock lock( cam->lookaheadMutex );
+			if( !cam->hasPending )
+			{
+				cam->detecting = false;
+				return;
+			}
+			frame.Swap( cam->pendingFrame );
+			cam->hasPending = false;
+		}
+
+		{
+			PipelineProfiler::ScopedTimer timer( cam->profiler, "detection" );
+			WriteLock lock( cam->detectorMutex );
+			frame.points = cam->detector->FindInterestPoints( frame.frame );
+		}
+		cam->profiler.Increment( "detected_points", frame.points.size() );
+
+		WriteLock lock( cam->lookaheadMutex );
+		cam->lookaheadFrame.Swap( frame );
+		cam->hasLookahead = true;
+		if( cam->hasPending )
+		{
+			WorkerPool::Job job = boost::bind( &SparseVONode::LookaheadDetect, this, cam );
+			_workers.EnqueueJob( job );
+		}
+		else
+		{
+			cam->detecting = false;
+		}
+	}
+
+	void StatsCallback( const ros::TimerEvent& event )
+	{
+		diagnostic_msgs::DiagnosticArray msg;
+		msg.header.stamp = event.current_real;
+		for( unsigned int i = 0; i < _cameras.size(); ++i )
+		{
+			CameraState& cam = *_cameras[i];
+			std::string name = ros::this_node::getName();
+			if( !cam.name.empty() ) { name += "/" + cam.name; }
+			msg.status.push_back( cam.profiler.Report( name, cam.name ) );
+		}
+		_diagPub.publish( msg );
+	}
+
+	bool CheckInitialization( CameraState& cam, FrameInfo& current )
 	{
 		// Initialization catch
-		double timeSinceLastFrame = ( current.time - _lastFrame.time ).toSec();
-		if( _keyFrame.frame.empty() ||
+		double timeSinceLastFrame = ( current.time - cam.lastFrame.time ).toSec();
+		if( cam.keyFrame.frame.empty() ||
 		    timeSinceLastFrame > _maxFrameDt ||
-		    _keyFrame.points.size() < _minNumKeypoints )
+		    cam.keyFrame.points.size() < _minNumKeypoints )
 		{
 			return false;
 		}
 		return true;
 	}
 
-	bool PredictAndTrack( FrameInfo& current )
+	// Tracks the source frame's points into the current frame, where the source
+	// is either the keyframe or the last frame with points aligned to it.
+	// Keyframe points and tracks are reduced to the tracked points.
+	bool PredictAndTrack( CameraState& cam, FrameInfo& source, const PoseSE2& lastToSource,
+	                      InterestPointTracker& tracker, const char* stage,
+	                      FrameInfo& current )
 	{
 		// Track interest points into current frame
 		// TODO Scale
-		PoseSE2 disp = _predictor.PredictMotion( _lastFrame.time,
+		PipelineProfiler::ScopedTimer predictTimer( cam.profiler, "prediction" );
+		PoseSE2 disp = _predictor.PredictMotion( cam.lastFrame.time,
 		                                         current.time,
 		                                         current.frameId, // TODO
 		                                         1.0 );
-		PoseSE2 guessPose = _lastToKey * disp;
+		PoseSE2 guessPose = lastToSource * disp;
 
-		InterestPoints normPoints = UndistortAndNormalizePoints( current.points,
-		                                                         current.calibration );
-		InterestPoints transNormPoints = TransformPoints( normPoints, guessPose );
-		current.points = DistortAndUnnormalizePoints( transNormPoints,
-		                                              current.calibration );
+		// Seed the search with the source points moved by the predicted
+		// pose, which takes current undistorted image coordinates to source
+		// undistorted coordinates
+		UndistortPoints( source.points, source.calibration,
+		                 cam.pointTable.get(), cam.sourceUndist );
+		TransformPoints( cam.sourceUndist, guessPose.Inverse(), cam.seedUndist );
+		NormalizePoints( cam.seedUndist, current.calibration, cam.seedUndist );
+		DistortAndUnnormalizePoints( cam.seedUndist, current.calibration,
+		                             cam.pointTable.get(), current.points );
+		predictTimer.Stop();
 
 		size_t numCurrentPoints = current.points.size();
-		if( !_tracker->TrackInterestPoints( _keyFrame.frame, _keyFrame.points,
-		                                    current.frame, current.points ) )
+		std::vector<unsigned int>& inlierInds = cam.inlierInds;
+		PipelineProfiler::ScopedTimer trackTimer( cam.profiler, stage );
+		if( !tracker.TrackInterestPoints( source.frame, source.points,
+		                                  current.frame, current.points,
+		                                  inlierInds ) )
 		{
 			ROS_INFO_STREAM( "Tracking failed!" );
 			return false;
 		}
+		trackTimer.Stop();
+		if( &source != &cam.keyFrame )
+		{
+			CompactByIndices( cam.keyFrame.points, inlierInds );
+		}
+		CompactByIndices( cam.keyFrame.tracks, inlierInds );
+		cam.profiler.Increment( "tracked_points", current.points.size() );
 
 		// Failure if not enough inliers in tracking
 		size_t numTrackingInliers = current.points.size();
@@ -317,32 +939,38 @@ private:
 		return true;
 	}
 
-	bool EstimateMotion( FrameInfo& current, PoseSE2& pose )
+	// Estimates the pose of the current frame relative to the source frame
+	bool EstimateMotion( CameraState& cam, FrameInfo& source, FrameInfo& current,
+	                     PoseSE2& pose )
 	{
-		// Estimate motion between frames
-		InterestPoints normKey = UndistortAndNormalizePoints( _keyFrame.points,
-		                                                      _keyFrame.calibration );
-		InterestPoints currKey = UndistortAndNormalizePoints( current.points,
-		                                                      current.calibration );
-		std::vector<unsigned int> inlierInds;
-		if( !_estimator->EstimateMotion( _keyFrame.points,
-		                                 current.points,
-		                                 inlierInds,
-		                                 pose ) )
+		// Estimate motion between frames in undistorted image coordinates
+		UndistortPoints( source.points, source.calibration,
+		                 cam.pointTable.get(), cam.sourceUndist );
+		UndistortPoints( current.points, current.calibration,
+		                 cam.pointTable.get(), cam.currUndist );
+		std::vector<unsigned int>& inlierInds = cam.inlierInds;
+		PipelineProfiler::ScopedTimer timer( cam.profiler, "estimation" );
+		bool estimated = cam.estimator->EstimateMotion( cam.sourceUndist,
+		                                                cam.currUndist,
+		                                                inlierInds,
+		                                                pose );
+		timer.Stop();
+		unsigned int numIterations = cam.estimator->GetLastNumIterations();
+		if( numIterations > 0 ) { cam.profiler.Increment( "ransac_iterations", numIterations ); }
+		if( !estimated )
 		{
 			ROS_WARN_STREAM( "Could not estimate motion between frames." );
 			return false;
 		}
+		cam.profiler.Increment( "motion_inliers", inlierInds.size() );
 
-		InterestPoints keyInlier;
-		InterestPoints currInlier;
-		BOOST_FOREACH( unsigned int i, inlierInds )
+		CompactByIndices( cam.keyFrame.points, inlierInds );
+		CompactByIndices( cam.keyFrame.tracks, inlierInds );
+		CompactByIndices( current.points, inlierInds );
+		if( &source != &cam.keyFrame )
 		{
-			keyInlier.push_back( _keyFrame.points[i] );
-			currInlier.push_back( current.points[i] );
+			CompactByIndices( source.points, inlierInds );
 		}
-		_keyFrame.points = keyInlier;
-		current.points = currInlier;
 
 		// Check number of inliers
 		size_t numMotionInliers = current.points.size();
@@ -352,40 +980,48 @@ private:
 		{
 			ROS_INFO_STREAM( numMotionInliers << " inliers after motion estimation less than "
 			                                  << minMotionInliers << ". Resetting keyframe." );
-			SetKeyFrame( current );
 			return false;
 		}
 
-		// TODO Do we still want this logic?
-		// // Check if we need to redetect
-		// double inlierRatio = numMotionInliers / (double) _originalNumKeypoints;
-		// if( inlierRatio <= _redetectThresh )
-		// {
-		//  ROS_INFO_STREAM( _keyFrame.points.size() << " inliers less than "
-		//                                          << _redetectThresh * _originalNumKeypoints
-		//                                          << ". Resetting keyframe." );
-		// }
-
+		// Surviving tracks have been followed for one more frame
+		for( unsigned int i = 0; i < cam.keyFrame.tracks.size(); ++i )
+		{
+			++cam.keyFrame.tracks[i].age;
+		}
+		current.tracks = cam.keyFrame.tracks;
 		return true;
 	}
 
-	void SetKeyFrame( const FrameInfo& current )
+	// Sets a frame with already detected points as the keyframe
+	bool SetKeyFrame( CameraState& cam, const FrameInfo& current )
 	{
-		_keyFrame = current;
-		_keyFrame.points = _detector->FindInterestPoints( _keyFrame.frame );
-		_originalNumKeypoints = _keyFrame.points.size();
-		if( _originalNumKeypoints < _minNumKeypoints )
+		cam.keyFrame = current;
+		cam.originalNumKeypoints = cam.keyFrame.points.size();
+		if( cam.originalNumKeypoints < _minNumKeypoints )
 		{
-			ROS_INFO_STREAM( "Found " << _originalNumKeypoints << " keypoints, less than min: " <<
+			ROS_INFO_STREAM( "Found " << cam.originalNumKeypoints << " keypoints, less than min: " <<
 			                 (unsigned int) _minNumKeypoints );
-			_keyFrame.frame = cv::Mat();
-			_keyFrame.points.clear();
-			return;
+			cam.keyFrame.frame = cv::Mat();
+			cam.keyFrame.image.reset();
+			cam.keyFrame.points.clear();
+			cam.keyFrame.tracks.clear();
+			return false;
 		}
-		// ROS_INFO_STREAM( "Found " << _originalNumKeypoints << " keypoints in new keyframe" );
+		// ROS_INFO_STREAM( "Found " << cam.originalNumKeypoints << " keypoints in new keyframe" );
+		if( cam.keyFrame.tracks.size() != cam.keyFrame.points.size() )
+		{
+			cam.keyFrame.tracks.clear();
+			for( unsigned int i = 0; i < cam.keyFrame.points.size(); ++i )
+			{
+				cam.keyFrame.tracks.push_back( NewTrack( cam ) );
+			}
+		}
+		cam.tracker->SetKeyFrame( cam.keyFrame.frame );
 
-		_lastFrame = _keyFrame;
-		_lastToKey = PoseSE2();
+		cam.lastFrame = cam.keyFrame;
+		cam.lastToKey = PoseSE2();
+		cam.framesSinceRefine = 0;
+		return true;
 	}
 };
 
@@ -1,75 +1,169 @@
 #include "odoflow/CornerPointDetector.h"
 #include "argus_utils/utils/ParamUtils.h"
 
+#include <boost/bind.hpp>
+
 namespace argus
 {
+CornerPointDetectorParams::CornerPointDetectorParams()
+	: maxNumPoints( 100 ),
+	minQuality( 0.05 ),
+	minSeparation( 0.02 ),
+	blockDim( 3 ),
+	useHarris( false ),
+	harrisK( 0.04 ),
+	enableRefine( true ),
+	refineWindowDim( 3 ),
+	refineZeroDim( -1 ),
+	refineMaxIters( 5 ),
+	refineMinLogEps( -4 ) {}
+
+std::ostream& operator<<( std::ostream& os, const CornerPointDetectorParams& params )
+{
+	os << "max num points: " << params.maxNumPoints << std::endl;
+	os << "min quality: " << params.minQuality << std::endl;
+	os << "min separation: " << params.minSeparation << std::endl;
+	os << "block dim: " << params.blockDim << std::endl;
+	os << "use harris: " << params.useHarris << std::endl;
+	os << "harris k: " << params.harrisK << std::endl;
+	os << "enable refine: " << params.enableRefine << std::endl;
+	os << "refine window dim: " << params.refineWindowDim << std::endl;
+	os << "refine zero dim: " << params.refineZeroDim << std::endl;
+	os << "refine max iters: " << params.refineMaxIters << std::endl;
+	os << "refine min log eps: " << params.refineMinLogEps;
+	return os;
+}
+
+CornerPointDetector::CornerPointDetector( const CornerPointDetectorParams& params )
+{
+	SetParams( params );
+}
+
 CornerPointDetector::CornerPointDetector( ros::NodeHandle& nh, ros::NodeHandle& ph )
-	: InterestPointDetector( nh, ph )
 {
-	_featureMaxPoints.InitializeAndRead( ph, 100, "max_num_points", "Maximum number of points to find" );
+	CornerPointDetectorParams defaults;
+
+	_featureMaxPoints.InitializeAndRead( ph, defaults.maxNumPoints, "max_num_points", "Maximum number of points to find" );
 	_featureMaxPoints.AddCheck<GreaterThan>( 0 );
 	_featureMaxPoints.AddCheck<IntegerValued>( ROUND_CEIL );
 
-	_featureMinQuality.InitializeAndRead( ph, 0.05, "min_quality", "Minimum feature quality threshold" );
+	_featureMinQuality.InitializeAndRead( ph, defaults.minQuality, "min_quality", "Minimum feature quality threshold" );
 	_featureMinQuality.AddCheck<GreaterThan>( 0 );
 
-	_featureMinSeparation.InitializeAndRead( ph, 10.0, "min_separation", "Minimum feature separation (normalized)" );
+	_featureMinSeparation.InitializeAndRead( ph, defaults.minSeparation, "min_separation", "Minimum feature separation (normalized)" );
 	_featureMinSeparation.AddCheck<GreaterThanOrEqual>( 0 );
 	_featureMinSeparation.AddCheck<LessThanOrEqual>( 1.0 );
 
-	_featureBlockDim.InitializeAndRead( ph, 3, "block_dim", "Feature covariation computation window size (pix)" );
+	_featureBlockDim.InitializeAndRead( ph, defaults.blockDim, "block_dim", "Feature covariation computation window size (pix)" );
 	_featureBlockDim.AddCheck<GreaterThan>( 0 );
 	_featureBlockDim.AddCheck<IntegerValued>( ROUND_CEIL );
 
-	_useHarris.InitializeAndRead( ph, false, "use_harris", "Usage of Harris corner detector" );
+	_useHarris.InitializeAndRead( ph, defaults.useHarris, "use_harris", "Usage of Harris corner detector" );
 
-	_harrisK.InitializeAndRead( ph, 0.04, "harris_k", "Harris k value" );
+	_harrisK.InitializeAndRead( ph, defaults.harrisK, "harris_k", "Harris k value" );
 	_harrisK.AddCheck<GreaterThanOrEqual>( 0 );
 
-	_enableRefine.InitializeAndRead( ph, true, "enable_refinement", "Enable subpixel feature refinement" );
+	_enableRefine.InitializeAndRead( ph, defaults.enableRefine, "enable_refinement", "Enable subpixel feature refinement" );
 
-	_refineWindowDim.InitializeAndRead( ph, 3, "refine_window_dim", "Refinement search window half-dim (pix)" );
+	_refineWindowDim.InitializeAndRead( ph, defaults.refineWindowDim, "refine_window_dim", "Refinement search window half-dim (pix)" );
 	_refineWindowDim.AddCheck<GreaterThan>( 0 );
 	_refineWindowDim.AddCheck<IntegerValued>( ROUND_CEIL );
 
-	_refineZeroDim.InitializeAndRead( ph, -1, "refine_zero_dim", "Refinement zero window half-dim (pix)" );
-	_refineWindowDim.AddCheck<GreaterThanOrEqual>( -1 );
-	_refineWindowDim.AddCheck<IntegerValued>( ROUND_CLOSEST );
+	_refineZeroDim.InitializeAndRead( ph, defaults.refineZeroDim, "refine_zero_dim", "Refinement zero window half-dim (pix)" );
+	_refineZeroDim.AddCheck<GreaterThanOrEqual>( -1 );
+	_refineZeroDim.AddCheck<IntegerValued>( ROUND_CLOSEST );
 
-	_refineMaxIters.InitializeAndRead( ph, 5, "refine_max_iters", "Maximum number of refinement iterations" );
+	_refineMaxIters.InitializeAndRead( ph, defaults.refineMaxIters, "refine_max_iters", "Maximum number of refinement iterations" );
 	_refineMaxIters.AddCheck<GreaterThan>( 0 );
 	_refineMaxIters.AddCheck<IntegerValued>( ROUND_CEIL );
 
-	_refineMinLogEps.InitializeAndRead( ph, -4, "refine_min_log_eps", "Minimum refinement iteration log10 improvement" );
+	_refineMinLogEps.InitializeAndRead( ph, defaults.refineMinLogEps, "refine_min_log_eps", "Minimum refinement iteration log10 improvement" );
+
+	ReadParams();
+	NumericParam::Callback numCb = boost::bind( &CornerPointDetector::ReadParams, this );
+	BooleanParam::Callback boolCb = boost::bind( &CornerPointDetector::ReadParams, this );
+	_featureMaxPoints.AddCallback( numCb );
+	_featureMinQuality.AddCallback( numCb );
+	_featureMinSeparation.AddCallback( numCb );
+	_featureBlockDim.AddCallback( numCb );
+	_useHarris.AddCallback( boolCb );
+	_harrisK.AddCallback( numCb );
+	_enableRefine.AddCallback( boolCb );
+	_refineWindowDim.AddCallback( numCb );
+	_refineZeroDim.AddCallback( numCb );
+	_refineMaxIters.AddCallback( numCb );
+	_refineMinLogEps.AddCallback( numCb );
+}
+
+void CornerPointDetector::ReadParams()
+{
+	CornerPointDetectorParams params;
+	params.maxNumPoints = _featureMaxPoints;
+	params.minQuality = _featureMinQuality;
+	params.minSeparation = _featureMinSeparation;
+	params.blockDim = _featureBlockDim;
+	params.useHarris = _useHarris;
+	params.harrisK = _harrisK;
+	params.enableRefine = _enableRefine;
+	params.refineWindowDim = _refineWindowDim;
+	params.refineZeroDim = _refineZeroDim;
+	params.refineMaxIters = _refineMaxIters;
+	params.refineMinLogEps = _refineMinLogEps;
+	SetParams( params );
+}
+
+void CornerPointDetector::SetParams( const CornerPointDetectorParams& params )
+{
+	if( params.maxNumPoints == 0 || params.blockDim == 0 ||
+	    params.refineWindowDim == 0 || params.refineMaxIters == 0 )
+	{
+		throw std::invalid_argument( "CornerPointDetector: Point count, block dim, and refinement window and iterations must be positive." );
+	}
+
+	WriteLock lock( _mutex );
+	_params = params;
+}
+
+CornerPointDetectorParams CornerPointDetector::GetParams() const
+{
+	ReadLock lock( _mutex );
+	return _params;
 }
 
 InterestPoints CornerPointDetector::FindInterestPoints( const cv::Mat& image )
+{
+	return FindInterestPoints( image, cv::Mat() );
+}
+
+InterestPoints CornerPointDetector::FindInterestPoints( const cv::Mat& image,
+                                                        const cv::Mat& mask )
 {
 	InterestPoints points;
 	if( image.empty() ) { return points; }
 
+	CornerPointDetectorParams params = GetParams();
 	double imageScale = ( image.size().width + image.size().height ) * 0.5;
-	double separation = _featureMinSeparation * imageScale;
+	double separation = params.minSeparation * imageScale;
 	cv::goodFeaturesToTrack( image,
 	                         points,
-	                         _featureMaxPoints,
-	                         _featureMinQuality,
+	                         params.maxNumPoints,
+	                         params.minQuality,
 	                         separation,
-	                         cv::noArray(),
-	                         _featureBlockDim,
-	                         _useHarris,
-	                         _harrisK );
+	                         mask,
+	                         params.blockDim,
+	                         params.useHarris,
+	                         params.harrisK );
 
 	if( points.size() == 0 ) { return points; }
 
 	// TODO Subpixel refinement
-	if( _enableRefine )
+	if( params.enableRefine )
 	{
-		cv::Size refineWindowSize( _refineWindowDim, _refineWindowDim );
-		cv::Size refineZeroSize( _refineZeroDim, _refineZeroDim );
+		cv::Size refineWindowSize( params.refineWindowDim, params.refineWindowDim );
+		cv::Size refineZeroSize( params.refineZeroDim, params.refineZeroDim );
 		cv::TermCriteria refineCriteria( cv::TermCriteria::COUNT | cv::TermCriteria::EPS,
-		                                 _refineMaxIters,
-		                                 std::pow( 10, _refineMinLogEps ) );
+		                                 params.refineMaxIters,
+		                                 std::pow( 10, params.refineMinLogEps ) );
 		cv::cornerSubPix( image, points, refineWindowSize, refineZeroSize, refineCriteria );
 	}
 
@@ -5,18 +5,171 @@
 
 #include <opencv2/video/tracking.hpp>
 
+#include <boost/bind.hpp>
+
+// Max number of keyframe masks cached without a call to SetKeyFrame
+#define ECC_MAX_CACHED_MASKS (8)
+
 namespace argus
 {
+ECCDenseTrackerParams::ECCDenseTrackerParams()
+	: logMinEpsilon( -3 ),
+	maxIters( 50 ),
+	logMinCorrelation( -2.0 ),
+	selectionRatio( 1.0 ),
+	selectionCellDim( 16 ),
+	selectionMinGradient( 2.0 ) {}
+
+std::ostream& operator<<( std::ostream& os, const ECCDenseTrackerParams& params )
+{
+	os << "log min epsilon: " << params.logMinEpsilon << std::endl;
+	os << "max iters: " << params.maxIters << std::endl;
+	os << "log min correlation: " << params.logMinCorrelation << std::endl;
+	os << "selection ratio: " << params.selectionRatio << std::endl;
+	os << "selection cell dim: " << params.selectionCellDim << std::endl;
+	os << "selection min gradient: " << params.selectionMinGradient;
+	return os;
+}
+
+ECCDenseTracker::ECCDenseTracker( const ECCDenseTrackerParams& params )
+{
+	SetParams( params );
+}
+
 ECCDenseTracker::ECCDenseTracker( ros::NodeHandle& nh, ros::NodeHandle& ph )
 {
-	_logMinEps.InitializeAndRead( ph, -3, "log_min_eps",
+	ECCDenseTrackerParams defaults;
+
+	_logMinEps.InitializeAndRead( ph, defaults.logMinEpsilon, "log_min_eps",
 	                              "Log10 minimum solver tolerance" );
-	_maxIters.InitializeAndRead( ph, 50, "max_iters",
+	_maxIters.InitializeAndRead( ph, defaults.maxIters, "max_iters",
 	                             "Maximum solver iterations" );
 	_maxIters.AddCheck<GreaterThan>( 0 );
-	_logMinCorrelation.InitializeAndRead( ph, -2.0, "log_min_correlation",
+	_logMinCorrelation.InitializeAndRead( ph, defaults.logMinCorrelation, "log_min_correlation",
 	                                      "log10 of 1.0 - minimum solution correlation" );
 	_logMinCorrelation.AddCheck<LessThan>( std::log10( 1.0 ) );
+
+	_selectionRatio.InitializeAndRead( ph, defaults.selectionRatio, "selection_ratio",
+	                                   "Ratio of highest-gradient keyframe pixels to use, 1 for all" );
+	_selectionRatio.AddCheck<GreaterThan>( 0 );
+	_selectionRatio.AddCheck<LessThanOrEqual>( 1.0 );
+	_selectionCellDim.InitializeAndRead( ph, defaults.selectionCellDim, "selection_cell_dim",
+	                                     "Side length in pixels of the pixel selection grid cells" );
+	_selectionCellDim.AddCheck<IntegerValued>();
+	_selectionCellDim.AddCheck<GreaterThan>( 0 );
+	_selectionMinGradient.InitializeAndRead( ph, defaults.selectionMinGradient, "selection_min_gradient",
+	                                         "Minimum gradient magnitude of selected pixels" );
+	_selectionMinGradient.AddCheck<GreaterThanOrEqual>( 0 );
+
+	ReadParams();
+	NumericParam::Callback cb = boost::bind( &ECCDenseTracker::ReadParams, this );
+	_logMinEps.AddCallback( cb );
+	_maxIters.AddCallback( cb );
+	_logMinCorrelation.AddCallback( cb );
+	_selectionRatio.AddCallback( cb );
+	_selectionCellDim.AddCallback( cb );
+	_selectionMinGradient.AddCallback( cb );
+}
+
+void ECCDenseTracker::ReadParams()
+{
+	ECCDenseTrackerParams params;
+	params.logMinEpsilon = _logMinEps;
+	params.maxIters = _maxIters;
+	params.logMinCorrelation = _logMinCorrelation;
+	params.selectionRatio = _selectionRatio;
+	params.selectionCellDim = _selectionCellDim;
+	params.selectionMinGradient = _selectionMinGradient;
+	SetParams( params );
+}
+
+void ECCDenseTracker::SetParams( const ECCDenseTrackerParams& params )
+{
+	if( params.maxIters == 0 )
+	{
+		throw std::invalid_argument( "ECCDenseTracker: Max iterations must be positive." );
+	}
+	if( params.logMinCorrelation >= 0 )
+	{
+		throw std::invalid_argument( "ECCDenseTracker: Log min correlation must be negative." );
+	}
+	if( params.selectionRatio <= 0 || params.selectionRatio > 1.0 )
+	{
+		throw std::invalid_argument( "ECCDenseTracker: Selection ratio must be in (0, 1]." );
+	}
+	if( params.selectionCellDim == 0 )
+	{
+		throw std::invalid_argument( "ECCDenseTracker: Selection cell dim must be positive." );
+	}
+
+	WriteLock lock( _paramsMutex );
+	_params = params;
+}
+
+ECCDenseTrackerParams ECCDenseTracker::GetParams() const
+{
+	ReadLock lock( _paramsMutex );
+	return _params;
+}
+
+void ECCDenseTracker::SetKeyFrame( const std::vector<cv::Mat>& pyramid )
+{
+	ECCDenseTrackerParams params = GetParams();
+	_masks.clear();
+	_masks.resize( pyramid.size() );
+	for( unsigned int i = 0; i < pyramid.size(); ++i )
+	{
+		ComputeMask( pyramid[i], params, _masks[i] );
+	}
+}
+
+cv::Mat ECCDenseTracker::GetMask( const cv::Mat& image,
+                                  const ECCDenseTrackerParams& params )
+{
+	for( unsigned int i = 0; i < _masks.size(); ++i )
+	{
+		const cv::Mat& cached = _masks[i].image;
+		if( cached.data == image.data && cached.size() == image.size() &&
+		    cached.step == image.step )
+		{
+			if( !IsMaskCurrent( _masks[i], params ) )
+			{
+				ComputeMask( image, params, _masks[i] );
+			}
+			return _masks[i].mask;
+		}
+	}
+
+	if( _masks.size() >= ECC_MAX_CACHED_MASKS ) { _masks.clear(); }
+	_masks.emplace_back();
+	ComputeMask( image, params, _masks.back() );
+	return _masks.back().mask;
+}
+
+bool ECCDenseTracker::IsMaskCurrent( const LevelMask& level,
+                                     const ECCDenseTrackerParams& params ) const
+{
+	return level.selectionRatio == params.selectionRatio &&
+	       level.selectionCellDim == params.selectionCellDim &&
+	       level.selectionMinGradient == params.selectionMinGradient;
+}
+
+void ECCDenseTracker::ComputeMask( const cv::Mat& image,
+                                   const ECCDenseTrackerParams& params,
+                                   LevelMask& level ) const
+{
+	level.image = image;
+	level.selectionRatio = params.selectionRatio;
+	level.selectionCellDim = params.selectionCellDim;
+	level.selectionMinGradient = params.selectionMinGradient;
+	level.mask = cv::Mat();
+	if( level.selectionRatio >= 1.0 ) { return; }
+
+	std::vector<cv::Point> pixels;
+	SelectGradientPixels( image, level.selectionCellDim, level.selectionRatio,
+	                      level.selectionMinGradient, pixels );
+	if( pixels.empty() ) { return; }
+	level.mask = PixelsToMask( pixels, image.size() );
 }
 
 bool ECCDenseTracker::TrackImages( const cv::Mat& to,
@@ -28,16 +181,21 @@ bool ECCDenseTracker::TrackImages( const cv::Mat& to,
 	cv::Mat warp = cv::Mat::zeros( 2, 3, CV_32F );
 	EigenToMat<float>( HinitR, warp );
 
+	ECCDenseTrackerParams params = GetParams();
 	cv::TermCriteria termCriteria( cv::TermCriteria::COUNT | cv::TermCriteria::EPS,
-	                               _maxIters,
-	                               std::pow( 10, _logMinEps ) );
+	                               params.maxIters,
+	                               std::pow( 10, params.logMinEpsilon ) );
+
+	// The mask applies to the input image, which is the keyframe here
+	cv::Mat mask = GetMask( to, params );
 
 	try
 	{
 		double ecc = cv::findTransformECC( from, to, warp,
 		                                   cv::MOTION_EUCLIDEAN,
-		                                   termCriteria );
-		double minECC = 1.0 - std::pow( 10, _logMinCorrelation );
+		                                   termCriteria,
+		                                   mask );
+		double minECC = 1.0 - std::pow( 10, params.logMinCorrelation );
 		if( ecc < minECC )
 		{
 			ROS_INFO_STREAM( "Correlation " << ecc << " less than min " << minECC );
@@ -1,31 +1,88 @@
 #include "odoflow/FASTPointDetector.h"
 #include "argus_utils/utils/ParamUtils.h"
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <opencv2/features2d.hpp>
 #include <iostream>
 
 namespace argus
 {
+FASTPointDetectorParams::FASTPointDetectorParams()
+	: intensityThreshold( 50 ),
+	enableNMS( true ),
+	maxNumPoints( 255 ),
+	detectorType( "FAST_7_12" ) {}
+
+std::ostream& operator<<( std::ostream& os, const FASTPointDetectorParams& params )
+{
+	os << "intensity threshold: " << params.intensityThreshold << std::endl;
+	os << "enable NMS: " << params.enableNMS << std::endl;
+	os << "max num points: " << params.maxNumPoints << std::endl;
+	os << "detector type: " << params.detectorType;
+	return os;
+}
+
+FASTPointDetector::FASTPointDetector( const FASTPointDetectorParams& params )
+{
+	SetParams( params );
+}
+
 FASTPointDetector::FASTPointDetector( ros::NodeHandle& nh, ros::NodeHandle& ph )
-	: InterestPointDetector( nh, ph )
 {
-	_intensityThreshold.InitializeAndRead( ph, 50, "intensity_threshold",
+	FASTPointDetectorParams defaults;
+
+	_intensityThreshold.InitializeAndRead( ph, defaults.intensityThreshold, "intensity_threshold",
 	                                       "Minimum central pixel intensity difference" );
 	_intensityThreshold.AddCheck<GreaterThanOrEqual>( 0 );
 	_intensityThreshold.AddCheck<LessThanOrEqual>( 255 );
 	_intensityThreshold.AddCheck<IntegerValued>( ROUND_CLOSEST );
 
-	_enableNMS.InitializeAndRead( ph, true, "enable_nonmax_suppression",
+	_enableNMS.InitializeAndRead( ph, defaults.enableNMS, "enable_nonmax_suppression",
 	                              "Usage of non-maximum suppression" );
 
-	_maxNumPoints.InitializeAndRead( ph, 255, "max_num_points",
+	_maxNumPoints.InitializeAndRead( ph, defaults.maxNumPoints, "max_num_points",
 	                                 "Maximum number of points to find" );
 	_maxNumPoints.AddCheck<GreaterThanOrEqual>( 0 );
 	_maxNumPoints.AddCheck<IntegerValued>( ROUND_CEIL );
 
-	_detectorType.InitializeAndRead( ph, "FAST_7_12", "detector_type",
+	_detectorType.InitializeAndRead( ph, defaults.detectorType, "detector_type",
 	                                 "FAST detector type" );
+
+	ReadParams();
+	_intensityThreshold.AddCallback( boost::bind( &FASTPointDetector::ReadParams, this ) );
+	_enableNMS.AddCallback( boost::bind( &FASTPointDetector::ReadParams, this ) );
+	_maxNumPoints.AddCallback( boost::bind( &FASTPointDetector::ReadParams, this ) );
+	_detectorType.AddCallback( boost::bind( &FASTPointDetector::ReadParams, this ) );
+}
+
+void FASTPointDetector::ReadParams()
+{
+	FASTPointDetectorParams params;
+	params.intensityThreshold = _intensityThreshold;
+	params.enableNMS = _enableNMS;
+	params.maxNumPoints = _maxNumPoints;
+	params.detectorType = _detectorType.GetValue();
+	SetParams( params );
+}
+
+void FASTPointDetector::SetParams( const FASTPointDetectorParams& params )
+{
+	if( params.intensityThreshold < 0 || params.intensityThreshold > 255 )
+	{
+		throw std::invalid_argument( "FASTPointDetector: Intensity threshold must be in [0, 255]." );
+	}
+	int type = StringToDetector( params.detectorType );
+
+	WriteLock lock( _mutex );
+	_params = params;
+	_type = type;
+}
+
+FASTPointDetectorParams FASTPointDetector::GetParams() const
+{
+	ReadLock lock( _mutex );
+	return _params;
 }
 
 /*! \brief Comparator used for sorting keypoints by responses
@@ -37,17 +94,25 @@ bool CompareKeypoints( const cv::KeyPoint& a, const cv::KeyPoint& b )
 
 InterestPoints FASTPointDetector::FindInterestPoints( const cv::Mat& image )
 {
+	FASTPointDetectorParams params;
+	int type;
+	{
+		ReadLock lock( _mutex );
+		params = _params;
+		type = _type;
+	}
+
 	std::vector<cv::KeyPoint> keypoints;
 	cv::FAST( image,
 	          keypoints,
-	          _intensityThreshold,
-	          _enableNMS,
-	          StringToDetector( _detectorType ) );
+	          params.intensityThreshold,
+	          params.enableNMS,
+	          type );
 
 	std::sort( keypoints.begin(), keypoints.end(), CompareKeypoints );
 
 	InterestPoints points;
-	unsigned int toCopy = std::min( keypoints.size(), (size_t) _maxNumPoints.GetValue() );
+	unsigned int toCopy = std::min( keypoints.size(), (size_t) params.maxNumPoints );
 	points.reserve( toCopy );
 	for( unsigned int i = 0; i < toCopy; i++ )
 	{
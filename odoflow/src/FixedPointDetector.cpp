@@ -1,31 +1,74 @@
 #include "odoflow/FixedPointDetector.h"
 #include "argus_utils/utils/ParamUtils.h"
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <iostream>
 #include <sstream>
 
 namespace argus
 {
+FixedPointDetectorParams::FixedPointDetectorParams()
+	: gridDim( 30 ) {}
+
+std::ostream& operator<<( std::ostream& os, const FixedPointDetectorParams& params )
+{
+	os << "grid dim: " << params.gridDim;
+	return os;
+}
+
+FixedPointDetector::FixedPointDetector( const FixedPointDetectorParams& params )
+	: _cachedGridSize( 0, 0 )
+{
+	SetParams( params );
+}
+
 FixedPointDetector::FixedPointDetector( ros::NodeHandle& nh, ros::NodeHandle& ph )
-	: InterestPointDetector( nh, ph ), _cachedGridSize( 0, 0 )
+	: _cachedGridSize( 0, 0 )
 {
-	_gridDim.InitializeAndRead( ph, 30, "grid_dim",
+	FixedPointDetectorParams defaults;
+	_gridDim.InitializeAndRead( ph, defaults.gridDim, "grid_dim",
 	                            "Interest point grid width and height." );
 	_gridDim.AddCheck<GreaterThan>( 1 );
 	_gridDim.AddCheck<IntegerValued>( ROUND_CEIL );
 
-	UpdateInterestPoints();
+	ReadParams();
+	_gridDim.AddCallback( boost::bind( &FixedPointDetector::ReadParams, this ) );
 }
 
-InterestPoints FixedPointDetector::FindInterestPoints( const cv::Mat& image )
+void FixedPointDetector::ReadParams()
+{
+	FixedPointDetectorParams params;
+	params.gridDim = _gridDim;
+	SetParams( params );
+}
+
+void FixedPointDetector::SetParams( const FixedPointDetectorParams& params )
 {
+	if( params.gridDim <= 1 )
+	{
+		throw std::invalid_argument( "FixedPointDetector: Grid dim must be greater than 1." );
+	}
+
+	WriteLock lock( _mutex );
+	_params = params;
 	UpdateInterestPoints();
+}
 
+FixedPointDetectorParams FixedPointDetector::GetParams() const
+{
+	ReadLock lock( _mutex );
+	return _params;
+}
+
+InterestPoints FixedPointDetector::FindInterestPoints( const cv::Mat& image )
+{
 	// NOTE We recompute the pixel coordinates using each image's size, as
 	// this might change
 	cv::Size imgSize = image.size();
 	InterestPoints scaledPoints;
+
+	ReadLock lock( _mutex );
 	scaledPoints.reserve( _cachedGrid.size() );
 
 	BOOST_FOREACH( const InterestPoint &point, _cachedGrid )
@@ -41,7 +84,7 @@ InterestPoints FixedPointDetector::FindInterestPoints( const cv::Mat& image )
  */
 void FixedPointDetector::UpdateInterestPoints()
 {
-	GridSize gridSize( _gridDim, _gridDim );
+	GridSize gridSize( _params.gridDim, _params.gridDim );
 
 	if( gridSize == _cachedGridSize ) { return; }
 
@@ -0,0 +1,284 @@
+#include "odoflow/GridPointDetector.h"
+#include "odoflow/FASTPointDetector.h"
+#include "argus_utils/utils/ParamUtils.h"
+
+#include <boost/bind.hpp>
+#include <opencv2/features2d.hpp>
+#include <algorithm>
+
+// Border required around a pixel for the FAST circle test
+#define GRID_FAST_BORDER (3)
+
+namespace argus
+{
+static bool compare_responses( const cv::KeyPoint& a, const cv::KeyPoint& b )
+{
+	return a.response > b.response;
+}
+
+/*! \brief Detects and selects points in a range of grid cells. Each cell
+ * writes only to its own output and threshold entries. Cells with no
+ * unmasked pixels are skipped.
+ */
+class GridDetectBody
+	: public cv::ParallelLoopBody
+{
+public:
+
+	GridDetectBody( const cv::Mat& image, const cv::Mat& mask,
+	                unsigned int rows, unsigned int cols,
+	                unsigned int perCell, int type, bool nms,
+	                double minThreshold, double maxThreshold, double adaptRate,
+	                std::vector<double>& thresholds,
+	                std::vector<InterestPoints>& cellPoints )
+		: _image( image ), _mask( mask ), _rows( rows ), _cols( cols ), _perCell( perCell ),
+		_type( type ), _nms( nms ), _minThreshold( minThreshold ),
+		_maxThreshold( maxThreshold ), _adaptRate( adaptRate ),
+		_thresholds( thresholds ), _cellPoints( cellPoints ) {}
+
+	virtual void operator()( const cv::Range& range ) const
+	{
+		std::vector<cv::KeyPoint> keypoints;
+		for( int i = range.start; i < range.end; ++i )
+		{
+			unsigned int r = i / _cols;
+			unsigned int c = i % _cols;
+			cv::Rect cell( c * _image.cols / _cols, r * _image.rows / _rows, 0, 0 );
+			cell.width = ( c + 1 ) * _image.cols / _cols - cell.x;
+			cell.height = ( r + 1 ) * _image.rows / _rows - cell.y;
+
+			InterestPoints& points = _cellPoints[i];
+			points.clear();
+			bool fullCell = true;
+			if( !_mask.empty() )
+			{
+				int numUnmasked = cv::countNonZero( _mask( cell ) );
+				if( numUnmasked == 0 ) { continue; }
+				fullCell = numUnmasked == cell.area();
+			}
+
+			// Pad the cell so that points near its edges can be tested, then keep
+			// only the points that lie inside the cell itself
+			cv::Rect padded( cell.x - GRID_FAST_BORDER, cell.y - GRID_FAST_BORDER,
+			                 cell.width + 2 * GRID_FAST_BORDER,
+			                 cell.height + 2 * GRID_FAST_BORDER );
+			padded &= cv::Rect( 0, 0, _image.cols, _image.rows );
+
+			keypoints.clear();
+			cv::FAST( _image( padded ), keypoints, (int) _thresholds[i], _nms, _type );
+
+			std::sort( keypoints.begin(), keypoints.end(), compare_responses );
+			unsigned int numFound = 0;
+			for( unsigned int j = 0; j < keypoints.size(); ++j )
+			{
+				cv::Point2f pt = keypoints[j].pt + cv::Point2f( padded.x, padded.y );
+				cv::Point px( pt.x, pt.y );
+				if( !cell.contains( px ) ) { continue; }
+				if( !fullCell && _mask.at<uchar>( px ) == 0 ) { continue; }
+				++numFound;
+				if( points.size() < _perCell ) { points.push_back( pt ); }
+			}
+
+			// Raise the threshold if the cell was saturated, and lower it if
+			// the cell came up short. Partially masked cells are not representative.
+			if( !fullCell ) { continue; }
+			double& threshold = _thresholds[i];
+			if( numFound > 2 * _perCell )
+			{
+				threshold = std::min( threshold * ( 1.0 + _adaptRate ), _maxThreshold );
+			}
+			else if( numFound < _perCell )
+			{
+				threshold = std::max( threshold * ( 1.0 - _adaptRate ), _minThreshold );
+			}
+		}
+	}
+
+private:
+
+	const cv::Mat& _image;
+	const cv::Mat& _mask;
+	unsigned int _rows;
+	unsigned int _cols;
+	unsigned int _perCell;
+	int _type;
+	bool _nms;
+	double _minThreshold;
+	double _maxThreshold;
+	double _adaptRate;
+	std::vector<double>& _thresholds;
+	std::vector<InterestPoints>& _cellPoints;
+};
+
+GridPointDetectorParams::GridPointDetectorParams()
+	: gridRows( 4 ),
+	gridCols( 4 ),
+	pointsPerCell( 16 ),
+	initialThreshold( 20 ),
+	minThreshold( 5 ),
+	maxThreshold( 100 ),
+	adaptRate( 0.2 ),
+	enableNMS( true ),
+	detectorType( "FAST_9_16" ) {}
+
+std::ostream& operator<<( std::ostream& os, const GridPointDetectorParams& params )
+{
+	os << "grid rows: " << params.gridRows << std::endl;
+	os << "grid cols: " << params.gridCols << std::endl;
+	os << "points per cell: " << params.pointsPerCell << std::endl;
+	os << "initial threshold: " << params.initialThreshold << std::endl;
+	os << "min threshold: " << params.minThreshold << std::endl;
+	os << "max threshold: " << params.maxThreshold << std::endl;
+	os << "adapt rate: " << params.adaptRate << std::endl;
+	os << "enable NMS: " << params.enableNMS << std::endl;
+	os << "detector type: " << params.detectorType;
+	return os;
+}
+
+GridPointDetector::GridPointDetector( const GridPointDetectorParams& params )
+{
+	SetParams( params );
+}
+
+GridPointDetector::GridPointDetector( ros::NodeHandle& nh, ros::NodeHandle& ph )
+{
+	GridPointDetectorParams defaults;
+
+	_gridRows.InitializeAndRead( ph, defaults.gridRows, "grid_rows", "Number of grid rows" );
+	_gridRows.AddCheck<GreaterThan>( 0 );
+	_gridRows.AddCheck<IntegerValued>( ROUND_CLOSEST );
+
+	_gridCols.InitializeAndRead( ph, defaults.gridCols, "grid_cols", "Number of grid columns" );
+	_gridCols.AddCheck<GreaterThan>( 0 );
+	_gridCols.AddCheck<IntegerValued>( ROUND_CLOSEST );
+
+	_pointsPerCell.InitializeAndRead( ph, defaults.pointsPerCell, "points_per_cell",
+	                                  "Maximum number of points to keep per cell" );
+	_pointsPerCell.AddCheck<GreaterThan>( 0 );
+	_pointsPerCell.AddCheck<IntegerValued>( ROUND_CEIL );
+
+	_initialThreshold.InitializeAndRead( ph, defaults.initialThreshold, "initial_threshold",
+	                                     "Initial cell central pixel intensity difference" );
+	_initialThreshold.AddCheck<GreaterThanOrEqual>( 0 );
+	_initialThreshold.AddCheck<LessThanOrEqual>( 255 );
+
+	_minThreshold.InitializeAndRead( ph, defaults.minThreshold, "min_threshold",
+	                                 "Minimum adapted cell intensity difference" );
+	_minThreshold.AddCheck<GreaterThanOrEqual>( 1 );
+	_minThreshold.AddCheck<LessThanOrEqual>( 255 );
+
+	_maxThreshold.InitializeAndRead( ph, defaults.maxThreshold, "max_threshold",
+	                                 "Maximum adapted cell intensity difference" );
+	_maxThreshold.AddCheck<GreaterThanOrEqual>( 1 );
+	_maxThreshold.AddCheck<LessThanOrEqual>( 255 );
+
+	_adaptRate.InitializeAndRead( ph, defaults.adaptRate, "adapt_rate",
+	                              "Fractional cell threshold change per detection" );
+	_adaptRate.AddCheck<GreaterThanOrEqual>( 0 );
+	_adaptRate.AddCheck<LessThan>( 1.0 );
+
+	_enableNMS.InitializeAndRead( ph, defaults.enableNMS, "enable_nonmax_suppression",
+	                              "Usage of non-maximum suppression" );
+
+	_detectorType.InitializeAndRead( ph, defaults.detectorType, "detector_type",
+	                                 "FAST detector type" );
+
+	ReadParams();
+	NumericParam::Callback numCb = boost::bind( &GridPointDetector::ReadParams, this );
+	_gridRows.AddCallback( numCb );
+	_gridCols.AddCallback( numCb );
+	_pointsPerCell.AddCallback( numCb );
+	_initialThreshold.AddCallback( numCb );
+	_minThreshold.AddCallback( numCb );
+	_maxThreshold.AddCallback( numCb );
+	_adaptRate.AddCallback( numCb );
+	_enableNMS.AddCallback( boost::bind( &GridPointDetector::ReadParams, this ) );
+	_detectorType.AddCallback( boost::bind( &GridPointDetector::ReadParams, this ) );
+}
+
+void GridPointDetector::ReadParams()
+{
+	GridPointDetectorParams params;
+	params.gridRows = _gridRows;
+	params.gridCols = _gridCols;
+	params.pointsPerCell = _pointsPerCell;
+	params.initialThreshold = _initialThreshold;
+	params.minThreshold = _minThreshold;
+	params.maxThreshold = _maxThreshold;
+	params.adaptRate = _adaptRate;
+	params.enableNMS = _enableNMS;
+	params.detectorType = _detectorType.GetValue();
+	SetParams( params );
+}
+
+void GridPointDetector::SetParams( const GridPointDetectorParams& params )
+{
+	if( params.gridRows == 0 || params.gridCols == 0 || params.pointsPerCell == 0 )
+	{
+		throw std::invalid_argument( "GridPointDetector: Grid dimensions and points per cell must be positive." );
+	}
+	if( params.adaptRate < 0 || params.adaptRate >= 1.0 )
+	{
+		throw std::invalid_argument( "GridPointDetector: Adapt rate must be in [0, 1)." );
+	}
+	int type = FASTPointDetector::StringToDetector( params.detectorType );
+
+	WriteLock lock( _mutex );
+	_params = params;
+	_type = type;
+}
+
+GridPointDetectorParams GridPointDetector::GetParams() const
+{
+	ReadLock lock( _mutex );
+	return _params;
+}
+
+InterestPoints GridPointDetector::FindInterestPoints( const cv::Mat& image )
+{
+	return FindInterestPoints( image, cv::Mat() );
+}
+
+InterestPoints GridPointDetector::FindInterestPoints( const cv::Mat& image,
+                                                      const cv::Mat& mask )
+{
+	InterestPoints points;
+	if( image.empty() ) { return points; }
+	if( !mask.empty() && ( mask.size() != image.size() || mask.type() != CV_8U ) )
+	{
+		throw std::invalid_argument( "GridPointDetector: Mask must be CV_8U and match the image size." );
+	}
+
+	WriteLock lock( _mutex );
+
+	unsigned int rows = std::min( (int) _params.gridRows, image.rows );
+	unsigned int cols = std::min( (int) _params.gridCols, image.cols );
+	unsigned int numCells = rows * cols;
+	double minThreshold = _params.minThreshold;
+	double maxThreshold = std::max( minThreshold, _params.maxThreshold );
+
+	// Restart adaptation if the grid changed
+	if( _thresholds.size() != numCells )
+	{
+		_thresholds.assign( numCells, _params.initialThreshold );
+	}
+	for( unsigned int i = 0; i < numCells; ++i )
+	{
+		_thresholds[i] = std::max( minThreshold, std::min( _thresholds[i], maxThreshold ) );
+	}
+
+	std::vector<InterestPoints> cellPoints( numCells );
+	GridDetectBody body( image, mask, rows, cols, _params.pointsPerCell,
+	                     _type, _params.enableNMS,
+	                     minThreshold, maxThreshold, _params.adaptRate,
+	                     _thresholds, cellPoints );
+	cv::parallel_for_( cv::Range( 0, numCells ), body );
+
+	points.reserve( numCells * _params.pointsPerCell );
+	for( unsigned int i = 0; i < numCells; ++i )
+	{
+		points.insert( points.end(), cellPoints[i].begin(), cellPoints[i].end() );
+	}
+	return points;
+}
+} // end namespace argus
@@ -0,0 +1,345 @@
+#include "odoflow/ICDenseTracker.h"
+#include "odoflow/OdoflowCommon.h"
+
+#include "camplex/FiducialCommon.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <limits>
+
+// Max number of keyframe levels cached without a call to SetKeyFrame
+#define IC_MAX_CACHED_LEVELS (8)
+
+namespace argus
+{
+// Sums for the Gauss-Newton step and the zero-mean normalized correlation
+struct ICAccumulator
+{
+	double b[3];
+	double Hinv[6]; // Hessian terms of pixels that fell outside the image
+	double n, sw, st, sww, stt, swt;
+
+	ICAccumulator()
+	{
+		std::fill( b, b + 3, 0.0 );
+		std::fill( Hinv, Hinv + 6, 0.0 );
+		n = sw = st = sww = stt = swt = 0;
+	}
+
+	void AddValid( const float* sd, float w, float t )
+	{
+		float e = w - t;
+		b[0] += sd[0] * e;
+		b[1] += sd[1] * e;
+		b[2] += sd[2] * e;
+		n += 1;
+		sw += w;
+		st += t;
+		sww += w * w;
+		stt += t * t;
+		swt += w * t;
+	}
+
+	void AddInvalid( const float* sd )
+	{
+		Hinv[0] += sd[0] * sd[0];
+		Hinv[1] += sd[0] * sd[1];
+		Hinv[2] += sd[0] * sd[2];
+		Hinv[3] += sd[1] * sd[1];
+		Hinv[4] += sd[1] * sd[2];
+		Hinv[5] += sd[2] * sd[2];
+	}
+};
+
+// Bilinearly samples a single-precision image, returning false if the
+// point does not lie entirely within the image
+static bool sample_bilinear( const cv::Mat& image, double x, double y, float& out )
+{
+	if( !( x >= 0 && y >= 0 ) ) { return false; }
+	int x0 = (int) x;
+	int y0 = (int) y;
+	if( x0 + 1 >= image.cols || y0 + 1 >= image.rows ) { return false; }
+	float ax = x - x0;
+	float ay = y - y0;
+	const float* r0 = image.ptr<float>( y0 ) + x0;
+	const float* r1 = image.ptr<float>( y0 + 1 ) + x0;
+	out = ( 1 - ay ) * ( ( 1 - ax ) * r0[0] + ax * r0[1] ) +
+	      ay * ( ( 1 - ax ) * r1[0] + ax * r1[1] );
+	return true;
+}
+
+ICDenseTracker::ICDenseTracker( ros::NodeHandle& nh, ros::NodeHandle& ph )
+{
+	_logMinEps.InitializeAndRead( ph, -3, "log_min_eps",
+	                              "Log10 minimum solver step size" );
+	_maxIters.InitializeAndRead( ph, 50, "max_iters",
+	                             "Maximum solver iterations" );
+	_maxIters.AddCheck<GreaterThan>( 0 );
+	_logMinCorrelation.InitializeAndRead( ph, -2.0, "log_min_correlation",
+	                                      "log10 of 1.0 - minimum solution correlation" );
+	_logMinCorrelation.AddCheck<LessThan>( std::log10( 1.0 ) );
+	_minValidRatio.InitializeAndRead( ph, 0.25, "min_valid_ratio",
+	                                  "Minimum ratio of template pixels that overlap the current frame" );
+	_minValidRatio.AddCheck<GreaterThan>( 0 );
+	_minValidRatio.AddCheck<LessThanOrEqual>( 1.0 );
+
+	_selectionRatio.InitializeAndRead( ph, 1.0, "selection_ratio",
+	                                   "Ratio of highest-gradient template pixels to use, 1 for all" );
+	_selectionRatio.AddCheck<GreaterThan>( 0 );
+	_selectionRatio.AddCheck<LessThanOrEqual>( 1.0 );
+	_selectionCellDim.InitializeAndRead( ph, 16, "selection_cell_dim",
+	                                     "Side length in pixels of the pixel selection grid cells" );
+	_selectionCellDim.AddCheck<IntegerValued>();
+	_selectionCellDim.AddCheck<GreaterThan>( 0 );
+	_selectionMinGradient.InitializeAndRead( ph, 2.0, "selection_min_gradient",
+	                                         "Minimum gradient magnitude of selected pixels" );
+	_selectionMinGradient.AddCheck<GreaterThanOrEqual>( 0 );
+}
+
+void ICDenseTracker::SetKeyFrame( const std::vector<cv::Mat>& pyramid )
+{
+	_levels.clear();
+	_levels.resize( pyramid.size() );
+	for( unsigned int i = 0; i < pyramid.size(); ++i )
+	{
+		ComputeLevel( pyramid[i], _levels[i] );
+	}
+}
+
+const ICDenseTracker::LevelCache& ICDenseTracker::GetLevel( const cv::Mat& image )
+{
+	for( unsigned int i = 0; i < _levels.size(); ++i )
+	{
+		const cv::Mat& cached = _levels[i].image;
+		if( cached.data == image.data && cached.size() == image.size() &&
+		    cached.step == image.step )
+		{
+			// Selection parameters may have been changed at runtime
+			if( !IsLevelCurrent( _levels[i] ) )
+			{
+				ComputeLevel( image, _levels[i] );
+			}
+			return _levels[i];
+		}
+	}
+
+	if( _levels.size() >= IC_MAX_CACHED_LEVELS ) { _levels.clear(); }
+	_levels.emplace_back();
+	ComputeLevel( image, _levels.back() );
+	return _levels.back();
+}
+
+bool ICDenseTracker::IsLevelCurrent( const LevelCache& level ) const
+{
+	return level.selectionRatio == _selectionRatio &&
+	       level.selectionCellDim == (unsigned int) _selectionCellDim &&
+	       level.selectionMinGradient == _selectionMinGradient;
+}
+
+void ICDenseTracker::ComputeLevel( const cv::Mat& image, LevelCache& level ) const
+{
+	level.image = image;
+	image.convertTo( level.templ, CV_32F );
+	level.center = cv::Point2d( 0.5 * ( image.cols - 1 ), 0.5 * ( image.rows - 1 ) );
+
+	cv::Mat gx, gy;
+	cv::Scharr( level.templ, gx, CV_32F, 1, 0, 1.0 / 32 );
+	cv::Scharr( level.templ, gy, CV_32F, 0, 1, 1.0 / 32 );
+
+	// Steepest descent images for the increment parameterized as
+	// (tx, ty, theta) with rotation about the image center
+	level.steepest.create( image.size(), CV_32FC3 );
+	double H[6] = { 0, 0, 0, 0, 0, 0 };
+	for( int y = 0; y < image.rows; ++y )
+	{
+		const float* gxRow = gx.ptr<float>( y );
+		const float* gyRow = gy.ptr<float>( y );
+		float* sdRow = level.steepest.ptr<float>( y );
+		float dy = y - level.center.y;
+		for( int x = 0; x < image.cols; ++x )
+		{
+			float dx = x - level.center.x;
+			float s0 = gxRow[x];
+			float s1 = gyRow[x];
+			float s2 = dx * s1 - dy * s0;
+			sdRow[3 * x] = s0;
+			sdRow[3 * x + 1] = s1;
+			sdRow[3 * x + 2] = s2;
+			H[0] += s0 * s0;
+			H[1] += s0 * s1;
+			H[2] += s0 * s2;
+			H[3] += s1 * s1;
+			H[4] += s1 * s2;
+			H[5] += s2 * s2;
+		}
+	}
+	level.hessian << H[0], H[1], H[2],
+	                 H[1], H[3], H[4],
+	                 H[2], H[4], H[5];
+
+	level.selectionRatio = _selectionRatio;
+	level.selectionCellDim = _selectionCellDim;
+	level.selectionMinGradient = _selectionMinGradient;
+	level.pixels.clear();
+	level.pixelTempl.clear();
+	level.pixelSteepest.clear();
+	if( level.selectionRatio >= 1.0 ) { return; }
+
+	// Gather the selected pixels contiguously and restrict the Hessian to them
+	SelectGradientPixels( image, level.selectionCellDim, level.selectionRatio,
+	                      level.selectionMinGradient, level.pixels );
+	level.pixelTempl.reserve( level.pixels.size() );
+	level.pixelSteepest.reserve( level.pixels.size() );
+	if( level.pixels.empty() ) { return; }
+
+	ICAccumulator acc;
+	for( unsigned int i = 0; i < level.pixels.size(); ++i )
+	{
+		const cv::Point& p = level.pixels[i];
+		level.pixelTempl.push_back( level.templ.at<float>( p ) );
+		level.pixelSteepest.push_back( level.steepest.at<cv::Vec3f>( p ) );
+		acc.AddInvalid( level.pixelSteepest.back().val );
+	}
+	level.hessian << acc.Hinv[0], acc.Hinv[1], acc.Hinv[2],
+	                 acc.Hinv[1], acc.Hinv[3], acc.Hinv[4],
+	                 acc.Hinv[2], acc.Hinv[4], acc.Hinv[5];
+}
+
+bool ICDenseTracker::TrackImages( const cv::Mat& to,
+                                  const cv::Mat& from,
+                                  PoseSE2& pose )
+{
+	const LevelCache& level = GetLevel( to );
+	if( from.size() != level.templ.size() )
+	{
+		ROS_WARN_STREAM( "ICDenseTracker: Image sizes do not match." );
+		return false;
+	}
+
+	cv::Mat image;
+	from.convertTo( image, CV_32F );
+
+	// Solve for the warp taking template (key) coordinates to image (current)
+	// coordinates, which is the inverse of the requested pose
+	FixedMatrixType<3, 3> W = pose.ToMatrix().inverse();
+
+	const double minStep = std::pow( 10, _logMinEps );
+	const unsigned int maxIters = _maxIters;
+	// A level with no selected pixels is tracked densely
+	const bool sparse = !level.pixels.empty();
+	const double minValid = _minValidRatio *
+	                        ( sparse ? level.pixels.size() : level.templ.total() );
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+
+	cv::Mat warp( 2, 3, CV_64F );
+	cv::Mat warped;
+	ICAccumulator acc;
+	for( unsigned int iter = 0; iter < maxIters; ++iter )
+	{
+		// Accumulate the steepest-descent residual over valid pixels, and remove
+		// invalid pixels from the precomputed Hessian
+		acc = ICAccumulator();
+		if( sparse )
+		{
+			// Sample the current frame at only the selected pixels
+			for( unsigned int i = 0; i < level.pixels.size(); ++i )
+			{
+				const cv::Point& p = level.pixels[i];
+				const float* sd = level.pixelSteepest[i].val;
+				double u = W( 0, 0 ) * p.x + W( 0, 1 ) * p.y + W( 0, 2 );
+				double v = W( 1, 0 ) * p.x + W( 1, 1 ) * p.y + W( 1, 2 );
+				float w;
+				if( sample_bilinear( image, u, v, w ) )
+				{
+					acc.AddValid( sd, w, level.pixelTempl[i] );
+				}
+				else
+				{
+					acc.AddInvalid( sd );
+				}
+			}
+		}
+		else
+		{
+			for( unsigned int i = 0; i < 2; ++i )
+			{
+				for( unsigned int j = 0; j < 3; ++j )
+				{
+					warp.at<double>( i, j ) = W( i, j );
+				}
+			}
+			// Pixels warped from outside the image are marked with NaN
+			cv::warpAffine( image, warped, warp, level.templ.size(),
+			                cv::INTER_LINEAR | cv::WARP_INVERSE_MAP,
+			                cv::BORDER_CONSTANT, cv::Scalar::all( nan ) );
+
+			for( int y = 0; y < warped.rows; ++y )
+			{
+				const float* wRow = warped.ptr<float>( y );
+				const float* tRow = level.templ.ptr<float>( y );
+				const float* sdRow = level.steepest.ptr<float>( y );
+				for( int x = 0; x < warped.cols; ++x )
+				{
+					const float* sd = sdRow + 3 * x;
+					if( std::isnan( wRow[x] ) ) { acc.AddInvalid( sd ); }
+					else { acc.AddValid( sd, wRow[x], tRow[x] ); }
+				}
+			}
+		}
+
+		if( acc.n < minValid )
+		{
+			ROS_INFO_STREAM( "ICDenseTracker: Only " << acc.n << " valid pixels, less than min " << minValid );
+			return false;
+		}
+
+		Eigen::Matrix3d H;
+		H << acc.Hinv[0], acc.Hinv[1], acc.Hinv[2],
+		     acc.Hinv[1], acc.Hinv[3], acc.Hinv[4],
+		     acc.Hinv[2], acc.Hinv[4], acc.Hinv[5];
+		H = level.hessian - H;
+		Eigen::Vector3d dp = H.ldlt().solve( Eigen::Vector3d( acc.b[0], acc.b[1], acc.b[2] ) );
+		if( !dp.allFinite() )
+		{
+			ROS_INFO_STREAM( "ICDenseTracker: Degenerate Hessian." );
+			return false;
+		}
+
+		// Compose with the inverse of the increment, which rotates about the center
+		double c = std::cos( dp( 2 ) );
+		double s = std::sin( dp( 2 ) );
+		FixedMatrixType<3, 3> dW = FixedMatrixType<3, 3>::Identity();
+		dW( 0, 0 ) = c;
+		dW( 0, 1 ) = -s;
+		dW( 1, 0 ) = s;
+		dW( 1, 1 ) = c;
+		dW( 0, 2 ) = dp( 0 ) + level.center.x - ( c * level.center.x - s * level.center.y );
+		dW( 1, 2 ) = dp( 1 ) + level.center.y - ( s * level.center.x + c * level.center.y );
+		W = W * dW.inverse();
+
+		// Rotation step is scaled by the image radius to compare with pixels
+		double radius = std::max( level.center.x, level.center.y );
+		double step = std::sqrt( dp( 0 ) * dp( 0 ) + dp( 1 ) * dp( 1 ) ) +
+		              std::abs( dp( 2 ) ) * radius;
+		if( step < minStep ) { break; }
+	}
+
+	// Zero-mean normalized correlation of the last evaluated warp
+	double varW = acc.sww - acc.sw * acc.sw / acc.n;
+	double varT = acc.stt - acc.st * acc.st / acc.n;
+	double cov = acc.swt - acc.sw * acc.st / acc.n;
+	double corr = ( varW > 0 && varT > 0 ) ? cov / std::sqrt( varW * varT ) : 0;
+	double minCorr = 1.0 - std::pow( 10, _logMinCorrelation );
+	if( corr < minCorr )
+	{
+		ROS_INFO_STREAM( "Correlation " << corr << " less than min " << minCorr );
+		return false;
+	}
+
+	FixedMatrixType<3, 3> Hout = W.inverse();
+	PoseSE2::Rotation R( 0 );
+	R.fromRotationMatrix( Hout.topLeftCorner<2, 2>() );
+	Translation2Type t( Hout( 0, 2 ), Hout( 1, 2 ) );
+	pose = PoseSE2( t, R );
+	return true;
+}
+}
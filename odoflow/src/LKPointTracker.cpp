@@ -1,91 +1,250 @@
 #include "odoflow/LKPointTracker.h"
 #include "argus_utils/utils/ParamUtils.h"
 
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
 #include <iostream>
 #include <sstream>
 
 namespace argus
 {
+LKPointTracker::PyramidCache::PyramidCache()
+	: hasDerivatives( false ) {}
+
+bool LKPointTracker::PyramidCache::Matches( const cv::Mat& img ) const
+{
+	return !pyramid.empty() && img.data == image.data &&
+	       img.size() == image.size() && img.step == image.step;
+}
+
+void LKPointTracker::PyramidCache::Clear()
+{
+	image = cv::Mat();
+	pyramid.clear();
+	hasDerivatives = false;
+}
+
+LKPointTrackerParams::LKPointTrackerParams()
+	: pyramidLevel( 0 ),
+	windowDim( 30 ),
+	logEigenThreshold( -4 ),
+	maxIters( 30 ),
+	logMinEpsilon( -3 ),
+	maxFlowError( 10 ) {}
+
+std::ostream& operator<<( std::ostream& os, const LKPointTrackerParams& params )
+{
+	os << "pyramid level: " << params.pyramidLevel << std::endl;
+	os << "window dim: " << params.windowDim << std::endl;
+	os << "log eigenvalue threshold: " << params.logEigenThreshold << std::endl;
+	os << "max iters: " << params.maxIters << std::endl;
+	os << "log min epsilon: " << params.logMinEpsilon << std::endl;
+	os << "max flow error: " << params.maxFlowError;
+	return os;
+}
+
+LKPointTracker::LKPointTracker( const LKPointTrackerParams& params )
+	: _cachedWindowDim( 0 ),
+	_cachedPyramidLevel( 0 )
+{
+	SetParams( params );
+}
+
 LKPointTracker::LKPointTracker( ros::NodeHandle& nh, ros::NodeHandle& ph )
-	: InterestPointTracker( nh, ph )
+	: _cachedWindowDim( 0 ),
+	_cachedPyramidLevel( 0 )
 {
-	_solverMaxIters.InitializeAndRead( ph, 30, "max_iters",
+	LKPointTrackerParams defaults;
+
+	_solverMaxIters.InitializeAndRead( ph, defaults.maxIters, "max_iters",
 	                                   "Lucas-Kanade solver max iterations." );
 	_solverMaxIters.AddCheck<GreaterThan>( 0 );
 	_solverMaxIters.AddCheck<IntegerValued>( ROUND_CEIL );
 
-	_solverMinLogEpsilon.InitializeAndRead( ph, -3, "log_min_eps",
+	_solverMinLogEpsilon.InitializeAndRead( ph, defaults.logMinEpsilon, "log_min_eps",
 	                                        "Lucas-Kande solver log10 min epsilon." );
 
-	_pyramidLevel.InitializeAndRead( ph, 0, "pyramid_level",
+	_pyramidLevel.InitializeAndRead( ph, defaults.pyramidLevel, "pyramid_level",
 	                                 "Lucas-Kanade max pyramid level." );
 	_pyramidLevel.AddCheck<GreaterThanOrEqual>( 0 );
 	_pyramidLevel.AddCheck<IntegerValued>( ROUND_CLOSEST );
 
 	// TODO Normalize to images size
-	_flowWindowDim.InitializeAndRead( ph, 30, "window_dim",
+	_flowWindowDim.InitializeAndRead( ph, defaults.windowDim, "window_dim",
 	                                  "Lucas-Kanade search window dim." );
 	_flowWindowDim.AddCheck<GreaterThanOrEqual>( 3 ); // OpenCV requirements
 	_flowWindowDim.AddCheck<IntegerValued>( ROUND_CLOSEST );
 
-	_logFlowEigenThreshold.InitializeAndRead( ph, -4, "log_flow_eigenvalue_threshold",
+	_logFlowEigenThreshold.InitializeAndRead( ph, defaults.logEigenThreshold, "log_flow_eigenvalue_threshold",
 	                                          "Lucas-Kanade spatial gradient log10 eigenvalue threshold." );
 
-	_maxFlowError.InitializeAndRead( ph, 10, "flow_error_threshold",
+	_maxFlowError.InitializeAndRead( ph, defaults.maxFlowError, "flow_error_threshold",
 	                                 "Lucas-Kanade max solution error threshold." );
 	_maxFlowError.AddCheck<GreaterThan>( 0 );
+
+	ReadParams();
+	NumericParam::Callback cb = boost::bind( &LKPointTracker::ReadParams, this );
+	_solverMaxIters.AddCallback( cb );
+	_solverMinLogEpsilon.AddCallback( cb );
+	_pyramidLevel.AddCallback( cb );
+	_flowWindowDim.AddCallback( cb );
+	_logFlowEigenThreshold.AddCallback( cb );
+	_maxFlowError.AddCallback( cb );
+}
+
+void LKPointTracker::ReadParams()
+{
+	LKPointTrackerParams params;
+	params.pyramidLevel = _pyramidLevel;
+	params.windowDim = _flowWindowDim;
+	params.logEigenThreshold = _logFlowEigenThreshold;
+	params.maxIters = _solverMaxIters;
+	params.logMinEpsilon = _solverMinLogEpsilon;
+	params.maxFlowError = _maxFlowError;
+	SetParams( params );
+}
+
+void LKPointTracker::SetParams( const LKPointTrackerParams& params )
+{
+	if( params.windowDim < 3 )
+	{
+		throw std::invalid_argument( "LKPointTracker: Window dim must be at least 3." );
+	}
+	if( params.maxIters == 0 )
+	{
+		throw std::invalid_argument( "LKPointTracker: Max iterations must be positive." );
+	}
+
+	WriteLock lock( _paramsMutex );
+	_params = params;
+}
+
+LKPointTrackerParams LKPointTracker::GetParams() const
+{
+	ReadLock lock( _paramsMutex );
+	return _params;
 }
 
 bool LKPointTracker::TrackInterestPoints( const cv::Mat& key,
                                           InterestPoints& keypoints,
                                           const cv::Mat& tar,
-                                          InterestPoints& tarpoints )
+                                          InterestPoints& tarpoints,
+                                          std::vector<unsigned int>& inlierInds )
 {
+	inlierInds.clear();
 	// Make sure we have points to track
 	if( key.empty() || tar.empty() || keypoints.empty() )
 	{
 		return false;
 	}
 
-	// OpenCV's Lucas-Kanade requires single-precision floating point
-	InterestPointsf keyPoints = DowncastInterestPoints( keypoints );
-	InterestPointsf targetPoints = DowncastInterestPoints( tarpoints );
-	if( targetPoints.empty() )
+	LKPointTrackerParams params = GetParams();
+	CheckCacheParameters( params );
+	if( !_keyCache.Matches( key ) ) { SetKeyFrame( key ); }
+	// The target cache is only kept for promotion to keyframe, since cached image
+	// data may have been released since the last call
+	BuildPyramid( tar, false, _tarCache );
+
+	if( tarpoints.empty() )
 	{
-		targetPoints = keyPoints;
+		tarpoints = keypoints;
 	}
 
 	cv::TermCriteria termCriteria = cv::TermCriteria( cv::TermCriteria::COUNT |
 	                                                  cv::TermCriteria::EPS,
-	                                                  _solverMaxIters,
-	                                                  std::pow( 10, _solverMinLogEpsilon ) );
-	std::vector<uchar> status;
-	std::vector<float> errors;
-	cv::calcOpticalFlowPyrLK( key,
-	                          tar,
-	                          keyPoints,
-	                          targetPoints,
-	                          status,
-	                          errors,
-	                          cv::Size( _flowWindowDim, _flowWindowDim ),
-	                          _pyramidLevel,
+	                                                  params.maxIters,
+	                                                  std::pow( 10, params.logMinEpsilon ) );
+	cv::calcOpticalFlowPyrLK( _keyCache.pyramid,
+	                          _tarCache.pyramid,
+	                          keypoints,
+	                          tarpoints,
+	                          _status,
+	                          _errors,
+	                          cv::Size( _cachedWindowDim, _cachedWindowDim ),
+	                          _cachedPyramidLevel,
 	                          termCriteria,
 	                          cv::OPTFLOW_USE_INITIAL_FLOW,
-	                          std::pow( 10, _logFlowEigenThreshold ) );
+	                          std::pow( 10, params.logEigenThreshold ) );
+
+	// Fold the error threshold into the status mask and compact in place
+	for( unsigned int i = 0; i < _status.size(); ++i )
+	{
+		_status[i] = _status[i] == 1 && _errors[i] < params.maxFlowError;
+		if( _status[i] ) { inlierInds.push_back( i ); }
+	}
+	CompactByMask( keypoints, _status );
+	CompactByMask( tarpoints, _status );
+
+	return !keypoints.empty();
+}
+
+void LKPointTracker::SetKeyFrame( const cv::Mat& key )
+{
+	CheckCacheParameters( GetParams() );
+	if( _keyCache.Matches( key ) ) { return; }
+
+	// Keyframes are usually promoted from the last tracked frame
+	if( _tarCache.Matches( key ) )
+	{
+		std::swap( _keyCache, _tarCache );
+		_tarCache.Clear();
+		AddDerivatives( _keyCache );
+	}
+	else
+	{
+		BuildPyramid( key, true, _keyCache );
+	}
+}
 
-	InterestPointsf keyInliers, targetInliers;
-	for( unsigned int i = 0; i < status.size(); ++i )
+void LKPointTracker::CheckCacheParameters( const LKPointTrackerParams& params )
+{
+	int windowDim = params.windowDim;
+	int pyramidLevel = params.pyramidLevel;
+	if( windowDim != _cachedWindowDim || pyramidLevel != _cachedPyramidLevel )
 	{
-		if( status[i] == 1 && errors[i] < _maxFlowError )
-		{
-			keyInliers.push_back( keyPoints[i] );
-			targetInliers.push_back( targetPoints[i] );
-		}
+		_keyCache.Clear();
+		_tarCache.Clear();
+		_cachedWindowDim = windowDim;
+		_cachedPyramidLevel = pyramidLevel;
 	}
+}
 
-	keypoints = UpcastInterestPoints( keyInliers );
-	tarpoints = UpcastInterestPoints( targetInliers );
+void LKPointTracker::BuildPyramid( const cv::Mat& image, bool withDerivatives,
+                                   PyramidCache& cache )
+{
+	cache.image = image;
+	cache.hasDerivatives = withDerivatives;
+	cv::buildOpticalFlowPyramid( image,
+	                             cache.pyramid,
+	                             cv::Size( _cachedWindowDim, _cachedWindowDim ),
+	                             _cachedPyramidLevel,
+	                             withDerivatives );
+}
+
+void LKPointTracker::AddDerivatives( PyramidCache& cache )
+{
+	if( cache.hasDerivatives ) { return; }
 
-	return !keyPoints.empty();
+	// Matches the interleaved, zero-padded layout of cv::buildOpticalFlowPyramid
+	std::vector<cv::Mat> interleaved;
+	interleaved.reserve( 2 * cache.pyramid.size() );
+	cv::Mat dx, dy, deriv, padded;
+	BOOST_FOREACH( const cv::Mat& level, cache.pyramid )
+	{
+		cv::Scharr( level, dx, CV_16S, 1, 0 );
+		cv::Scharr( level, dy, CV_16S, 0, 1 );
+		cv::Mat channels[2] = { dx, dy };
+		cv::merge( channels, 2, deriv );
+		cv::copyMakeBorder( deriv, padded,
+		                    _cachedWindowDim, _cachedWindowDim,
+		                    _cachedWindowDim, _cachedWindowDim,
+		                    cv::BORDER_CONSTANT | cv::BORDER_ISOLATED );
+
+		interleaved.push_back( level );
+		interleaved.push_back( padded( cv::Rect( _cachedWindowDim, _cachedWindowDim,
+		                                         level.cols, level.rows ) ) );
+	}
+	cache.pyramid.swap( interleaved );
+	cache.hasDerivatives = true;
 }
 }
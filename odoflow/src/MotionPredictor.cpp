@@ -5,6 +5,8 @@
 #include "argus_utils/random/MultivariateGaussian.hpp"
 #include "camplex/FiducialCommon.h"
 
+#include <cmath>
+
 namespace argus
 {
 MotionPredictor::MotionPredictor( ros::NodeHandle& nh, ros::NodeHandle& ph )
@@ -13,6 +15,11 @@ MotionPredictor::MotionPredictor( ros::NodeHandle& nh, ros::NodeHandle& ph )
 	_maxPredictEntropy.InitializeAndRead( ph, 1.0, "max_predict_entropy",
 	                                      "Max predict uncertainty entropy" );
 
+	unsigned int bufferSize;
+	GetParam( ph, "prediction_buffer_size", bufferSize, 200u );
+	_velBuffer.SetCapacity( bufferSize );
+	GetParam( ph, "prediction_extrinsics_ttl", _extrinsicsTtl, 1.0 );
+
 	GetParam( ph, "enable_prediction", _enablePrediction, false );
 	if( _enablePrediction )
 	{
@@ -35,52 +42,39 @@ MotionPredictor::MotionPredictor( ros::NodeHandle& nh, ros::NodeHandle& ph )
 
 void MotionPredictor::Reset()
 {
-    _velIntegrator.Reset();
+	_velBuffer.Reset();
+
+	WriteLock lock( _mutex );
+	_extrinsicsCache.clear();
 }
 
 PoseSE2 MotionPredictor::PredictMotion( const ros::Time& fromTime,
-                                           const ros::Time& currTime,
-                                           const std::string& camFrame,
-                                           double scale )
+                                        const ros::Time& currTime,
+                                        const std::string& camFrame,
+                                        double scale )
 {
+	if( !_enablePrediction ) { return PoseSE2(); }
+
 	// Can't predict motion if we haven't received any odom messages
-	if( !_enablePrediction || _odomFrame.empty() )
+	std::string odomFrame;
+	PoseSE3 odomToCam;
+	if( !GetOdomToCamera( camFrame, currTime, odomFrame, odomToCam ) )
 	{
-		if( _odomFrame.empty() )
-		{
-			ROS_WARN_STREAM( "Prediction enabled but no odometry messages received" );
-		}
 		return PoseSE2();
 	}
 
 	PoseSE3 odomDisp;
 	PoseSE3::CovarianceMatrix odomCov;
-	if( !_velIntegrator.Integrate( fromTime.toSec(), currTime.toSec(),
-	                               odomDisp, odomCov ) )
+	if( !_velBuffer.Integrate( fromTime.toSec(), currTime.toSec(),
+	                           odomDisp, odomCov ) )
 	{
 		ROS_WARN_STREAM( "Could not predict motion from " << fromTime << " to " << currTime );
 		odomDisp = PoseSE3(); // Unnecessary
 		odomCov = PoseSE3::CovarianceMatrix::Identity(); // TODO
 	}
 
-	PoseSE3 odomToCam;
-	PoseSE3 camDisp;
-	PoseSE3::CovarianceMatrix guessCov; // TODO Use the covariance?
-	try
-	{
-		odomToCam = _extrinsics.GetExtrinsics( _odomFrame,
-		                                       camFrame,
-		                                       currTime );
-	}
-	catch( ExtrinsicsException& e )
-	{
-		ROS_WARN_STREAM( "Could not get extrinsics: " << e.what() );
-		return PoseSE2();
-		// guessCov = odomCov;
-	}
-
-	camDisp = odomToCam * odomDisp * odomToCam.Inverse();
-	guessCov = TransformCovariance( odomCov, odomToCam );
+	PoseSE3 camDisp = odomToCam * odomDisp * odomToCam.Inverse();
+	PoseSE3::CovarianceMatrix guessCov = TransformCovariance( odomCov, odomToCam ); // TODO Use the covariance?
 	// HACK Hard-coded indices corresponding to y, z, x_ang
 	// which in turn correspond to camera translation and roll for standard (x-forward) conventions
 	MatrixType subCov( 3, 3 );
@@ -103,20 +97,84 @@ PoseSE2 MotionPredictor::PredictMotion( const ros::Time& fromTime,
 	return ret;
 }
 
+bool MotionPredictor::GetOdomToCamera( const std::string& camFrame,
+                                       const ros::Time& time,
+                                       std::string& odomFrame,
+                                       PoseSE3& odomToCam )
+{
+	{
+		ReadLock lock( _mutex );
+		odomFrame = _odomFrame;
+		if( odomFrame.empty() )
+		{
+			ROS_WARN_STREAM( "Prediction enabled but no odometry messages received" );
+			return false;
+		}
+
+		ExtrinsicsCache::const_iterator iter = _extrinsicsCache.find( camFrame );
+		if( iter != _extrinsicsCache.end() &&
+		    std::abs( ( time - iter->second.time ).toSec() ) <= _extrinsicsTtl )
+		{
+			odomToCam = iter->second.odomToCam;
+			return true;
+		}
+	}
+
+	// The lookup can block, so it is done unlocked and only the cache is
+	// updated under the lock
+	try
+	{
+		odomToCam = _extrinsics.GetExtrinsics( odomFrame, camFrame, time );
+	}
+	catch( ExtrinsicsException& e )
+	{
+		ROS_WARN_STREAM( "Could not get extrinsics: " << e.what() );
+		return false;
+	}
+
+	// Don't cache if the odometry frame changed during the lookup
+	WriteLock lock( _mutex );
+	if( odomFrame == _odomFrame )
+	{
+		CachedExtrinsics& cached = _extrinsicsCache[camFrame];
+		cached.time = time;
+		cached.odomToCam = odomToCam;
+	}
+	return true;
+}
+
+void MotionPredictor::SetOdomFrame( const std::string& frame )
+{
+	{
+		ReadLock lock( _mutex );
+		if( frame == _odomFrame ) { return; }
+	}
+
+	WriteLock lock( _mutex );
+	_odomFrame = frame;
+	_extrinsicsCache.clear();
+}
+
 void MotionPredictor::OdometryCallback( const nav_msgs::Odometry::ConstPtr& msg )
 {
 	PoseSE3::TangentVector vel = MsgToTangent( msg->twist.twist );
 	PoseSE3::CovarianceMatrix cov;
 	ParseMatrix( msg->twist.covariance, cov );
-	_velIntegrator.BufferInfo( msg->header.stamp.toSec(), vel, cov );
-	_odomFrame = msg->child_frame_id;
+	if( !_velBuffer.BufferInfo( msg->header.stamp.toSec(), vel, cov ) )
+	{
+		ROS_WARN_STREAM( "Dropping out-of-order odometry message at " << msg->header.stamp );
+	}
+	SetOdomFrame( msg->child_frame_id );
 }
 
 void MotionPredictor::TwistStampedCallback( const geometry_msgs::TwistStamped::ConstPtr& msg )
 {
 	PoseSE3::TangentVector vel = MsgToTangent( msg->twist );
 	PoseSE3::CovarianceMatrix cov = PoseSE3::CovarianceMatrix::Zero();
-	_velIntegrator.BufferInfo( msg->header.stamp.toSec(), vel, cov );
-	_odomFrame = msg->header.frame_id;
+	if( !_velBuffer.BufferInfo( msg->header.stamp.toSec(), vel, cov ) )
+	{
+		ROS_WARN_STREAM( "Dropping out-of-order twist message at " << msg->header.stamp );
+	}
+	SetOdomFrame( msg->header.frame_id );
+}
 }
-}
\ No newline at end of file
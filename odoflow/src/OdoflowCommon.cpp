@@ -1,8 +1,11 @@
 #include "odoflow/OdoflowCommon.h"
+#include "odoflow/PointTransformTable.h"
 
 #include <opencv2/imgproc.hpp>
 #include <opencv2/calib3d.hpp>
 
+#include <algorithm>
+
 namespace argus
 {
 std::ostream& operator<<( std::ostream& os, const InterestPoints& points )
@@ -15,26 +18,6 @@ std::ostream& operator<<( std::ostream& os, const InterestPoints& points )
 	return os;
 }
 
-InterestPointsf DowncastInterestPoints( const InterestPoints& in )
-{
-	InterestPointsf out( in.size() );
-	for( unsigned int i = 0; i < in.size(); i++ )
-	{
-		out[i] = cv::Point2f( in[i].x, in[i].y );
-	}
-	return out;
-}
-
-InterestPoints UpcastInterestPoints( const InterestPointsf& in )
-{
-	InterestPoints out( in.size() );
-	for( unsigned int i = 0; i < in.size(); i++ )
-	{
-		out[i] = cv::Point2d( in[i].x, in[i].y );
-	}
-	return out;
-}
-
 InterestPoints ProcessPoints( const InterestPoints& points,
                               const CameraCalibration& model,
                               bool undistort,
@@ -58,7 +41,7 @@ InterestPoints UnprocessPoints( const InterestPoints& points,
                                 bool distort,
                                 bool unnormalize )
 {
-	std::vector<cv::Point3d> points3;
+	std::vector<cv::Point3f> points3;
 	convertPointsToHomogeneous( points, points3 );
 
 	InterestPoints distPoints;
@@ -113,28 +96,175 @@ InterestPoints DistortAndUnnormalizePoints( const InterestPoints& points,
 	return UnprocessPoints( points, model, true, true );
 }
 
+InterestPoints UndistortPoints( const InterestPoints& points,
+                                const CameraCalibration& model,
+                                const PointTransformTable* table )
+{
+	InterestPoints undistorted;
+	UndistortPoints( points, model, table, undistorted );
+	return undistorted;
+}
+
+void UndistortPoints( const InterestPoints& points,
+                      const CameraCalibration& model,
+                      const PointTransformTable* table,
+                      InterestPoints& out )
+{
+	if( !table || !table->Matches( model ) )
+	{
+		out = UndistortPoints( points, model );
+		return;
+	}
+
+	table->UndistortAndNormalize( points, out );
+	const cv::Matx33d& K = model.GetIntrinsicMatrix();
+	for( unsigned int i = 0; i < out.size(); ++i )
+	{
+		InterestPoint& p = out[i];
+		p = InterestPoint( K( 0, 0 ) * p.x + K( 0, 1 ) * p.y + K( 0, 2 ),
+		                   K( 1, 1 ) * p.y + K( 1, 2 ) );
+	}
+}
+
+InterestPoints UndistortAndNormalizePoints( const InterestPoints& points,
+                                            const CameraCalibration& model,
+                                            const PointTransformTable* table )
+{
+	if( !table || !table->Matches( model ) )
+	{
+		return UndistortAndNormalizePoints( points, model );
+	}
+	return table->UndistortAndNormalize( points );
+}
+
+InterestPoints DistortAndUnnormalizePoints( const InterestPoints& points,
+                                            const CameraCalibration& model,
+                                            const PointTransformTable* table )
+{
+	InterestPoints distorted;
+	DistortAndUnnormalizePoints( points, model, table, distorted );
+	return distorted;
+}
+
+void DistortAndUnnormalizePoints( const InterestPoints& points,
+                                  const CameraCalibration& model,
+                                  const PointTransformTable* table,
+                                  InterestPoints& out )
+{
+	if( !table || !table->Matches( model ) )
+	{
+		out = DistortAndUnnormalizePoints( points, model );
+		return;
+	}
+	table->DistortAndUnnormalize( points, out );
+}
+
+void NormalizePoints( const InterestPoints& points,
+                      const CameraCalibration& model,
+                      InterestPoints& out )
+{
+	const cv::Matx33d& K = model.GetIntrinsicMatrix();
+	out.resize( points.size() );
+	for( unsigned int i = 0; i < points.size(); ++i )
+	{
+		double y = ( points[i].y - K( 1, 2 ) ) / K( 1, 1 );
+		double x = ( points[i].x - K( 0, 2 ) - K( 0, 1 ) * y ) / K( 0, 0 );
+		out[i] = InterestPoint( x, y );
+	}
+}
+
 InterestPoints TransformPoints( const InterestPoints& points,
                                 const PoseSE2& trans )
+{
+	InterestPoints transformed;
+	TransformPoints( points, trans, transformed );
+	return transformed;
+}
+
+void TransformPoints( const InterestPoints& points,
+                      const PoseSE2& trans,
+                      InterestPoints& out )
 {
 	if( points.empty() )
 	{
 		throw std::invalid_argument( "TransformPoints: Empty points given." );
 	}
 
-	Eigen::Matrix<double, 2, Eigen::Dynamic> pts( 2, points.size() );
+	const FixedMatrixType<3, 3> H = trans.ToMatrix();
+	out.resize( points.size() );
 	for( unsigned int i = 0; i < points.size(); ++i )
 	{
-		pts( 0, i ) = points[i].x;
-		pts( 1, i ) = points[i].y;
+		double x = points[i].x;
+		double y = points[i].y;
+		out[i] = InterestPoint( H( 0, 0 ) * x + H( 0, 1 ) * y + H( 0, 2 ),
+		                        H( 1, 0 ) * x + H( 1, 1 ) * y + H( 1, 2 ) );
 	}
+}
 
-	pts = trans.ToTransform() * pts;
-	InterestPoints transformed;
-	transformed.reserve( points.size() );
-	for( unsigned int i = 0; i < points.size(); ++i )
+void SelectGradientPixels( const cv::Mat& image,
+                           unsigned int cellDim,
+                           double ratio,
+                           double minGradient,
+                           std::vector<cv::Point>& pixels )
+{
+	pixels.clear();
+	if( image.empty() || cellDim == 0 || ratio <= 0 ) { return; }
+
+	cv::Mat gx, gy, magnitude;
+	cv::Scharr( image, gx, CV_32F, 1, 0, 1.0 / 32 );
+	cv::Scharr( image, gy, CV_32F, 0, 1, 1.0 / 32 );
+	magnitude = cv::abs( gx ) + cv::abs( gy );
+
+	typedef std::pair<float, cv::Point> Candidate;
+	std::vector<Candidate> candidates;
+	candidates.reserve( cellDim * cellDim );
+	pixels.reserve( std::ceil( ratio * image.total() ) );
+	for( int y0 = 0; y0 < image.rows; y0 += cellDim )
 	{
-		transformed.emplace_back( pts( 0, i ), pts( 1, i ) );
+		int y1 = std::min( y0 + (int) cellDim, image.rows );
+		for( int x0 = 0; x0 < image.cols; x0 += cellDim )
+		{
+			int x1 = std::min( x0 + (int) cellDim, image.cols );
+
+			candidates.clear();
+			for( int y = y0; y < y1; ++y )
+			{
+				const float* row = magnitude.ptr<float>( y );
+				for( int x = x0; x < x1; ++x )
+				{
+					if( row[x] > minGradient )
+					{
+						candidates.emplace_back( row[x], cv::Point( x, y ) );
+					}
+				}
+			}
+
+			size_t budget = std::max( (size_t) std::round( ratio * ( x1 - x0 ) * ( y1 - y0 ) ),
+			                          (size_t) 1 );
+			if( candidates.size() > budget )
+			{
+				std::nth_element( candidates.begin(),
+				                  candidates.begin() + budget,
+				                  candidates.end(),
+				                  []( const Candidate& a, const Candidate& b ) { return a.first > b.first; } );
+				candidates.resize( budget );
+			}
+			for( unsigned int i = 0; i < candidates.size(); ++i )
+			{
+				pixels.push_back( candidates[i].second );
+			}
+		}
 	}
-	return transformed;
+}
+
+cv::Mat PixelsToMask( const std::vector<cv::Point>& pixels,
+                      const cv::Size& size )
+{
+	cv::Mat mask = cv::Mat::zeros( size, CV_8U );
+	for( unsigned int i = 0; i < pixels.size(); ++i )
+	{
+		mask.at<uchar>( pixels[i] ) = 255;
+	}
+	return mask;
 }
 }
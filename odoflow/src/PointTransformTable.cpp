@@ -0,0 +1,209 @@
+#include "odoflow/PointTransformTable.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace argus
+{
+static void split_points( const InterestPoints& values,
+                          std::vector<float>& outX,
+                          std::vector<float>& outY )
+{
+	outX.resize( values.size() );
+	outY.resize( values.size() );
+	for( unsigned int i = 0; i < values.size(); ++i )
+	{
+		outX[i] = values[i].x;
+		outY[i] = values[i].y;
+	}
+}
+
+// Returns row-major grid nodes starting at the origin
+static InterestPoints make_nodes( double originX, double originY, double step,
+                                  int cols, int rows )
+{
+	InterestPoints nodes;
+	nodes.reserve( cols * rows );
+	for( int r = 0; r < rows; ++r )
+	{
+		for( int c = 0; c < cols; ++c )
+		{
+			nodes.emplace_back( originX + c * step, originY + r * step );
+		}
+	}
+	return nodes;
+}
+
+PointTransformTable::PointTransformTable( const CameraCalibration& model,
+                                          unsigned int cellDim )
+	: _model( model )
+{
+	if( cellDim == 0 )
+	{
+		throw std::invalid_argument( "PointTransformTable: Cell dim must be positive." );
+	}
+	cv::Size size = model.GetScale();
+	if( size.width <= 0 || size.height <= 0 )
+	{
+		throw std::invalid_argument( "PointTransformTable: Calibration has no image size." );
+	}
+
+	// Pixel to unit plane over the image, with the last node at or past the border
+	_undistort.originX = 0;
+	_undistort.originY = 0;
+	_undistort.invStep = 1.0 / cellDim;
+	_undistort.cols = ( size.width + cellDim - 1 ) / cellDim + 1;
+	_undistort.rows = ( size.height + cellDim - 1 ) / cellDim + 1;
+	InterestPoints pixelNodes = make_nodes( 0, 0, cellDim, _undistort.cols, _undistort.rows );
+	InterestPoints normalized = UndistortAndNormalizePoints( pixelNodes, model );
+	split_points( normalized, _undistort.outX, _undistort.outY );
+
+	// Unit plane to pixel over the bounds of the undistorted image, with
+	// about the same resolution
+	double minX = std::numeric_limits<double>::infinity();
+	double minY = minX;
+	double maxX = -minX;
+	double maxY = -minX;
+	for( unsigned int i = 0; i < normalized.size(); ++i )
+	{
+		minX = std::min( minX, (double) normalized[i].x );
+		minY = std::min( minY, (double) normalized[i].y );
+		maxX = std::max( maxX, (double) normalized[i].x );
+		maxY = std::max( maxY, (double) normalized[i].y );
+	}
+	double step = cellDim / std::max( model.GetFx(), model.GetFy() );
+	_distort.originX = minX;
+	_distort.originY = minY;
+	_distort.invStep = 1.0 / step;
+	_distort.cols = std::ceil( ( maxX - minX ) / step ) + 1;
+	_distort.rows = std::ceil( ( maxY - minY ) / step ) + 1;
+	InterestPoints planeNodes = make_nodes( minX, minY, step, _distort.cols, _distort.rows );
+	InterestPoints pixels = DistortAndUnnormalizePoints( planeNodes, model );
+	split_points( pixels, _distort.outX, _distort.outY );
+}
+
+bool PointTransformTable::Matches( const CameraCalibration& model ) const
+{
+	if( model.GetScale() != _model.GetScale() ||
+	    model.GetIntrinsicMatrix() != _model.GetIntrinsicMatrix() )
+	{
+		return false;
+	}
+	const cv::Mat& a = model.GetDistortionCoeffs();
+	const cv::Mat& b = _model.GetDistortionCoeffs();
+	if( a.empty() || b.empty() ) { return a.empty() && b.empty(); }
+	return a.total() == b.total() && a.type() == b.type() &&
+	       cv::norm( a, b, cv::NORM_INF ) == 0;
+}
+
+const CameraCalibration& PointTransformTable::GetCalibration() const
+{
+	return _model;
+}
+
+inline bool PointTransformTable::Grid::EvaluatePoint( float x, float y,
+                                                      float& u, float& v ) const
+{
+	const float maxX = cols - 1;
+	const float maxY = rows - 1;
+	float fx = ( x - originX ) * invStep;
+	float fy = ( y - originY ) * invStep;
+	bool inside = fx >= 0 && fy >= 0 && fx <= maxX && fy <= maxY;
+
+	// Clamp so that invalid points still index within the table
+	fx = std::min( std::max( fx, 0.0f ), maxX );
+	fy = std::min( std::max( fy, 0.0f ), maxY );
+	int ix = std::min( (int) fx, cols - 2 );
+	int iy = std::min( (int) fy, rows - 2 );
+	float ax = fx - ix;
+	float ay = fy - iy;
+
+	int i00 = iy * cols + ix;
+	int i10 = i00 + cols;
+	float w00 = ( 1 - ax ) * ( 1 - ay );
+	float w01 = ax * ( 1 - ay );
+	float w10 = ( 1 - ax ) * ay;
+	float w11 = ax * ay;
+	const float* gx = outX.data();
+	const float* gy = outY.data();
+	u = w00 * gx[i00] + w01 * gx[i00 + 1] + w10 * gx[i10] + w11 * gx[i10 + 1];
+	v = w00 * gy[i00] + w01 * gy[i00 + 1] + w10 * gy[i10] + w11 * gy[i10 + 1];
+	return inside;
+}
+
+void PointTransformTable::Grid::Evaluate( const float* x, const float* y,
+                                          float* u, float* v,
+                                          unsigned char* valid, size_t n ) const
+{
+	for( size_t i = 0; i < n; ++i )
+	{
+		valid[i] = EvaluatePoint( x[i], y[i], u[i], v[i] );
+	}
+}
+
+void PointTransformTable::UndistortAndNormalize( const float* x, const float* y,
+                                                 float* u, float* v,
+                                                 unsigned char* valid, size_t n ) const
+{
+	_undistort.Evaluate( x, y, u, v, valid, n );
+}
+
+void PointTransformTable::DistortAndUnnormalize( const float* x, const float* y,
+                                                 float* u, float* v,
+                                                 unsigned char* valid, size_t n ) const
+{
+	_distort.Evaluate( x, y, u, v, valid, n );
+}
+
+InterestPoints PointTransformTable::UndistortAndNormalize( const InterestPoints& points ) const
+{
+	InterestPoints out;
+	Transform( _undistort, &UndistortAndNormalizePoints, points, out );
+	return out;
+}
+
+InterestPoints PointTransformTable::DistortAndUnnormalize( const InterestPoints& points ) const
+{
+	InterestPoints out;
+	Transform( _distort, &DistortAndUnnormalizePoints, points, out );
+	return out;
+}
+
+void PointTransformTable::UndistortAndNormalize( const InterestPoints& points,
+                                                 InterestPoints& out ) const
+{
+	Transform( _undistort, &UndistortAndNormalizePoints, points, out );
+}
+
+void PointTransformTable::DistortAndUnnormalize( const InterestPoints& points,
+                                                 InterestPoints& out ) const
+{
+	Transform( _distort, &DistortAndUnnormalizePoints, points, out );
+}
+
+void PointTransformTable::Transform( const Grid& grid,
+                                     ExactTransform exact,
+                                     const InterestPoints& points,
+                                     InterestPoints& out ) const
+{
+	const size_t n = points.size();
+	out.resize( n );
+	InterestPoints outside;
+	std::vector<size_t> outsideInds;
+	for( size_t i = 0; i < n; ++i )
+	{
+		if( !grid.EvaluatePoint( points[i].x, points[i].y, out[i].x, out[i].y ) )
+		{
+			outside.push_back( points[i] );
+			outsideInds.push_back( i );
+		}
+	}
+	if( outside.empty() ) { return; }
+
+	InterestPoints exactOut = exact( outside, _model );
+	for( size_t i = 0; i < outsideInds.size(); ++i )
+	{
+		out[outsideInds[i]] = exactOut[i];
+	}
+}
+}
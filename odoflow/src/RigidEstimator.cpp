@@ -2,70 +2,361 @@
 #include "camplex/FiducialCommon.h"
 #include "argus_utils/utils/ParamUtils.h"
 
+#include <boost/bind.hpp>
 #include <opencv2/calib3d.hpp>
 #include <Eigen/SVD>
 
+// Min squared length of the segment between two sampled points
+#define TWO_POINT_MIN_SEPARATION_SQ (1E-12)
+
 namespace argus
 {
+typedef Eigen::Array<float, Eigen::Dynamic, 1> FloatArray;
+typedef Eigen::Array<unsigned char, Eigen::Dynamic, 1> MaskArray;
+
+// Copies interleaved points into contiguous x and y arrays, reusing capacity
+static void split_points( const InterestPoints& points, std::vector<float>& xs,
+                          std::vector<float>& ys )
+{
+	xs.resize( points.size() );
+	ys.resize( points.size() );
+	for( unsigned int i = 0; i < points.size(); ++i )
+	{
+		xs[i] = points[i].x;
+		ys[i] = points[i].y;
+	}
+}
+
+RigidEstimatorParams::RigidEstimatorParams()
+	: method( METHOD_HOMOGRAPHY ),
+	logReprojThreshold( -2 ),
+	maxIters( 10 ),
+	confidence( 0.99 ) {}
+
+std::ostream& operator<<( std::ostream& os, const RigidEstimatorParams& params )
+{
+	os << "method: " << ( params.method == RigidEstimatorParams::METHOD_TWO_POINT ?
+	                      "two_point" : "homography" ) << std::endl;
+	os << "log reprojection threshold: " << params.logReprojThreshold << std::endl;
+	os << "max iters: " << params.maxIters << std::endl;
+	os << "confidence: " << params.confidence;
+	return os;
+}
+
+RigidEstimator::RigidEstimator( const RigidEstimatorParams& params )
+	: _lastNumIterations( 0 )
+{
+	SetParams( params );
+}
+
 RigidEstimator::RigidEstimator( ros::NodeHandle& nh, ros::NodeHandle& ph )
+	: _lastNumIterations( 0 )
 {
-	_logReprojThreshold.Initialize( ph, -2,
+	RigidEstimatorParams defaults;
+
+	std::string method;
+	GetParam<std::string>( ph, "method", method, "homography" );
+	_params.method = StringToMethod( method );
+
+	_logReprojThreshold.Initialize( ph, defaults.logReprojThreshold,
 	                                "log_reprojection_threshold",
 	                                "RANSAC log10 reprojection inlier threshold" );
 
-	_maxIters.Initialize( ph, 10, "max_iters",
+	_maxIters.Initialize( ph, defaults.maxIters, "max_iters",
 	                      "RANSAC max iterations" );
 	_maxIters.AddCheck<GreaterThan>( 0 );
 	_maxIters.AddCheck<IntegerValued>( ROUND_CEIL );
+
+	_confidence.Initialize( ph, defaults.confidence, "confidence",
+	                        "Two-point RANSAC termination confidence" );
+	_confidence.AddCheck<GreaterThan>( 0 );
+	_confidence.AddCheck<LessThan>( 1.0 );
+
+	ReadParams();
+	NumericParam::Callback cb = boost::bind( &RigidEstimator::ReadParams, this );
+	_logReprojThreshold.AddCallback( cb );
+	_maxIters.AddCallback( cb );
+	_confidence.AddCallback( cb );
+}
+
+void RigidEstimator::ReadParams()
+{
+	// The method is not a runtime parameter
+	RigidEstimatorParams params = GetParams();
+	params.logReprojThreshold = _logReprojThreshold;
+	params.maxIters = _maxIters;
+	params.confidence = _confidence;
+	SetParams( params );
+}
+
+void RigidEstimator::SetParams( const RigidEstimatorParams& params )
+{
+	if( params.maxIters == 0 )
+	{
+		throw std::invalid_argument( "RigidEstimator: Max iterations must be positive." );
+	}
+	if( params.confidence <= 0 || params.confidence >= 1.0 )
+	{
+		throw std::invalid_argument( "RigidEstimator: Confidence must be in (0, 1)." );
+	}
+
+	WriteLock lock( _mutex );
+	_params = params;
+}
+
+RigidEstimatorParams RigidEstimator::GetParams() const
+{
+	ReadLock lock( _mutex );
+	return _params;
+}
+
+RigidEstimatorParams::Method RigidEstimator::StringToMethod( const std::string& str )
+{
+	if( str == "homography" )
+	{
+		return RigidEstimatorParams::METHOD_HOMOGRAPHY;
+	}
+	else if( str == "two_point" )
+	{
+		return RigidEstimatorParams::METHOD_TWO_POINT;
+	}
+	else
+	{
+		throw std::invalid_argument( "RigidEstimator: Unknown method " + str );
+	}
 }
 
 bool RigidEstimator::EstimateMotion( InterestPoints& key,
                                      InterestPoints& tar,
-									 std::vector<unsigned int>& inlierInds,
+                                     std::vector<unsigned int>& inlierInds,
                                      PoseSE2& transform  )
 {
+	inlierInds.clear();
+	_lastNumIterations = 0;
 	if( key.empty() || tar.empty() )
 	{
 		ROS_INFO_STREAM( "RigidEstimator: Received empty points." );
 		return false;
 	}
+	if( key.size() != tar.size() )
+	{
+		ROS_WARN_STREAM( "RigidEstimator: Received " << key.size() << " key points but "
+		                 << tar.size() << " target points." );
+		return false;
+	}
+
+	RigidEstimatorParams params = GetParams();
+	Eigen::Matrix2d R;
+	Eigen::Vector2d t;
+	bool success = params.method == RigidEstimatorParams::METHOD_TWO_POINT ?
+	               EstimateTwoPoint( params, key, tar, inlierInds, R, t ) :
+	               EstimateHomography( params, key, tar, inlierInds, R, t );
+	if( !success ) { return false; }
+
+	// NOTE Image coordinates, converted to standard coordinates by CameraToStandard
+	FixedMatrixType<3, 3> H = FixedMatrixType<3, 3>::Identity();
+	H.block<2, 2>( 0, 0 ) = R;
+	H.block<2, 1>( 0, 2 ) = t;
+	transform = PoseSE2( H );
+	return true;
+}
+
+unsigned int RigidEstimator::GetLastNumIterations() const
+{
+	return _lastNumIterations;
+}
 
-	std::vector<char> inliers;
+bool RigidEstimator::EstimateHomography( const RigidEstimatorParams& params,
+                                         InterestPoints& key,
+                                         InterestPoints& tar,
+                                         std::vector<unsigned int>& inlierInds,
+                                         Eigen::Matrix2d& R,
+                                         Eigen::Vector2d& t )
+{
+	_lastNumIterations = 0; // Not reported by OpenCV
 	// We want tar in frame of key, so this is the ordering
 	cv::Mat Hxest = cv::findHomography( tar,
 	                                    key,
 	                                    cv::RANSAC,
-	                                    std::pow( 10, _logReprojThreshold ),
-	                                    inliers,
-	                                    _maxIters );
+	                                    std::pow( 10, params.logReprojThreshold ),
+	                                    _inliers,
+	                                    params.maxIters );
 	if( Hxest.empty() )
 	{
 		ROS_INFO_STREAM( "RigidEstimator: Failed to find homography." );
 		return false;
 	}
 
-	InterestPoints keyInliers, tarInliers;
-	for( unsigned int i = 0; i < inliers.size(); i++ )
+	for( unsigned int i = 0; i < _inliers.size(); i++ )
 	{
-		if( inliers[i] )
+		if( _inliers[i] )
 		{
 			inlierInds.push_back(i);
 		}
 	}
 
-	Eigen::MatrixXd Ab = MatToEigen<double>( Hxest );
-
 	// Extract the rotation using Procrustes solution
-	Eigen::Matrix2d A = Ab.block<2, 2>( 0, 0 );
+	Eigen::Matrix2d A;
+	A << Hxest.at<double>( 0, 0 ), Hxest.at<double>( 0, 1 ),
+	     Hxest.at<double>( 1, 0 ), Hxest.at<double>( 1, 1 );
 	Eigen::JacobiSVD<Eigen::Matrix2d> svd( A, Eigen::ComputeFullU | Eigen::ComputeFullV );
-	Eigen::Matrix2d R = svd.matrixU() * svd.matrixV().transpose();
+	R = svd.matrixU() * svd.matrixV().transpose();
+	t << Hxest.at<double>( 0, 2 ), Hxest.at<double>( 1, 2 );
+	return true;
+}
 
-	// NOTE We use standard coordinates (x-forward)
-	FixedMatrixType<3, 3> H = FixedMatrixType<3, 3>::Identity();
-	H.block<2, 2>( 1, 1 ) = R;
-	H( 1, 2 ) = -Ab( 0, 2 ); // Image x corresponds to camera -y
-	H( 2, 2 ) = -Ab( 1, 2 ); // Image y corresponds to camera -z
-	transform = PoseSE2( H );
+bool RigidEstimator::EstimateTwoPoint( const RigidEstimatorParams& params,
+                                       InterestPoints& key,
+                                       InterestPoints& tar,
+                                       std::vector<unsigned int>& inlierInds,
+                                       Eigen::Matrix2d& R,
+                                       Eigen::Vector2d& t )
+{
+	const unsigned int n = key.size();
+	if( n < 2 )
+	{
+		ROS_INFO_STREAM( "RigidEstimator: Need at least 2 points." );
+		return false;
+	}
+
+	split_points( key, _keyX, _keyY );
+	split_points( tar, _tarX, _tarY );
+	_residualsSq.resize( n );
+
+	const double thresh = std::pow( 10, params.logReprojThreshold );
+	const double threshSq = thresh * thresh;
+	const double logFail = std::log( 1.0 - params.confidence );
+	unsigned int maxIters = params.maxIters;
+
+	std::uniform_int_distribution<unsigned int> firstDist( 0, n - 1 );
+	std::uniform_int_distribution<unsigned int> secondDist( 0, n - 2 );
+
+	unsigned int bestCount = 0;
+	Eigen::Matrix2d hypR;
+	Eigen::Vector2d hypT;
+	for( unsigned int iter = 0; iter < maxIters; ++iter )
+	{
+		_lastNumIterations = iter + 1;
+		unsigned int i = firstDist( _generator );
+		unsigned int j = secondDist( _generator );
+		if( j >= i ) { ++j; }
+
+		// Closed-form rotation aligning the sampled segments
+		Eigen::Vector2d dt( tar[j].x - tar[i].x, tar[j].y - tar[i].y );
+		Eigen::Vector2d dk( key[j].x - key[i].x, key[j].y - key[i].y );
+		if( dt.squaredNorm() < TWO_POINT_MIN_SEPARATION_SQ ||
+		    dk.squaredNorm() < TWO_POINT_MIN_SEPARATION_SQ )
+		{
+			continue;
+		}
+		double angle = std::atan2( dt.x() * dk.y() - dt.y() * dk.x(), dt.dot( dk ) );
+		double c = std::cos( angle );
+		double s = std::sin( angle );
+		hypR << c, -s, s, c;
+		Eigen::Vector2d keySum( key[i].x + key[j].x, key[i].y + key[j].y );
+		Eigen::Vector2d tarSum( tar[i].x + tar[j].x, tar[i].y + tar[j].y );
+		hypT = 0.5 * ( keySum - hypR * tarSum );
+
+		unsigned int count = ScoreInliers( hypR, hypT, threshSq, _inliers );
+		if( count <= bestCount ) { continue; }
+
+		bestCount = count;
+		_bestInliers.swap( _inliers );
+
+		// Shrink the iteration budget as the best inlier ratio improves
+		double w = (double) bestCount / n;
+		double pFail = 1.0 - w * w;
+		if( pFail <= 0 ) { break; }
+		double needed = std::ceil( logFail / std::log( pFail ) );
+		if( needed < maxIters ) { maxIters = std::max( (unsigned int) needed, iter + 1 ); }
+	}
+
+	if( bestCount < 2 )
+	{
+		ROS_INFO_STREAM( "RigidEstimator: Failed to find rigid motion." );
+		return false;
+	}
+
+	// Refit on the consensus set, then rescore with the refined model
+	if( !FitRigid( key, tar, _bestInliers, R, t ) )
+	{
+		ROS_INFO_STREAM( "RigidEstimator: Failed to refit rigid motion." );
+		return false;
+	}
+	if( ScoreInliers( R, t, threshSq, _inliers ) >= bestCount )
+	{
+		_bestInliers.swap( _inliers );
+	}
+
+	inlierInds.reserve( n );
+	for( unsigned int i = 0; i < n; ++i )
+	{
+		if( _bestInliers[i] ) { inlierInds.push_back( i ); }
+	}
+	return true;
+}
+
+unsigned int RigidEstimator::ScoreInliers( const Eigen::Matrix2d& R,
+                                           const Eigen::Vector2d& t,
+                                           double threshSq,
+                                           std::vector<unsigned char>& inliers )
+{
+	const unsigned int n = _keyX.size();
+	Eigen::Map<const FloatArray> keyX( _keyX.data(), n );
+	Eigen::Map<const FloatArray> keyY( _keyY.data(), n );
+	Eigen::Map<const FloatArray> tarX( _tarX.data(), n );
+	Eigen::Map<const FloatArray> tarY( _tarY.data(), n );
+	Eigen::Map<FloatArray> residualsSq( _residualsSq.data(), n );
+
+	const Eigen::Matrix2f Rf = R.cast<float>();
+	const Eigen::Vector2f tf = t.cast<float>();
+	residualsSq = ( Rf( 0, 0 ) * tarX + Rf( 0, 1 ) * tarY + tf( 0 ) - keyX ).square() +
+	              ( Rf( 1, 0 ) * tarX + Rf( 1, 1 ) * tarY + tf( 1 ) - keyY ).square();
+
+	inliers.resize( n );
+	Eigen::Map<MaskArray> mask( inliers.data(), n );
+	mask = ( residualsSq < (float) threshSq ).cast<unsigned char>();
+	return mask.cast<unsigned int>().sum();
+}
+
+bool RigidEstimator::FitRigid( const InterestPoints& key,
+                               const InterestPoints& tar,
+                               const std::vector<unsigned char>& inliers,
+                               Eigen::Matrix2d& R,
+                               Eigen::Vector2d& t )
+{
+	unsigned int count = 0;
+	Eigen::Vector2d keyMean = Eigen::Vector2d::Zero();
+	Eigen::Vector2d tarMean = Eigen::Vector2d::Zero();
+	for( unsigned int i = 0; i < key.size(); ++i )
+	{
+		if( !inliers[i] ) { continue; }
+		keyMean += Eigen::Vector2d( key[i].x, key[i].y );
+		tarMean += Eigen::Vector2d( tar[i].x, tar[i].y );
+		++count;
+	}
+	if( count < 2 ) { return false; }
+	keyMean /= count;
+	tarMean /= count;
+
+	Eigen::Matrix2d cov = Eigen::Matrix2d::Zero();
+	for( unsigned int i = 0; i < key.size(); ++i )
+	{
+		if( !inliers[i] ) { continue; }
+		Eigen::Vector2d k = Eigen::Vector2d( key[i].x, key[i].y ) - keyMean;
+		Eigen::Vector2d p = Eigen::Vector2d( tar[i].x, tar[i].y ) - tarMean;
+		cov += p * k.transpose();
+	}
+
+	// Kabsch solution with reflection correction
+	Eigen::JacobiSVD<Eigen::Matrix2d> svd( cov, Eigen::ComputeFullU | Eigen::ComputeFullV );
+	Eigen::Matrix2d D = Eigen::Matrix2d::Identity();
+	if( ( svd.matrixV() * svd.matrixU().transpose() ).determinant() < 0 )
+	{
+		D( 1, 1 ) = -1;
+	}
+	R = svd.matrixV() * D * svd.matrixU().transpose();
+	t = keyMean - R * tarMean;
 	return true;
 }
 }
@@ -0,0 +1,116 @@
+#include "odoflow/VelocityBuffer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace argus
+{
+VelocityBuffer::VelocityBuffer( unsigned int capacity )
+{
+	SetCapacity( capacity );
+}
+
+void VelocityBuffer::SetCapacity( unsigned int capacity )
+{
+	if( capacity == 0 )
+	{
+		throw std::invalid_argument( "VelocityBuffer: Capacity must be positive" );
+	}
+
+	WriteLock lock( _mutex );
+	_samples.resize( capacity );
+	_start = 0;
+	_size = 0;
+}
+
+bool VelocityBuffer::BufferInfo( double time,
+                                 const PoseSE3::TangentVector& vel,
+                                 const PoseSE3::CovarianceMatrix& cov )
+{
+	WriteLock lock( _mutex );
+	if( _size > 0 && time < At( _size - 1 ).time ) { return false; }
+
+	size_t ind;
+	if( _size < _samples.size() )
+	{
+		ind = ( _start + _size ) % _samples.size();
+		++_size;
+	}
+	else
+	{
+		ind = _start;
+		_start = ( _start + 1 ) % _samples.size();
+	}
+	_samples[ind].time = time;
+	_samples[ind].vel = vel;
+	_samples[ind].cov = cov;
+	return true;
+}
+
+bool VelocityBuffer::Integrate( double fromTime, double toTime,
+                                PoseSE3& disp, PoseSE3::CovarianceMatrix& cov ) const
+{
+	if( toTime < fromTime )
+	{
+		if( !Integrate( toTime, fromTime, disp, cov ) ) { return false; }
+		disp = disp.Inverse();
+		return true;
+	}
+
+	// Copy out the samples spanning the range so that integration does not
+	// hold the lock
+	std::vector<Sample, Eigen::aligned_allocator<Sample> > spanned;
+	{
+		ReadLock lock( _mutex );
+		if( _size == 0 || At( 0 ).time > fromTime ) { return false; }
+
+		// Find the last sample at or before fromTime
+		size_t lo = 0;
+		size_t hi = _size;
+		while( hi - lo > 1 )
+		{
+			size_t mid = ( lo + hi ) / 2;
+			if( At( mid ).time <= fromTime ) { lo = mid; }
+			else { hi = mid; }
+		}
+		for( size_t i = lo; i < _size; ++i )
+		{
+			if( i > lo && At( i ).time >= toTime ) { break; }
+			spanned.push_back( At( i ) );
+		}
+	}
+
+	// Zero-order hold of each velocity until the next sample
+	disp = PoseSE3();
+	cov = PoseSE3::CovarianceMatrix::Zero();
+	for( size_t i = 0; i < spanned.size(); ++i )
+	{
+		double segStart = std::max( spanned[i].time, fromTime );
+		double segEnd = ( i + 1 < spanned.size() ) ? spanned[i + 1].time : toTime;
+		double dt = segEnd - segStart;
+		if( dt <= 0 ) { continue; }
+
+		disp = disp * PoseSE3::Exp( spanned[i].vel * dt );
+		cov += dt * dt * spanned[i].cov;
+	}
+	return true;
+}
+
+void VelocityBuffer::Reset()
+{
+	WriteLock lock( _mutex );
+	_start = 0;
+	_size = 0;
+}
+
+size_t VelocityBuffer::Size() const
+{
+	ReadLock lock( _mutex );
+	return _size;
+}
+
+const VelocityBuffer::Sample& VelocityBuffer::At( size_t i ) const
+{
+	return _samples[( _start + i ) % _samples.size()];
+}
+}